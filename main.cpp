@@ -4,24 +4,67 @@
 #include <array>
 #include <vector>
 #include <algorithm>
-#include <map>
-#include <memory>
 #include <utility>
 #include <stdexcept>
+#include <string_view>
+#include <cstdint>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <type_traits>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <map>
+#include <atomic>
+#include <deque>
+#include <cmath>
+#include <cstring>
+#include <csignal>
+#include <sstream>
+#include <charconv>
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+#endif
 
 using namespace std;
 
-/* Item system 0.5 by baelothe      *
+/* Item system 1.0 by baelothe      *
 * Changelog:                       *
 * 0.5: Initial version             *
-* Planned versions:                *
 * 0.6: Better autocasting,         *
 * inventory categories             *
 * 0.7: Inventory filters and       *
 * sorting                          *
-* 0.8: General rewrite             *
-* 0.9: Improve the main parts of   *
-* the system                       *
+* 0.8: General rewrite (tables     *
+* built at compile time, shared    *
+* prototypes, no virtuals)         *
 * 1.0: Item scripting              */
 namespace ItemSystem
 {
@@ -30,25 +73,34 @@ namespace ItemSystem
 	* this namespace.                                        */
 	namespace Items
 	{
-		/* Item categories are used to downcast to derived      *
-		* pointers and sorting the inventory (WIP).            */
+		/* Item categories are the type tags of items: they are *
+		* used to downcast to derived pointers (see itemCast())*
+		* and to sort the inventory.                           */
 		enum class Category : unsigned int {
 			CONSUMABLE, WEAPON, KEY, MISC
 		};
 		// Returns a integer value of a category (starts at 0, goes up).
-		const unsigned int categoryToValue(const Category& c) {
+		constexpr unsigned int categoryToValue(const Category& c) {
 			return static_cast<unsigned int>(c);
 		}
+		// The number of categories.
+		constexpr unsigned int categoryCount = categoryToValue(Category::MISC) + 1;
 		/* The Item class is the base type of all item objects. *
 		* Derive this to create subtypes. Making objects of    *
 		* this class won't work -- using a derived class is    *
-		* required.                                            */
+		* required. Items are literal types (string views to   *
+		* static text, no destructors) so the item tables can  *
+		* be built at compile time; keep new subtypes that way.*
+		* The subtypes are a closed set tagged by category,    *
+		* with no virtual functions: stats are plain reads     *
+		* from the item tables. A new subtype needs its own    *
+		* category (see itemCast()).                           */
 		class Item {
 		private:
 			// The display name of the item.
-			const std::string name;
+			const std::string_view name;
 			// The description of the item.
-			const std::string desc;
+			const std::string_view desc;
 			// The ID of the item.
 			const unsigned short id;
 			// The buy price of the item.
@@ -57,44 +109,44 @@ namespace ItemSystem
 			const unsigned short sell;
 			// The category of the item (used for sorting and casting).
 			const Category category;
+			// The effect script run when the item is used (see the Scripting namespace).
+			const std::string_view effect;
 		protected:
 			// ctor(s)
-			Item(const std::string& _name, const std::string& _desc,
+			constexpr Item(const std::string_view& _name, const std::string_view& _desc,
 				const unsigned short& _id, const unsigned short& _buy,
-				const unsigned short& _sell, const Category& _category)
+				const unsigned short& _sell, const Category& _category,
+				const std::string_view& _effect = "")
 				: name(_name), desc(_desc), id(_id), buy(_buy),
-				sell(_sell), category(_category) { /* empty ctor */
+				sell(_sell), category(_category), effect(_effect) { /* empty ctor */
 			}
+			// dtor(s) (not virtual -- items are never deleted through an Item pointer)
+			~Item() = default;
 		public:
 			// copy ctor(s)
-			Item(const Item& other) : name(other.name), desc(other.desc), id(other.id),
-				buy(other.buy), sell(other.sell), category(other.category) { /* empty ctor */
-			}
-			// dtor(s)
-			virtual ~Item() {
-				// Override if needed
-			}
-			// Use function (WIP)
-			virtual void use() = 0;
+			constexpr Item(const Item& other) = default;
 			// Getter functions
-			const std::string& getName() const {
+			constexpr const std::string_view& getName() const {
 				return name;
 			}
-			const std::string& getDesc() const {
+			constexpr const std::string_view& getDesc() const {
 				return desc;
 			}
-			const unsigned short& getID() const {
+			constexpr unsigned short getID() const {
 				return id;
 			}
-			const unsigned short& getBuyPrice() const {
+			constexpr unsigned short getBuyPrice() const {
 				return buy;
 			}
-			const unsigned short& getSellPrice() const {
+			constexpr unsigned short getSellPrice() const {
 				return sell;
 			}
-			const Category& getCategory() const {
+			constexpr const Category& getCategory() const {
 				return category;
 			}
+			constexpr const std::string_view& getEffect() const {
+				return effect;
+			}
 		};
 		/* The Weapon class derives from Item. Weapons are      *
 		* unstackable (WIP), have damage values, and can be    *
@@ -110,30 +162,24 @@ namespace ItemSystem
 			// The accuracy value of the weapon.
 			const unsigned short accuracy;
 		public:
+			// The category of every weapon.
+			static constexpr Category category = Category::WEAPON;
 			// ctor(s)
-			Weapon(const std::string& _name, const std::string& _desc,
+			constexpr Weapon(const std::string_view& _name, const std::string_view& _desc,
 				const unsigned short& _id, const unsigned short& _damage, const unsigned short& _crit, const unsigned short& _spelldam, const unsigned short& _accuracy,
-				const unsigned short& _buy, const unsigned short& _sell)
-				: Item(_name, _desc, _id, _buy, _sell, Category::WEAPON), damage(_damage), crit(_crit), spelldam(_spelldam), accuracy(_accuracy) { }
-			// dtor(s)
-			virtual ~Weapon() {
-				// Override if needed
-			}
-			// Use function (WIP)
-			virtual void use() override {
-				// Unused
-			}
+				const unsigned short& _buy, const unsigned short& _sell, const std::string_view& _effect = "")
+				: Item(_name, _desc, _id, _buy, _sell, Category::WEAPON, _effect), damage(_damage), crit(_crit), spelldam(_spelldam), accuracy(_accuracy) { }
 			// Getter functions
-			virtual const unsigned short& getDamage() const {
+			constexpr unsigned short getDamage() const {
 				return damage;
 			}
-			virtual const unsigned short& getAccuracy() const {
+			constexpr unsigned short getAccuracy() const {
 				return accuracy;
 			}
-			virtual const unsigned short& getSpellDamage() const {
+			constexpr unsigned short getSpellDamage() const {
 				return spelldam;
 			}
-			virtual const unsigned short& getCrit() const {
+			constexpr unsigned short getCrit() const {
 				return crit;
 			}
 		};
@@ -147,225 +193,771 @@ namespace ItemSystem
 			// The mana regain of the consumable.
 			const unsigned short mana;
 		public:
+			// The category of every consumable.
+			static constexpr Category category = Category::CONSUMABLE;
 			// ctor(s)
-			Consumable(const std::string& _name, const std::string& _desc,
+			constexpr Consumable(const std::string_view& _name, const std::string_view& _desc,
 				const unsigned short& _id, const unsigned short& _health,
 				const unsigned short& _mana, const unsigned short& _buy,
-				const unsigned short& _sell) : Item(_name, _desc, _id,
-					_buy, _sell, Category::CONSUMABLE), health(_health), mana(_mana) { }
-			// dtor(s)
-			virtual ~Consumable() {
-				// Override if needed
-			}
-			// Use function (WIP)
-			virtual void use() override {
-				// WIP
-			}
+				const unsigned short& _sell, const std::string_view& _effect = "hp += health; mp += mana")
+				: Item(_name, _desc, _id, _buy, _sell, Category::CONSUMABLE, _effect), health(_health), mana(_mana) { }
 			// Getter functions
-			virtual const unsigned short& getHealth() const {
+			constexpr unsigned short getHealth() const {
 				return health;
 			}
-			virtual const unsigned short& getMana() const {
+			constexpr unsigned short getMana() const {
 				return mana;
 			}
 		};
+		// Items are plain data (no vtable), so tables of them are packed.
+		static_assert(!std::is_polymorphic_v<Item> && std::is_trivially_copyable_v<Weapon> && std::is_trivially_copyable_v<Consumable>, "Items must stay plain data");
+		/* Casts an item to a subtype by checking its category  *
+		* (no RTTI). Returns nullptr if the item is something  *
+		* else.                                                */
+		template<class ItemType>
+		constexpr const ItemType* itemCast(const Item* item) {
+			if (item == nullptr || item->getCategory() != ItemType::category) return nullptr;
+			return static_cast<const ItemType*>(item);
+		}
 	}
 	/* The Tables namespace has several item lookup tables,   *
 	* making the generation and storage of item subtypes     *
-	* easier.                                                */
+	* easier. The tables are built at compile time: each    *
+	* one is a dense array indexed by item ID, plus a        *
+	* perfect hash over the item names.                      */
 	namespace Tables
 	{
 		// Better readability
 		using namespace ItemSystem::Items;
-		// Makes it easy to autogenerate item IDs
-		unsigned short next_id = 0;
-		class WeaponTable {
+		// Hashes an item name (FNV-1a with a seed and a final mix).
+		constexpr std::uint32_t hashName(const std::string_view& name, const std::uint32_t& seed) {
+			std::uint32_t hash = 2166136261u ^ seed;
+			for (const char c : name) {
+				hash ^= static_cast<unsigned char>(c);
+				hash *= 16777619u;
+			}
+			// FNV alone spreads the low bits poorly, mix them in
+			hash ^= hash >> 15;
+			hash *= 0x2c1b3c6du;
+			hash ^= hash >> 12;
+			return hash;
+		}
+		/* The Registry class is a read-only item table. Items  *
+		* are stored by ID (the first item's ID is the base,   *
+		* the rest must follow it without gaps), and names are *
+		* found through a perfect hash: the constructor        *
+		* searches for a hash seed that puts every name in its *
+		* own bucket, so a name lookup is one hash and one     *
+		* string compare. Make registries constexpr so all of  *
+		* this happens while compiling.                        */
+		template<class ItemType, std::size_t Count>
+		class Registry {
+		public:
+			// Bucket count (smallest power of two at least twice the item count).
+			static constexpr std::size_t bucketCount = [] {
+				std::size_t n = 1;
+				while (n < Count * 2) n *= 2;
+				return n;
+			}();
 		private:
-			// The table of weapons
-			const std::map<const std::string, const Weapon> table{
-				/*{
-				"Weapon name goes here",
-				Weapon(name, desc, next_id++, damage, crit, spell damage, buy, sell, accuracy,)
-				}*/
-				//{
-				//"Test Weapon",
-				//Weapon("Test Weapon", "For testing, idiot.", next_id++, 20, 10, 5)
-				//}
-				{
-					"Stick",
-					Weapon("Stick", "Useless, cannot gain any proficiency bonuses.", next_id++, 1, 0, 1, 100,  0, 0)
-				},
-				{
-					"Modal Soul",
-					Weapon("Modal Soul", "Wait!", next_id++, 9999, 100, 9999, 100, 9999, 9999)
-				},
-				{
-					"Wooden Bow",
-					Weapon("Wooden Bow", "A starter weapon for most hunters in training.", next_id++, 3, 5, 0, 50, 10, 7)
-				},
-				{
-					"Reinforced Bow",
-					Weapon("Reinforced Bow", "A more unique and composed wooden bow.", next_id++, 7, 10, 0, 60, 30, 20)
-				},
-				{
-					"Iron Bow",
-					Weapon("Iron Bow", "Forged in some unholy Audi'je's home, this bow is made from \nregurgitated iron.", next_id++, 15, 15, 0, 70, 60, 50)
-				},
-				{
-					"Tactical Compound Bow",
-					Weapon("Tactical Compound Bow", "A bow with a 16x optical scope, strap, and a better string.", next_id++, 35, 20, 0, 100, 100, 80)
-				},
-				{
-					"Meteor Bow",
-					Weapon("Meteor Bow", "Forged from a passing meteor, nicknamed MB-132. Incredibly Rare", next_id++, 50, 25, 0, 75, 250, 200)
-				},
-				{
-					"Star Bow",
-					Weapon("Star Bow", "This bow has an unkown origin, it's only main feature is the\ndistinct glow the arrows make when fired. The bow seems to possess a special \npower... The power of light.", next_id++, 100, 50, 0, 75, 1000, 750)
-				},
-				{
-					"Copper Shortsword",
-					Weapon("Copper Shortsword", "A flimsy blade, made from the cheapest material on the planet.", next_id++, 5, 1, 0, 90, 15, 10)
-				},
-				{
-					"Iron Blade",
-					Weapon("Iron Blade", "A less flimsy blade, made from less-cheap materials.", next_id++, 9, 2, 0, 90, 30, 20)
-				},
-				{
-					"Steel Blade",
-					Weapon("Steel Blade", "A blade made out of a semi-usable material. Not the best, or \nworst.", next_id++ , 20, 3, 0, 95, 75, 50)
-				},
-				{
-					"Obsidian Longsword",
-					Weapon("Obsidian Longsword", "A dangerous weapon, a major step-up from the previous blades.", next_id++, 50, 4, 0, 80, 150, 100)
-				},
-				{
-					"Core Lightblade",
-					Weapon("Core Lightblade", "The sword forged inside the planet's core. Has a obsidian blade \nwith magma flowing around it.", next_id++, 100, 4, 0, 95, 500, 400)
-				},
-				{
-					"The Singularity Blade",
-					Weapon("The Singularity Blade", "Cuts with astronomical force, created from a god of the past.\nThe blade is complicated and overdone in features, filling a part of the\nblade with a moral of rebirth.", next_id++, 200, 3, 0, 95, 1500, 1250)
-				},
-				{
-					"Wooden Staff",
-					Weapon("Wooden Staff", "A wooden stick with some message in an unknown language cut in on \nthe side.", next_id++, 1, 0, 15, 100, 5, 3)
-				},
-				{
-					"Infused Staff",
-					Weapon("Infused Staff", "Covered in markings and scratches, it seems to emanate power.", next_id++, 2, 1, 25, 100, 10, 5)
-				},
-				{
-					"Cut Wand",
-					Weapon("Cut Wand", "A small wand, it can be aimed to cast certain, more powerful \nspells.", next_id++, 2, 1, 55, 100, 50, 25)
-				},
-				{
-					"Nuja Wand",
-					Weapon("Nuja Wand", "A wand passed down through the ages. Holds a rhythmic power.", next_id++, 4, 1, 120, 100, 100, 75)
-				},
-				{
-					"F.I.L.O.",
-					Weapon("F.I.L.O.", "F.I.L.O is a staff made as a tribute to a human who died in an \naccident. Just you holding it brings back depressed memories.", next_id++, 5, 1, 200, 100, 150, 100)
-				},
-				{
-					"Staff of Mythos",
-					Weapon("Staff of Mythos", "This staff holds the power from the great eldritch monsters. \nIt was found by a human when he destroyed the eldritch beings on his planet. \nHolds the souls of all the eldritch monsters.", next_id++, 10, 1, 350, 100, 1000, 750)
-				},
-				{
-					"Leather Gloves",
-					Weapon("Leather Gloves", "Torn up, burnt, and dipped in acid. These leather gloves are \nwell-worn.", next_id++, 7, 0, 0, 99, 5, 3)
-				},
-				{
-					"Red Rubber Gloves",
-					Weapon("Red Rubber Gloves", "Somebody used these one time.", next_id++, 15, 0, 0, 99, 30, 20)
-				},
-				{
-					"Brass Knuckles",
-					Weapon("Brass Knuckles", "Packs a punch, and a pierce. The brass knuckles are light and \npowerful.", next_id++, 40, 0, 0, 99, 60, 50)
-				},
-				{
-					"Power Glove",
-					Weapon("Power Glove", "Confused with the techinical masterpiece often. The powerglove \nexplodes on impact.", next_id++, 75, 0, 0, 99, 150, 125)
-				},
-				{
-					"Torched Wristband",
-					Weapon("Torched Wristband", "Although not connected to the fists, the Torched Wristband \ninfuses the hand with strong power, also producing an explosion \nin the process.", next_id++, 150, 0, 0, 99, 750, 500)
-				},
-				{
-					"Hell-Forged Wristband",
-					Weapon("Hell-Forged Wristband", "Infuses the user with a large amount of strength so powerful, it \ncould destroy a building in one hit. The Hell-Forged wristband was \nused by a head executioner to keep control of his troops.", next_id++, 300, 0, 0, 99, 1750, 1400)
+			// The items, indexed by (ID - first ID)
+			const std::array<ItemType, Count> table;
+			// The hash seed that makes the name hash collision-free
+			const std::uint32_t seed;
+			// Name hash buckets (item index + 1, 0 means empty)
+			const std::array<unsigned short, bucketCount> buckets;
+			// Checks whether a seed gives every name its own bucket.
+			static constexpr bool isPerfect(const std::array<ItemType, Count>& items, const std::uint32_t& seed) {
+				std::array<bool, bucketCount> used{};
+				for (const ItemType& item : items) {
+					const std::size_t bucket = hashName(item.getName(), seed) & (bucketCount - 1);
+					if (used[bucket]) return false;
+					used[bucket] = true;
 				}
-			};
+				return true;
+			}
+			// Finds the first seed that makes the hash perfect.
+			static constexpr std::uint32_t findSeed(const std::array<ItemType, Count>& items) {
+				std::uint32_t seed = 0;
+				while (!isPerfect(items, seed)) seed++;
+				return seed;
+			}
+			// Fills the buckets for a seed.
+			static constexpr std::array<unsigned short, bucketCount> fillBuckets(const std::array<ItemType, Count>& items, const std::uint32_t& seed) {
+				std::array<unsigned short, bucketCount> filled{};
+				for (std::size_t i = 0; i < Count; i++)
+					filled[hashName(items[i].getName(), seed) & (bucketCount - 1)] = static_cast<unsigned short>(i + 1);
+				return filled;
+			}
 		public:
+			// ctor(s)
+			constexpr Registry(const std::array<ItemType, Count>& _table)
+				: table(_table), seed(findSeed(_table)), buckets(fillBuckets(_table, seed)) { }
+			// Checks that the item IDs follow each other without gaps.
+			constexpr bool hasDenseIDs() const {
+				for (std::size_t i = 0; i < Count; i++)
+					if (table[i].getID() != table[0].getID() + i) return false;
+				return true;
+			}
+			// Returns a pointer to the item with a name, or nullptr if there is none.
+			constexpr const ItemType* find(const std::string_view& nameID) const {
+				const unsigned short index = buckets[hashName(nameID, seed) & (bucketCount - 1)];
+				if (index == 0 || table[index - 1].getName() != nameID) return nullptr;
+				return &table[index - 1];
+			}
+			// Returns a pointer to the item with an ID, or nullptr if there is none.
+			constexpr const ItemType* find(const unsigned short& id) const {
+				const unsigned short index = id - table[0].getID();
+				if (id < table[0].getID() || index >= Count) return nullptr;
+				return &table[index];
+			}
 			// Generates a reference to an item in the table.
-			const Weapon& generate(const std::string& nameID) const {
+			const ItemType& generate(const std::string_view& nameID) const {
+				const ItemType* item = find(nameID);
+				// Check if the entry exists
+				if (item == nullptr)
+					throw std::invalid_argument("Attempted to generate an item that does not exist");
+				// Return the reference
+				return *item;
+			}
+			const ItemType& generate(const unsigned short& id) const {
+				const ItemType* item = find(id);
 				// Check if the entry exists
-				if (table.count(nameID) == 0)
-					throw std::invalid_argument("Attempted to generate a Weapon that does not exist");
+				if (item == nullptr)
+					throw std::invalid_argument("Attempted to generate an item that does not exist");
 				// Return the reference
-				return table.at(nameID);
+				return *item;
+			}
+			// Getter functions
+			constexpr std::size_t size() const {
+				return Count;
+			}
+			constexpr const ItemType* begin() const {
+				return table.data();
 			}
-		} const WeaponTable;
-		class ConsumableTable {
+			constexpr const ItemType* end() const {
+				return table.data() + Count;
+			}
+			constexpr std::uint32_t getSeed() const {
+				return seed;
+			}
+			constexpr const unsigned short* getBuckets() const {
+				return buckets.data();
+			}
+		};
+		/* The Catalog class is the item table the game reads.  *
+		* It's a view over items, a name hash seed and hash    *
+		* buckets laid out like a Registry's, wherever those   *
+		* live: in a built-in Registry or in a mapped item     *
+		* database (see the Database namespace). Lookups work  *
+		* the same as in a Registry.                           */
+		template<class ItemType>
+		class Catalog {
 		private:
-			// The table of consumables
-			const std::map<const std::string, const Consumable> table{
-				/*{
-				"Consumable name goes here",
-				Consumable(name, desc, next_id++, health, mana, buy, sell)
-				}*/
-				{
-					"Test Consumable",
-					Consumable("Test Consumable", "For testing, idiot.", next_id++, 20, 8, 10, 5)
-				},
-				{
-					"Normal Health Potion",
-					Consumable("Normal Health Potion", "Heals 25 HP ", next_id++, 25, 0, 15, 3)
-				},
-				{
-					"Greater Health Potion",
-					Consumable("Greater Health Potion", "Heals 100 HP", next_id++, 100, 0, 45, 20)
-				},
-				{
-					"Super Health Potion",
-					Consumable("Super Health Potion", "Heals 500 HP", next_id++, 500, 0, 100, 50)
-				},
-				{
-					"Full Health Potion",
-					Consumable("Full Health Potion", "Heals 9999 HP", next_id++, 9999, 0, 300, 150)
-				},
-				{
-					"Normal Mana Potion",
-					Consumable("Normal Mana Potion", "Restores 15 MP", next_id++, 0, 15, 10, 5)
-				},
-				{
-					"Greater Mana Potion",
-					Consumable("Greater Mana Potion", "Restores 45 MP", next_id++, 0, 45, 45, 20)
-				},
-				{
-					"Super Mana Potion",
-					Consumable("Super Mana Potion", "Restores 100 MP", next_id++, 0, 100, 100, 50)
-				},
-				{
-					"Full Mana Potion",
-					Consumable("Full Mana Potion", "Restores 9999 MP", next_id++, 0, 9999, 300, 150)
-				},
-				{
-					"Full Restore",
-					Consumable("Full Restore", "Restores 9999 MP and 9999 HP", next_id++, 9999, 9999, 500, 250)
-
-				}
-			};
+			// The items, indexed by (ID - first ID)
+			const ItemType* items;
+			std::size_t count;
+			// The name hash (seed and buckets, bucketCount is a power of two)
+			std::uint32_t seed;
+			const unsigned short* buckets;
+			std::size_t bucketCount;
 		public:
+			// ctor(s)
+			template<std::size_t Count>
+			constexpr Catalog(const Registry<ItemType, Count>& registry)
+				: items(registry.begin()), count(Count), seed(registry.getSeed()),
+				buckets(registry.getBuckets()), bucketCount(registry.bucketCount) { }
+			constexpr Catalog(const ItemType* _items, const std::size_t& _count, const std::uint32_t& _seed,
+				const unsigned short* _buckets, const std::size_t& _bucketCount)
+				: items(_items), count(_count), seed(_seed), buckets(_buckets), bucketCount(_bucketCount) { }
+			// Returns a pointer to the item with a name, or nullptr if there is none.
+			const ItemType* find(const std::string_view& nameID) const {
+				const unsigned short index = buckets[hashName(nameID, seed) & (bucketCount - 1)];
+				if (index == 0 || items[index - 1].getName() != nameID) return nullptr;
+				return &items[index - 1];
+			}
+			// Returns a pointer to the item with an ID, or nullptr if there is none.
+			const ItemType* find(const unsigned short& id) const {
+				if (count == 0 || id < items[0].getID()) return nullptr;
+				const std::size_t index = id - items[0].getID();
+				if (index >= count) return nullptr;
+				return &items[index];
+			}
 			// Generates a reference to an item in the table.
-			const Consumable& generate(const std::string& nameID) const {
+			const ItemType& generate(const std::string_view& nameID) const {
+				const ItemType* item = find(nameID);
+				// Check if the entry exists
+				if (item == nullptr)
+					throw std::invalid_argument("Attempted to generate an item that does not exist");
+				// Return the reference
+				return *item;
+			}
+			const ItemType& generate(const unsigned short& id) const {
+				const ItemType* item = find(id);
 				// Check if the entry exists
-				if (table.count(nameID) == 0)
-					throw std::invalid_argument("Attempted to generate a Weapon that does not exist");
+				if (item == nullptr)
+					throw std::invalid_argument("Attempted to generate an item that does not exist");
 				// Return the reference
-				return table.at(nameID);
+				return *item;
+			}
+			// Getter functions
+			std::size_t size() const {
+				return count;
+			}
+			const ItemType* begin() const {
+				return items;
+			}
+			const ItemType* end() const {
+				return items + count;
+			}
+			std::uint32_t getSeed() const {
+				return seed;
+			}
+			const unsigned short* getBuckets() const {
+				return buckets;
+			}
+			std::size_t getBucketCount() const {
+				return bucketCount;
+			}
+		};
+		/* The built-in table of weapons. IDs are stored in     *
+		* saves, so append new weapons at the end and never    *
+		* renumber.                                            *
+		* Weapon(name, desc, id, damage, crit, spell damage,   *
+		*        accuracy, buy, sell, effect script (none if   *
+		*        left out))                                    */
+		constexpr Registry BuiltinWeapons{ std::array{
+			Weapon("Stick", "Useless, cannot gain any proficiency bonuses.", 0, 1, 0, 1, 100,  0, 0),
+			Weapon("Modal Soul", "Wait!", 1, 9999, 100, 9999, 100, 9999, 9999),
+			Weapon("Wooden Bow", "A starter weapon for most hunters in training.", 2, 3, 5, 0, 50, 10, 7),
+			Weapon("Reinforced Bow", "A more unique and composed wooden bow.", 3, 7, 10, 0, 60, 30, 20),
+			Weapon("Iron Bow", "Forged in some unholy Audi'je's home, this bow is made from \nregurgitated iron.", 4, 15, 15, 0, 70, 60, 50),
+			Weapon("Tactical Compound Bow", "A bow with a 16x optical scope, strap, and a better string.", 5, 35, 20, 0, 100, 100, 80),
+			Weapon("Meteor Bow", "Forged from a passing meteor, nicknamed MB-132. Incredibly Rare", 6, 50, 25, 0, 75, 250, 200),
+			Weapon("Star Bow", "This bow has an unkown origin, it's only main feature is the\ndistinct glow the arrows make when fired. The bow seems to possess a special \npower... The power of light.", 7, 100, 50, 0, 75, 1000, 750),
+			Weapon("Copper Shortsword", "A flimsy blade, made from the cheapest material on the planet.", 8, 5, 1, 0, 90, 15, 10),
+			Weapon("Iron Blade", "A less flimsy blade, made from less-cheap materials.", 9, 9, 2, 0, 90, 30, 20),
+			Weapon("Steel Blade", "A blade made out of a semi-usable material. Not the best, or \nworst.", 10, 20, 3, 0, 95, 75, 50),
+			Weapon("Obsidian Longsword", "A dangerous weapon, a major step-up from the previous blades.", 11, 50, 4, 0, 80, 150, 100),
+			Weapon("Core Lightblade", "The sword forged inside the planet's core. Has a obsidian blade \nwith magma flowing around it.", 12, 100, 4, 0, 95, 500, 400),
+			Weapon("The Singularity Blade", "Cuts with astronomical force, created from a god of the past.\nThe blade is complicated and overdone in features, filling a part of the\nblade with a moral of rebirth.", 13, 200, 3, 0, 95, 1500, 1250),
+			Weapon("Wooden Staff", "A wooden stick with some message in an unknown language cut in on \nthe side.", 14, 1, 0, 15, 100, 5, 3),
+			Weapon("Infused Staff", "Covered in markings and scratches, it seems to emanate power.", 15, 2, 1, 25, 100, 10, 5),
+			Weapon("Cut Wand", "A small wand, it can be aimed to cast certain, more powerful \nspells.", 16, 2, 1, 55, 100, 50, 25),
+			Weapon("Nuja Wand", "A wand passed down through the ages. Holds a rhythmic power.", 17, 4, 1, 120, 100, 100, 75),
+			Weapon("F.I.L.O.", "F.I.L.O is a staff made as a tribute to a human who died in an \naccident. Just you holding it brings back depressed memories.", 18, 5, 1, 200, 100, 150, 100),
+			Weapon("Staff of Mythos", "This staff holds the power from the great eldritch monsters. \nIt was found by a human when he destroyed the eldritch beings on his planet. \nHolds the souls of all the eldritch monsters.", 19, 10, 1, 350, 100, 1000, 750),
+			Weapon("Leather Gloves", "Torn up, burnt, and dipped in acid. These leather gloves are \nwell-worn.", 20, 7, 0, 0, 99, 5, 3),
+			Weapon("Red Rubber Gloves", "Somebody used these one time.", 21, 15, 0, 0, 99, 30, 20),
+			Weapon("Brass Knuckles", "Packs a punch, and a pierce. The brass knuckles are light and \npowerful.", 22, 40, 0, 0, 99, 60, 50),
+			Weapon("Power Glove", "Confused with the techinical masterpiece often. The powerglove \nexplodes on impact.", 23, 75, 0, 0, 99, 150, 125),
+			Weapon("Torched Wristband", "Although not connected to the fists, the Torched Wristband \ninfuses the hand with strong power, also producing an explosion \nin the process.", 24, 150, 0, 0, 99, 750, 500),
+			Weapon("Hell-Forged Wristband", "Infuses the user with a large amount of strength so powerful, it \ncould destroy a building in one hit. The Hell-Forged wristband was \nused by a head executioner to keep control of his troops.", 25, 300, 0, 0, 99, 1750, 1400)
+		} };
+		static_assert(BuiltinWeapons.hasDenseIDs(), "Weapon IDs must follow each other");
+		static_assert(BuiltinWeapons.begin()->getID() == 0, "Weapon IDs must start at 0");
+		/* The built-in table of consumables. IDs continue from *
+		* the weapons, the same rules apply.                   *
+		* Consumable(name, desc, id, health, mana, buy, sell,  *
+		*            effect script (heals health and mana if   *
+		*            left out))                                */
+		constexpr Registry BuiltinConsumables{ std::array{
+			Consumable("Test Consumable", "For testing, idiot.", 26, 20, 8, 10, 5),
+			Consumable("Normal Health Potion", "Heals 25 HP ", 27, 25, 0, 15, 3),
+			Consumable("Greater Health Potion", "Heals 100 HP", 28, 100, 0, 45, 20),
+			Consumable("Super Health Potion", "Heals 500 HP", 29, 500, 0, 100, 50),
+			Consumable("Full Health Potion", "Heals 9999 HP", 30, 9999, 0, 300, 150),
+			Consumable("Normal Mana Potion", "Restores 15 MP", 31, 0, 15, 10, 5),
+			Consumable("Greater Mana Potion", "Restores 45 MP", 32, 0, 45, 45, 20),
+			Consumable("Super Mana Potion", "Restores 100 MP", 33, 0, 100, 100, 50),
+			Consumable("Full Mana Potion", "Restores 9999 MP", 34, 0, 9999, 300, 150),
+			Consumable("Full Restore", "Restores 9999 MP and 9999 HP", 35, 9999, 9999, 500, 250)
+		} };
+		static_assert(BuiltinConsumables.hasDenseIDs(), "Consumable IDs must follow each other");
+		static_assert(BuiltinConsumables.begin()->getID() == BuiltinWeapons.end()[-1].getID() + 1, "Consumable IDs must continue from the weapons");
+		// Returns the ID of a built-in item by name (a typo fails to compile).
+		constexpr unsigned short builtinID(const std::string_view& name) {
+			if (const Weapon* weapon = BuiltinWeapons.find(name)) return weapon->getID();
+			return BuiltinConsumables.find(name)->getID();
+		}
+		// The items the game asks for by name (so an item database must have them too).
+		constexpr std::array<std::string_view, 2> requiredWeapons{ "Stick", "Modal Soul" };
+		constexpr std::array<std::string_view, 4> requiredConsumables{ "Normal Health Potion", "Greater Health Potion", "Super Health Potion", "Normal Mana Potion" };
+		static_assert([] {
+			for (const std::string_view& name : requiredWeapons)
+				if (BuiltinWeapons.find(name) == nullptr) return false;
+			for (const std::string_view& name : requiredConsumables)
+				if (BuiltinConsumables.find(name) == nullptr) return false;
+			return true;
+		}(), "The built-in tables must have the items the game asks for");
+		/* The item tables the game uses. They start out as the *
+		* built-in tables, and are pointed at the item         *
+		* database if one is loaded (before anything is put    *
+		* in an inventory -- slots keep pointers into these).  */
+		inline Catalog<Weapon> WeaponTable{ BuiltinWeapons };
+		inline Catalog<Consumable> ConsumableTable{ BuiltinConsumables };
+		// Returns the prototype of any item by ID, or nullptr if there is none.
+		inline const Item* findItem(const unsigned short& id) {
+			if (const Weapon* weapon = WeaponTable.find(id)) return weapon;
+			return ConsumableTable.find(id);
+		}
+		/* A Shop is a named list of items for sale (by ID),    *
+		* with the text shown when the player walks in.        */
+		struct Shop {
+			std::string_view name;
+			std::string_view greeting;
+			const std::uint16_t* stock;
+			std::size_t stockCount;
+		};
+		/* The ShopList class is a view over shops, like the    *
+		* Catalog class is for items.                          */
+		class ShopList {
+		private:
+			const Shop* shops;
+			std::size_t count;
+		public:
+			// ctor(s)
+			constexpr ShopList(const Shop* _shops, const std::size_t& _count) : shops(_shops), count(_count) { }
+			// Getter functions
+			const Shop& operator[](const std::size_t& index) const {
+				return shops[index];
+			}
+			std::size_t size() const {
+				return count;
+			}
+			const Shop* begin() const {
+				return shops;
+			}
+			const Shop* end() const {
+				return shops + count;
 			}
-		} const ConsumableTable;
+		};
+		// The stock of the built-in shops.
+		constexpr std::uint16_t WarriorsSupplyStock[] = {
+			builtinID("Copper Shortsword"), builtinID("Iron Blade"), builtinID("Steel Blade"),
+			builtinID("Obsidian Longsword"), builtinID("Core Lightblade"), builtinID("The Singularity Blade")
+		};
+		constexpr std::uint16_t HuntersEdgeStock[] = {
+			builtinID("Wooden Bow"), builtinID("Reinforced Bow"), builtinID("Iron Bow"),
+			builtinID("Tactical Compound Bow"), builtinID("Meteor Bow"), builtinID("Star Bow")
+		};
+		constexpr std::uint16_t MagicsGatheringStock[] = {
+			builtinID("Wooden Staff"), builtinID("Infused Staff"), builtinID("Cut Wand"),
+			builtinID("Nuja Wand"), builtinID("F.I.L.O."), builtinID("Staff of Mythos")
+		};
+		constexpr std::uint16_t RocketWrestlingStock[] = {
+			builtinID("Leather Gloves"), builtinID("Red Rubber Gloves"), builtinID("Brass Knuckles"),
+			builtinID("Power Glove"), builtinID("Torched Wristband"), builtinID("Hell-Forged Wristband")
+		};
+		constexpr std::uint16_t MikesStoreStock[] = {
+			builtinID("Normal Health Potion"), builtinID("Greater Health Potion"), builtinID("Super Health Potion"),
+			builtinID("Full Health Potion"), builtinID("Normal Mana Potion"), builtinID("Greater Mana Potion"),
+			builtinID("Super Mana Potion"), builtinID("Full Mana Potion")
+		};
+		/* The built-in shops of the black market.              *
+		* Shop{ name, greeting, stock, stock count }           */
+		constexpr Shop BuiltinShops[] = {
+			Shop{ "Warrior's Supply", "You walk in and are greeted by two Bren'kibs. \nThey are polishing their spears and weapons for selling.\nThey show you around the store.",
+				WarriorsSupplyStock, std::size(WarriorsSupplyStock) },
+			Shop{ "Hunter's Edge", "As you enter the shop you see a Kenku sitting behind the counter.\nHe throws a dagger at you, barely missing you.\nHe laughs and lets you look at his wares.",
+				HuntersEdgeStock, std::size(HuntersEdgeStock) },
+			Shop{ "The Magic's Gathering", "You walk into the Magic's Gathering. A very happy human greets you\n'W-we-we have D&D Sessions on thursdays...' He says\nHe hands you a flyer\n'OH, and I-I also sell things...' He says.",
+				MagicsGatheringStock, std::size(MagicsGatheringStock) },
+			Shop{ "Rocket Wrestling", "As you walk in, a massive explosion rings out and two skeleton samurais\njump down from nowhere. They greet you with power gloves primed.\nThey lift up their weapons and smile. They show you around.",
+				RocketWrestlingStock, std::size(RocketWrestlingStock) },
+			Shop{ "Mike's Friendly Store", "A very disgusting looking teen at the counter greets you as you walk in\n'Welcome to the store. SIR.' He says, with a very punchable face.",
+				MikesStoreStock, std::size(MikesStoreStock) }
+		};
+		// The shops the game uses (built-in, or from the item database).
+		inline ShopList ShopTable{ BuiltinShops, std::size(BuiltinShops) };
+	}
+	// Compiles the effects of a pair of item tables (throwing std::runtime_error if
+	// one doesn't compile), and runs those from then on (see the Scripting namespace).
+	namespace Scripting
+	{
+		inline void check(const Tables::Catalog<Items::Weapon>& weapons, const Tables::Catalog<Items::Consumable>& consumables);
+		inline void install(const Tables::Catalog<Items::Weapon>& weapons, const Tables::Catalog<Items::Consumable>& consumables);
+	}
+	/* The Database namespace reads and writes item          *
+	* databases: binary files holding the item tables and   *
+	* the shops, built offline with --compile-items. A      *
+	* database is mapped into memory and used in place: it  *
+	* has fixed-size little-endian records, the name hash   *
+	* buckets, and one pool with every string stored once.  *
+	* The loaded tables point into the mapping, so the text *
+	* is never copied and is shared by every running game.  */
+	namespace Database
+	{
+		// Better readability
+		using namespace ItemSystem::Items;
+		using namespace ItemSystem::Tables;
+		// The database the game loads at startup (if it exists).
+		constexpr const char* defaultPath = "items.bin";
+		// File identification
+		constexpr char fileMagic[4] = { 'B', 'N', 'I', 'D' };
+		constexpr std::uint32_t fileVersion = 1;
+		// Written as this value, so it reads back differently on a big-endian machine
+		constexpr std::uint32_t byteOrderMark = 0x01020304u;
+		// The most items a table can hold, and the most shops.
+		constexpr std::size_t maxItems = std::numeric_limits<unsigned short>::max();
+		constexpr std::size_t maxShops = 256;
+		// A range of the file (byte offset and entry count).
+		struct Section {
+			std::uint32_t offset;
+			std::uint32_t count;
+		};
+		// A string in the pool (byte offset into the pool and length).
+		struct StringRef {
+			std::uint32_t offset;
+			std::uint32_t length;
+		};
+		// The start of the file. Bucket and stock entries are
+		// 16-bit, and the string section's count is in bytes.
+		struct Header {
+			char magic[4];
+			std::uint32_t version;
+			std::uint32_t byteOrder;
+			std::uint32_t fileSize;
+			Section weapons, consumables, weaponBuckets, consumableBuckets, shops, shopStock, strings;
+			std::uint32_t weaponSeed, consumableSeed;
+		};
+		struct WeaponRecord {
+			StringRef name, desc, effect;
+			std::uint16_t id, damage, crit, spelldam, accuracy, buy, sell, padding;
+		};
+		struct ConsumableRecord {
+			StringRef name, desc, effect;
+			std::uint16_t id, health, mana, buy, sell, padding;
+		};
+		struct ShopRecord {
+			StringRef name, greeting;
+			std::uint32_t firstStock, stockCount;
+		};
+		static_assert(sizeof(Header) == 80 && sizeof(WeaponRecord) == 40 && sizeof(ConsumableRecord) == 36 && sizeof(ShopRecord) == 24, "Database records must not have padding");
+		static_assert(std::is_same_v<std::uint16_t, unsigned short>, "Hash buckets are read straight from the file");
+		/* The MappedFile class maps a whole file read-only and *
+		* shared. Throws std::runtime_error if it can't.       */
+		class MappedFile {
+		private:
+			const unsigned char* data = nullptr;
+			std::size_t size = 0;
+#if defined(_WIN32)
+			HANDLE file = INVALID_HANDLE_VALUE;
+			HANDLE mapping = nullptr;
+#endif
+		public:
+			// ctor(s)
+			MappedFile() = default;
+			explicit MappedFile(const std::string& path) {
+#if defined(_WIN32)
+				file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+				LARGE_INTEGER fileSize;
+				if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+					unmap();
+					throw std::runtime_error("Can't open " + path);
+				}
+				size = static_cast<std::size_t>(fileSize.QuadPart);
+				mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				if (mapping != nullptr)
+					data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+				if (data == nullptr) {
+					unmap();
+					throw std::runtime_error("Can't map " + path);
+				}
+#else
+				const int fd = open(path.c_str(), O_RDONLY);
+				struct stat info;
+				if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0) {
+					if (fd >= 0) close(fd);
+					throw std::runtime_error("Can't open " + path);
+				}
+				size = static_cast<std::size_t>(info.st_size);
+				void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+				// The mapping stays valid after the file is closed
+				close(fd);
+				if (mapped == MAP_FAILED)
+					throw std::runtime_error("Can't map " + path);
+				data = static_cast<const unsigned char*>(mapped);
+#endif
+			}
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+			MappedFile& operator=(MappedFile&& other) noexcept {
+				std::swap(data, other.data);
+				std::swap(size, other.size);
+#if defined(_WIN32)
+				std::swap(file, other.file);
+				std::swap(mapping, other.mapping);
+#endif
+				return *this;
+			}
+			// dtor(s)
+			~MappedFile() {
+				unmap();
+			}
+			// Unmaps the file.
+			void unmap() {
+#if defined(_WIN32)
+				if (data != nullptr) UnmapViewOfFile(data);
+				if (mapping != nullptr) CloseHandle(mapping);
+				if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+				file = INVALID_HANDLE_VALUE;
+				mapping = nullptr;
+#else
+				if (data != nullptr) munmap(const_cast<unsigned char*>(data), size);
+#endif
+				data = nullptr;
+				size = 0;
+			}
+			// Getter functions
+			const unsigned char* getData() const {
+				return data;
+			}
+			std::size_t getSize() const {
+				return size;
+			}
+		};
+		// The loaded database (kept mapped until the game exits).
+		inline MappedFile loaded;
+		// The prototypes and shops of the loaded database. They hold string
+		// views into the mapping; the storage is static rather than heap
+		// memory, and pages that are never touched are never mapped in.
+		alignas(Weapon) inline unsigned char weaponStorage[sizeof(Weapon) * maxItems];
+		alignas(Consumable) inline unsigned char consumableStorage[sizeof(Consumable) * maxItems];
+		inline Shop shopStorage[maxShops];
+		/* Loads an item database and points the game's tables *
+		* at it. Returns false if the file doesn't exist.      *
+		* Throws std::runtime_error if the file is damaged, an *
+		* item can't be found by its name, an item the game    *
+		* asks for is missing or an effect doesn't compile     *
+		* (the tables are left alone), and std::logic_error    *
+		* if a database is loaded already. Call it before any  *
+		* item goes into an inventory.                         */
+		inline bool load(const std::string& path) {
+			if (loaded.getData() != nullptr)
+				throw std::logic_error("An item database is already loaded");
+			if (!std::ifstream(path))
+				return false;
+			MappedFile file(path);
+			const unsigned char* data = file.getData();
+			const auto fail = [&path](const std::string& reason) {
+				throw std::runtime_error(path + " is not a valid item database (" + reason + ")");
+			};
+			// Check the header
+			if (file.getSize() < sizeof(Header)) fail("too small");
+			const Header& header = *reinterpret_cast<const Header*>(data);
+			if (!std::equal(std::begin(fileMagic), std::end(fileMagic), header.magic)) fail("wrong magic");
+			if (header.byteOrder != byteOrderMark) fail("this machine isn't little-endian");
+			if (header.version != fileVersion) fail("version " + std::to_string(header.version) + ", expected " + std::to_string(fileVersion));
+			if (header.fileSize != file.getSize()) fail("truncated");
+			// Check that a section lies inside the file
+			const auto section = [&](const Section& range, const std::size_t& entrySize) {
+				if (range.offset % 4 != 0 || range.offset > file.getSize() || range.count > (file.getSize() - range.offset) / entrySize)
+					fail("section out of bounds");
+				return data + range.offset;
+			};
+			const auto* weaponRecords = reinterpret_cast<const WeaponRecord*>(section(header.weapons, sizeof(WeaponRecord)));
+			const auto* consumableRecords = reinterpret_cast<const ConsumableRecord*>(section(header.consumables, sizeof(ConsumableRecord)));
+			const auto* weaponBuckets = reinterpret_cast<const std::uint16_t*>(section(header.weaponBuckets, sizeof(std::uint16_t)));
+			const auto* consumableBuckets = reinterpret_cast<const std::uint16_t*>(section(header.consumableBuckets, sizeof(std::uint16_t)));
+			const auto* shopRecords = reinterpret_cast<const ShopRecord*>(section(header.shops, sizeof(ShopRecord)));
+			const auto* shopStock = reinterpret_cast<const std::uint16_t*>(section(header.shopStock, sizeof(std::uint16_t)));
+			const auto* strings = reinterpret_cast<const char*>(section(header.strings, 1));
+			const std::size_t itemCount = std::size_t(header.weapons.count) + header.consumables.count;
+			if (header.weapons.count == 0 || header.consumables.count == 0 || itemCount > maxItems) fail("bad item count");
+			if (header.shops.count > maxShops) fail("too many shops");
+			// Check the name hashes
+			const auto checkBuckets = [&](const std::uint16_t* buckets, const Section& range, const std::uint32_t& count) {
+				if (range.count < count || (range.count & (range.count - 1)) != 0) fail("bad bucket count");
+				for (std::uint32_t i = 0; i < range.count; i++)
+					if (buckets[i] > count) fail("bad bucket");
+			};
+			checkBuckets(weaponBuckets, header.weaponBuckets, header.weapons.count);
+			checkBuckets(consumableBuckets, header.consumableBuckets, header.consumables.count);
+			// Gets a string from the pool
+			const auto text = [&](const StringRef& ref) {
+				if (ref.offset > header.strings.count || ref.length > header.strings.count - ref.offset) fail("string out of bounds");
+				return std::string_view(strings + ref.offset, ref.length);
+			};
+			// Build the prototypes (IDs start at 0 and follow each other)
+			Weapon* weapons = reinterpret_cast<Weapon*>(weaponStorage);
+			for (std::uint32_t i = 0; i < header.weapons.count; i++) {
+				const WeaponRecord& r = weaponRecords[i];
+				if (r.id != i) fail("weapon IDs must follow each other from 0");
+				new (&weapons[i]) Weapon(text(r.name), text(r.desc), r.id, r.damage, r.crit, r.spelldam, r.accuracy, r.buy, r.sell, text(r.effect));
+			}
+			Consumable* consumables = reinterpret_cast<Consumable*>(consumableStorage);
+			for (std::uint32_t i = 0; i < header.consumables.count; i++) {
+				const ConsumableRecord& r = consumableRecords[i];
+				if (r.id != header.weapons.count + i) fail("consumable IDs must continue from the weapons");
+				new (&consumables[i]) Consumable(text(r.name), text(r.desc), r.id, r.health, r.mana, r.buy, r.sell, text(r.effect));
+			}
+			for (std::uint32_t i = 0; i < header.shops.count; i++) {
+				const ShopRecord& r = shopRecords[i];
+				if (r.firstStock > header.shopStock.count || r.stockCount > header.shopStock.count - r.firstStock) fail("shop stock out of bounds");
+				for (std::uint32_t j = 0; j < r.stockCount; j++)
+					if (shopStock[r.firstStock + j] >= itemCount) fail("shop sells an item that doesn't exist");
+				shopStorage[i] = Shop{ text(r.name), text(r.greeting), shopStock + r.firstStock, r.stockCount };
+			}
+			// Every item must be found by its name, and the items the game asks for must be there
+			const Catalog<Weapon> weaponTable(weapons, header.weapons.count, header.weaponSeed, weaponBuckets, header.weaponBuckets.count);
+			const Catalog<Consumable> consumableTable(consumables, header.consumables.count, header.consumableSeed, consumableBuckets, header.consumableBuckets.count);
+			for (const Weapon& weapon : weaponTable)
+				if (weaponTable.find(weapon.getName()) != &weapon) fail("can't find the weapon " + std::string(weapon.getName()) + " by name");
+			for (const Consumable& consumable : consumableTable)
+				if (consumableTable.find(consumable.getName()) != &consumable) fail("can't find the consumable " + std::string(consumable.getName()) + " by name");
+			for (const std::string_view& name : requiredWeapons)
+				if (weaponTable.find(name) == nullptr) fail("no weapon named " + std::string(name));
+			for (const std::string_view& name : requiredConsumables)
+				if (consumableTable.find(name) == nullptr) fail("no consumable named " + std::string(name));
+			// Compile the effects, then switch the tables over
+			try {
+				Scripting::install(weaponTable, consumableTable);
+			}
+			catch (const std::runtime_error& e) {
+				fail(e.what());
+			}
+			WeaponTable = weaponTable;
+			ConsumableTable = consumableTable;
+			ShopTable = ShopList(shopStorage, header.shops.count);
+			loaded = std::move(file);
+			return true;
+		}
+		/* The Writer class builds a database file in memory,   *
+		* writing every number little-endian.                  */
+		class Writer {
+		private:
+			// The file, and the string pool (appended at the end)
+			std::string bytes;
+			std::string pool;
+			// Where each string is in the pool
+			std::unordered_map<std::string_view, StringRef> pooled;
+			// Writes a number at an offset.
+			void put32At(const std::size_t& offset, const std::uint32_t& value) {
+				for (std::size_t i = 0; i < 4; i++)
+					bytes[offset + i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+			}
+		public:
+			// ctor(s) (starts with room for the header)
+			Writer() : bytes(sizeof(Header), '\0') { }
+			// Writes numbers.
+			void put16(const std::uint16_t& value) {
+				bytes.push_back(static_cast<char>(value & 0xFF));
+				bytes.push_back(static_cast<char>(value >> 8));
+			}
+			void put32(const std::uint32_t& value) {
+				put16(static_cast<std::uint16_t>(value & 0xFFFF));
+				put16(static_cast<std::uint16_t>(value >> 16));
+			}
+			// Writes a string reference (adding the string to the pool once).
+			void putString(const std::string_view& text) {
+				auto found = pooled.find(text);
+				if (found == pooled.end()) {
+					found = pooled.emplace(text, StringRef{ static_cast<std::uint32_t>(pool.size()), static_cast<std::uint32_t>(text.size()) }).first;
+					pool.append(text.data(), text.size());
+				}
+				put32(found->second.offset);
+				put32(found->second.length);
+			}
+			// Pads the file to a multiple of 4 bytes.
+			void align() {
+				while (bytes.size() % 4 != 0) bytes.push_back('\0');
+			}
+			// Appends the string pool and returns its section.
+			Section putPool() {
+				const Section strings{ position(), static_cast<std::uint32_t>(pool.size()) };
+				bytes += pool;
+				return strings;
+			}
+			// Fills in the header (the fields in order).
+			void putHeader(const Header& header) {
+				std::copy(std::begin(header.magic), std::end(header.magic), bytes.begin());
+				const std::uint32_t fields[] = {
+					header.version, header.byteOrder, header.fileSize,
+					header.weapons.offset, header.weapons.count, header.consumables.offset, header.consumables.count,
+					header.weaponBuckets.offset, header.weaponBuckets.count, header.consumableBuckets.offset, header.consumableBuckets.count,
+					header.shops.offset, header.shops.count, header.shopStock.offset, header.shopStock.count,
+					header.strings.offset, header.strings.count, header.weaponSeed, header.consumableSeed
+				};
+				for (std::size_t i = 0; i < std::size(fields); i++)
+					put32At(sizeof(header.magic) + i * 4, fields[i]);
+			}
+			// Getter functions
+			std::uint32_t position() const {
+				return static_cast<std::uint32_t>(bytes.size());
+			}
+			const std::string& getBytes() const {
+				return bytes;
+			}
+		};
+		/* Writes the built-in item tables and shops to a       *
+		* database file. Throws std::runtime_error if an        *
+		* item's effect doesn't compile (nothing is written)    *
+		* or the file can't be written.                         */
+		inline void compile(const std::string& path) {
+			const Catalog<Weapon> weapons(BuiltinWeapons);
+			const Catalog<Consumable> consumables(BuiltinConsumables);
+			Scripting::check(weapons, consumables);
+			Writer out;
+			Header header{};
+			std::copy(std::begin(fileMagic), std::end(fileMagic), header.magic);
+			header.version = fileVersion;
+			header.byteOrder = byteOrderMark;
+			// Items
+			header.weapons = Section{ out.position(), static_cast<std::uint32_t>(weapons.size()) };
+			for (const Weapon& weapon : weapons) {
+				out.putString(weapon.getName());
+				out.putString(weapon.getDesc());
+				out.putString(weapon.getEffect());
+				for (const unsigned short value : { weapon.getID(), weapon.getDamage(), weapon.getCrit(), weapon.getSpellDamage(),
+					weapon.getAccuracy(), weapon.getBuyPrice(), weapon.getSellPrice(), static_cast<unsigned short>(0) })
+					out.put16(value);
+			}
+			header.consumables = Section{ out.position(), static_cast<std::uint32_t>(consumables.size()) };
+			for (const Consumable& consumable : consumables) {
+				out.putString(consumable.getName());
+				out.putString(consumable.getDesc());
+				out.putString(consumable.getEffect());
+				for (const unsigned short value : { consumable.getID(), consumable.getHealth(), consumable.getMana(),
+					consumable.getBuyPrice(), consumable.getSellPrice(), static_cast<unsigned short>(0) })
+					out.put16(value);
+			}
+			// Name hashes (the same seeds and buckets as the built-in tables)
+			header.weaponSeed = weapons.getSeed();
+			header.weaponBuckets = Section{ out.position(), static_cast<std::uint32_t>(weapons.getBucketCount()) };
+			for (std::size_t i = 0; i < weapons.getBucketCount(); i++)
+				out.put16(weapons.getBuckets()[i]);
+			out.align();
+			header.consumableSeed = consumables.getSeed();
+			header.consumableBuckets = Section{ out.position(), static_cast<std::uint32_t>(consumables.getBucketCount()) };
+			for (std::size_t i = 0; i < consumables.getBucketCount(); i++)
+				out.put16(consumables.getBuckets()[i]);
+			out.align();
+			// Shops
+			header.shops = Section{ out.position(), static_cast<std::uint32_t>(std::size(BuiltinShops)) };
+			std::uint32_t stockCount = 0;
+			for (const Shop& shop : BuiltinShops) {
+				out.putString(shop.name);
+				out.putString(shop.greeting);
+				out.put32(stockCount);
+				out.put32(static_cast<std::uint32_t>(shop.stockCount));
+				stockCount += static_cast<std::uint32_t>(shop.stockCount);
+			}
+			header.shopStock = Section{ out.position(), stockCount };
+			for (const Shop& shop : BuiltinShops)
+				for (std::size_t i = 0; i < shop.stockCount; i++)
+					out.put16(shop.stock[i]);
+			out.align();
+			// Strings
+			header.strings = out.putPool();
+			header.fileSize = out.position();
+			out.putHeader(header);
+			// Write the file
+			std::ofstream file(path, std::ios::binary | std::ios::trunc);
+			file.write(out.getBytes().data(), static_cast<std::streamsize>(out.getBytes().size()));
+			if (!file)
+				throw std::runtime_error("Can't write " + path);
+		}
 	}
 	/* The Container namespace has the item slot class and    *
 	* the inventory system.                                  */
@@ -373,25 +965,29 @@ namespace ItemSystem
 	{
 		// Better readability
 		using namespace ItemSystem::Items;
-		/* The ItemSlot class encapsulates a item subtype and   *
+		/* The ItemSlot class refers to an item prototype and   *
 		* allows it to be stored in the inventory, along with  *
-		* keeping track of how many items are stacked.         */
+		* keeping track of how many items are stacked.         *
+		* Prototypes are the immutable entries of the item     *
+		* tables and are shared by every slot; the stack is    *
+		* the only per-instance state an item has so far. Give *
+		* the slot more fields if an item ever needs its own.  */
 		class ItemSlot {
 		private:
-			// Pointer to (dynamically allocated) item-based instance
-			std::shared_ptr<const Item> item;
+			// Pointer to the (shared, immutable) item prototype
+			const Item* item;
 			// Stack amount
 			unsigned short stack;
 		public:
 			// ctor(s)
 			ItemSlot(const Item* _item = nullptr, const unsigned short& _stack = 1)
 				: item(_item), stack(_stack) { }
-			// Updates the item in the slot (destroying the old instance).
+			// Updates the item in the slot.
 			void update(const Item* newitem) {
-				item.reset(newitem);
+				item = newitem;
 			}
 			// Getter and setter functions
-			const std::shared_ptr<const Item>& getItem() const {
+			const Item* getItem() const {
 				return item;
 			}
 			const unsigned short& getStackAmount() const {
@@ -405,6 +1001,14 @@ namespace ItemSystem
 			void decrementStackAmount() {
 				stack--;
 			}
+			// Adds an amount to the stack amount.
+			void increaseStackAmount(const unsigned short& amount) {
+				stack += amount;
+			}
+			// Removes an amount from the stack amount.
+			void decreaseStackAmount(const unsigned short& amount) {
+				stack -= amount;
+			}
 			// Operator overloading
 			bool operator==(const ItemSlot& other) {
 				if (item->getID() == other.getItem()->getID())
@@ -415,1520 +1019,6666 @@ namespace ItemSystem
 		/* The Inventory holds a vector of item slots, and      *
 		* handles the creation and deletion of those slots.    *
 		* The inventory can be added to, deleted from, taken   *
-		* from, read entry by entry, and (WIP) sorted and      *
-		* filtered.                                            */
+		* from, and read entry by entry (see the Sorting       *
+		* namespace for sorted and filtered views).            *
+		* Slots are found by item ID through an index, so      *
+		* stacking and lookups don't scan the storage. Deleted *
+		* slots are left empty (no item) and squeezed out in   *
+		* one pass later, which keeps removal constant-time    *
+		* and the slot order stable for the menus.             *
+		* Slot indices change when the storage is compacted;   *
+		* to keep hold of a slot, get a Handle for it. A       *
+		* handle stays valid while its slot lives (across      *
+		* compactions), and resolves to npos once the slot is  *
+		* emptied, even if the entry is reused later.          *
+		* The slots are also watched in chunks, so a save can  *
+		* copy only the chunks that changed since its last     *
+		* look (see isChanged()).                              */
 		class Inventory {
+		public:
+			// The slot index of items that aren't in the inventory.
+			static constexpr unsigned int npos = ~0u;
+			// The most items a slot can stack.
+			static constexpr unsigned short maxStack = std::numeric_limits<unsigned short>::max();
+			// The slots in a watched chunk.
+			static constexpr unsigned int chunkSlots = 256;
+			// A lasting reference to a slot (the default handle refers to nothing).
+			struct Handle {
+				unsigned int entry = npos;
+				unsigned int generation = 0;
+			};
 		private:
+			// Where a handle's slot is, and the generation of the entry (bumped
+			// every time the slot is emptied, which makes older handles stale).
+			struct Entry {
+				unsigned int slot;
+				unsigned int generation;
+			};
 			// The data storage of the inventory.
 			std::vector<ItemSlot> storage;
+			// Slot index -> handle entry (alongside the storage).
+			std::vector<unsigned int> owners;
+			// The handle entries, and the ones free for reuse.
+			std::vector<Entry> entries;
+			std::vector<unsigned int> freeEntries;
+			// Item ID -> slot index (npos if there is no slot).
+			std::vector<unsigned int> lookup;
+			// The slot indices of each category, in inventory order. Emptied
+			// slots are dropped when the category is read, which doesn't change
+			// what the inventory holds (so it's allowed on a const inventory).
+			mutable std::array<std::vector<unsigned int>, categoryCount> categories;
+			// The number of empty slots waiting to be compacted.
+			unsigned int holes = 0;
+			// The number of times the storage was compacted.
+			unsigned int compactions = 0;
+			// Whether each chunk of slots changed since clearChanged().
+			std::vector<unsigned char> changed;
+			// Marks the chunk of a slot as changed.
+			void touch(const unsigned int& slot) {
+				const unsigned int chunk = slot / chunkSlots;
+				if (chunk >= changed.size()) changed.resize(chunk + 1u, 1);
+				changed[chunk] = 1;
+			}
+			// Empties the slot at an index.
+			void removeSlot(const unsigned int& slot) {
+				lookup[storage[slot].getItem()->getID()] = npos;
+				storage[slot] = ItemSlot(nullptr, 0);
+				touch(slot);
+				// Retire the slot's handle entry
+				Entry& entry = entries[owners[slot]];
+				entry.slot = npos;
+				entry.generation++;
+				freeEntries.push_back(owners[slot]);
+				owners[slot] = npos;
+				holes++;
+				// Compact once at least half of the storage is empty
+				if (holes * 2 > storage.size())
+					compact();
+			}
+			// Removes the empty slots (keeping the order) and fixes the index.
+			void compact() {
+				unsigned int kept = 0;
+				for (std::vector<unsigned int>& category : categories)
+					category.clear();
+				for (unsigned int i = 0; i < storage.size(); i++) {
+					if (storage[i].getItem() == nullptr) continue;
+					lookup[storage[i].getItem()->getID()] = kept;
+					categories[categoryToValue(storage[i].getItem()->getCategory())].push_back(kept);
+					entries[owners[i]].slot = kept;
+					owners[kept] = owners[i];
+					storage[kept++] = storage[i];
+				}
+				storage.resize(kept);
+				owners.resize(kept);
+				holes = 0;
+				compactions++;
+				changed.assign(changed.size(), 1);
+			}
 		public:
 			// ctor(s)
 			Inventory() {
 				// Reserve space
 				storage.reserve(20);
+				lookup.resize(Tables::WeaponTable.size() + Tables::ConsumableTable.size(), npos);
 			}
-			// Adds an item to the inventory.
+			// Adds an amount of an item to the inventory. The item must be a
+			// prototype (from the item tables), slots keep a pointer to it.
+			// Throws if the stack would go over maxStack.
 			template<class ItemType>
-			void addItem(const ItemType& item) {
-				// Initialize an item slot
-				ItemSlot slot(new ItemType(item));
-				// Check through inventory to see if an entry already exists
-				for (ItemSlot& entry : storage) {
-					// If there's an entry match
-					if (entry == slot) {
-						// Add to the existing slot's stack
-						entry.incrementStackAmount();
-						// Temporary item slot is destroyed here; no memory leaks (hopefully)
-						return;
-					}
+			void addItem(const ItemType& item, const unsigned short& amount = 1) {
+				const unsigned short& id = item.getID();
+				// Check if the stack has room
+				if (amount > getSpace(id))
+					throw std::overflow_error("Attempted to stack more items than a slot can hold");
+				if (amount == 0) return;
+				// Check the index to see if an entry already exists
+				if (id < lookup.size() && lookup[id] != npos) {
+					// Add to the existing slot's stack
+					storage[lookup[id]].increaseStackAmount(amount);
+					touch(lookup[id]);
+					return;
 				}
 				// No matches, add new entry
-				storage.push_back(std::move(slot));
+				if (id >= lookup.size())
+					lookup.resize(id + 1u, npos);
+				lookup[id] = static_cast<unsigned int>(storage.size());
+				categories[categoryToValue(item.getCategory())].push_back(lookup[id]);
+				storage.push_back(ItemSlot(&item, amount));
+				touch(lookup[id]);
+				// Give the slot a handle entry (reusing a retired one if there is one)
+				if (freeEntries.empty()) {
+					owners.push_back(static_cast<unsigned int>(entries.size()));
+					entries.push_back(Entry{ lookup[id], 0 });
+				}
+				else {
+					owners.push_back(freeEntries.back());
+					entries[freeEntries.back()].slot = lookup[id];
+					freeEntries.pop_back();
+				}
 			}
-			// Adds multiple items to the inventory.
-			template<class ItemType>
-			void addItems(const std::initializer_list<const ItemType>& items) {
+			// Adds multiple items to the inventory (prototypes, as with addItem()).
+			template<class... ItemTypes>
+			void addItems(const ItemTypes&... items) {
 				// Call addItem() for each item
-				for (auto it = items.begin(); it != items.end(); ++it)
-					addItem(*it);
+				(addItem(items), ...);
+			}
+			// Gets the slot index of an item (npos if it isn't in the inventory).
+			unsigned int getSlotIndex(const unsigned short& id) const {
+				if (id >= lookup.size()) return npos;
+				return lookup[id];
+			}
+			// Gets how many more of an item fit in its stack.
+			unsigned short getSpace(const unsigned short& id) const {
+				const unsigned int slot = getSlotIndex(id);
+				if (slot == npos) return maxStack;
+				return maxStack - storage[slot].getStackAmount();
 			}
 			// Inspects an item in the inventory.
-			const Item* inspectItem(const unsigned int& index) {
+			const Item* inspectItem(const unsigned int& index) const {
 				// Check OOB
 				if (index >= storage.size()) return nullptr;
 				// Return the item pointer
-				return storage.at(index).getItem().get();
+				return storage.at(index).getItem();
+			}
+			// Inspects an item in the inventory as a subtype (nullptr if it's another category).
+			template<class ItemType>
+			const ItemType* inspectItem(const unsigned int& index) const {
+				return itemCast<ItemType>(inspectItem(index));
+			}
+			// Gets the slot indices of a category, in inventory order.
+			const std::vector<unsigned int>& getCategory(const Category& category) const {
+				std::vector<unsigned int>& slots = categories[categoryToValue(category)];
+				// Drop slots that were emptied since the last read
+				slots.erase(std::remove_if(slots.begin(), slots.end(), [this](const unsigned int& slot) {
+					return storage[slot].getItem() == nullptr;
+				}), slots.end());
+				return slots;
+			}
+			template<class ItemType>
+			const std::vector<unsigned int>& getCategory() const {
+				return getCategory(ItemType::category);
 			}
 			// Inspects a item slot from the inventory.
-			const ItemSlot* inspectSlot(const unsigned int& index) {
-				// Check OOB
-				if (index >= storage.size()) return nullptr;
+			const ItemSlot* inspectSlot(const unsigned int& index) const {
+				// Check OOB (and empty slots)
+				if (index >= storage.size() || storage.at(index).getItem() == nullptr) return nullptr;
 				// Return the slot reference
 				return &(storage.at(index));
 			}
-			// Removes a single item from the inventory.
-			void deleteItem(const unsigned int& index) {
-				// Check OOB
-				if (index >= storage.size()) return;
+			// Removes an amount of an item from the inventory (at most the
+			// whole stack). Returns how many were removed.
+			unsigned short deleteItem(const unsigned int& index, const unsigned short& amount = 1) {
+				// Check OOB (and empty slots)
+				if (index >= storage.size() || storage.at(index).getItem() == nullptr) return 0;
 				// Remove from stack
-				storage.at(index).decrementStackAmount();
+				const unsigned short removed = std::min(amount, storage.at(index).getStackAmount());
+				storage.at(index).decreaseStackAmount(removed);
+				touch(index);
 				// Check if the slot is empty (and should be deleted)
 				if (storage.at(index).getStackAmount() == 0)
 					// Delete the slot
-					storage.erase(storage.begin() + index);
+					removeSlot(index);
+				return removed;
 			}
 			// Removes an item slot from the inventory.
 			void deleteSlot(const unsigned int& index) {
-				// Check OOB
-				if (index >= storage.size()) return;
+				// Check OOB (and empty slots)
+				if (index >= storage.size() || storage.at(index).getItem() == nullptr) return;
 				// Remove the item slot at the specified index
-				storage.erase(storage.begin() + index);
+				removeSlot(index);
 			}
 			// Takes an item from the inventory (deleting the item slot if stack is out).
-			const std::shared_ptr<const Item> takeItem(const unsigned int& index) {
+			const Item* takeItem(const unsigned int& index) {
 				// Check OOB
 				if (index >= storage.size()) return nullptr;
 				// Get item
-				const std::shared_ptr<const Item> item = storage.at(index).getItem();
+				const Item* item = storage.at(index).getItem();
 				// Remove from stack or delete the item slot
-				if (storage.at(index).getStackAmount() > 1) {
-					// Subtract from stack
-					storage.at(index).decrementStackAmount();
-				}
-				// No stack remaining, remove the entry
-				else {
-					// Delete the entry
-					deleteItem(index);
-				}
+				deleteItem(index);
 				// Return the item
 				return item;
 			}
-			// Gets the entire inventory vector (read-only).
+			// Gets a handle to the slot at an index (the default handle if
+			// there is no slot).
+			Handle getHandle(const unsigned int& index) const {
+				if (index >= storage.size() || storage[index].getItem() == nullptr) return Handle{};
+				return Handle{ owners[index], entries[owners[index]].generation };
+			}
+			// Gets the slot index of a handle (npos if its slot is gone).
+			unsigned int getSlotIndex(const Handle& handle) const {
+				if (handle.entry >= entries.size() || entries[handle.entry].generation != handle.generation) return npos;
+				return entries[handle.entry].slot;
+			}
+			// Inspects the item of a handle's slot (nullptr if the slot is gone).
+			const Item* inspectItem(const Handle& handle) const {
+				const unsigned int index = getSlotIndex(handle);
+				if (index == npos) return nullptr;
+				return storage[index].getItem();
+			}
+			template<class ItemType>
+			const ItemType* inspectItem(const Handle& handle) const {
+				return itemCast<ItemType>(inspectItem(handle));
+			}
+			// Gets the number of slots, counting deleted slots that weren't
+			// compacted yet (inspectSlot() returns nullptr for those).
+			unsigned int getSlotCount() const {
+				return static_cast<unsigned int>(storage.size());
+			}
+			// Gets the number of times the slots were compacted (and moved).
+			const unsigned int& getCompactions() const {
+				return compactions;
+			}
+			// Whether a chunk of slots changed since clearChanged() (chunks
+			// never cleared count as changed).
+			bool isChanged(const unsigned int& chunk) const {
+				return chunk >= changed.size() || changed[chunk] != 0;
+			}
+			// Marks every chunk as unchanged.
+			void clearChanged() {
+				changed.assign((storage.size() + chunkSlots - 1) / chunkSlots, 0);
+			}
+			// Gets the entire inventory vector (read-only). Squeezes out
+			// deleted slots first, so the slot indices may change.
 			const std::vector<ItemSlot>& getAll() {
+				if (holes > 0)
+					compact();
 				return storage;
 			}
 		};
 	}
-}
-
-using namespace ItemSystem::Items;
-using namespace ItemSystem::Tables;
-using namespace ItemSystem::Container;
-
-////////////////WEAPONSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSS STructs.
-/*
-struct Weapon {
-string wep_name;
-string wep_desc;
-int getDamage();
-int getCrit();
-int wep_type;
-int wep_spelldam;
-int getBuyPrice();
-int getAccuracy();
-};
-
-struct Consumable {
-string con_name;
-int con_healgain;
-int con_managain;
-int con_type;
-int con_cost;
-};
-*/
-
-struct Accuracy {
-
-	int head;
-	int chest;
-	int rightarm;
-	int leftarm;
-	int rightleg;
-	int leftleg;
-	///Bodypart Damage Multiplier
-	double headdamagex = 2.00;
-	double chestdamagex = 1.00;
-	double rightarmdamagex = 1.00;
-	double leftarmdamagex = 1.00;
-	double rightlegdamagex = 1.00;
-	double leftlegdamagex = 1.00;
-} Acc;
-
-void chargen();
-
-/*
-const vector<Consumable> consumableTable{
-What does this mean... though?
-Name
-Health Gain
-Mana Gain
-Type (1 = Health Potion, 2 = Mana Potion)
-Cost
-///Health Potions
-{ "Normal Health Potion", 25, 0, 1, 5 },
-{ "Greater Health Potion", 100, 0, 1, 15, },
-{ "Super Health Potion", 500, 0, 1, 50 },
-{ "Full Health Potion", 9999, 0, 1, 150 },
-///Mana Potions
-{ "Normal Mana Potion", 0, 5, 2, 5 },
-{ "Greater Mana Potion", 0, 25, 2, 10 },
-{ "Super Mana Potion", 0, 100, 2, 35 },
-{ "Full Mana Potion", 0, 9999, 2, 100 }
-
-};
-
-*/
-
-
-
-int input;
-void inventory();
-
-struct Enemy
-{
-	string ename;
-	int maxeHP;
-	int maxeMP;
-	int emp;
-	int ehp;
-	int estr;
-	int edef;
-	int eitl;
-	int espd;
-	int ecrt;
-	int elvl;
-	double eheadhp = 1.00;
-	double echesthp = 1.00;
-	double erightarmhp = 1.00;
-	double eleftarmhp = 1.00;
-	double erightleghp = 1.00;
-	double eleftleghp = 1.00;
-} Enemy;
-
-struct Character
-{
-	///Everything not related to the things below
-	string name = "None";
-	string race = "None";
-	string clas = "None";
-	string difficultyN = "Normal";
-	string profession = "None";
-	string dad;
-	double difficultyD = 1;
-	double expmultiplier = 1;
-	int dust = 15;
-	///Stats
-	int lvl = 1;
-	int exp = 0;
-	int maxHP;
-	int maxMP;
-	int hp;
-	int mp;
-	int str = 1;
-	int def = 1;
-	int crt = 1;
-	int spd = 1;
-	int itl = 1;
-	///Bodypart Health
-	double headhp = 1.00;
-	double chesthp = 1.00;
-	double rightarmhp = 1.00;
-	double leftarmhp = 1.00;
-	double rightleghp = 1.00;
-	double leftleghp = 1.00;
-	///Skill Professions start here
-	double strprof = 1.00;
-	double defprof = 1.00;
-	double spdprof = 1.00;
-	double itlprof = 1.00;
-	///Weapon Professions start here
-	double bowprof = 1.00;
-	double swordprof = 1.00;
-	double staffprof = 1.00;
-	double unarmedprof = 1.00;
-	///Literally useless.
-	int seed;
-	bool blackmarketfirst = false;
-	bool workshopfirst = false;
-	///Body Mods/workshop
-	string modsot[4] = { "Dust Grip - (Sword Prof +.25) - 50 Dust", "Dust String - (Bow Prof +.25) - 50 Dust", "Casting Serum - (Staff Prof +.25) - 50 Dust", "Knuckle Dust - (Unarmed Prof +.25) - 50 Dust" };
-	int modsmt[4] = { 15, 15, 15, 15 };
-	// Inventory
-	Inventory inventory;
-	Weapon* equipped;
-} Charac;
+	/* The Sorting namespace has the inventory sorting and    *
+	* filtering engine. Sort keys are computed once per     *
+	* slot and cached, new slots are put in place with a    *
+	* binary search instead of sorting again, and filters   *
+	* only ever look at the slots (nothing is copied).      */
+	namespace Sorting
+	{
+		// Better readability
+		using namespace ItemSystem::Items;
+		using namespace ItemSystem::Container;
+		// The things an inventory can be sorted by.
+		enum class SortKey : unsigned int {
+			NAME, BUY, SELL, DAMAGE, CRIT, ACCURACY, HEAL, CATEGORY
+		};
+		// Computes the sort key of an item. Names are keyed by their first
+		// 8 characters (so most name compares are one integer compare),
+		// stats the item doesn't have count as 0.
+		constexpr std::uint64_t makeKey(const Item& item, const SortKey& key) {
+			const Weapon* weapon = itemCast<Weapon>(&item);
+			const Consumable* consumable = itemCast<Consumable>(&item);
+			switch (key) {
+			case SortKey::NAME: {
+				std::uint64_t packed = 0;
+				for (std::size_t i = 0; i < 8; i++)
+					packed = (packed << 8) | (i < item.getName().size() ? static_cast<unsigned char>(item.getName()[i]) : 0);
+				return packed;
+			}
+			case SortKey::BUY:
+				return item.getBuyPrice();
+			case SortKey::SELL:
+				return item.getSellPrice();
+			case SortKey::DAMAGE:
+				return weapon ? weapon->getDamage() : 0;
+			case SortKey::CRIT:
+				return weapon ? weapon->getCrit() : 0;
+			case SortKey::ACCURACY:
+				return weapon ? weapon->getAccuracy() : 0;
+			case SortKey::HEAL:
+				return consumable ? consumable->getHealth() : 0;
+			case SortKey::CATEGORY:
+				return categoryToValue(item.getCategory());
+			}
+			return 0;
+		}
+		/* A Filter wraps a predicate on item slots so filters  *
+		* can be combined with &, | and !. Build them with the *
+		* functions below (inCategory(), atLeast(), ...).      */
+		template<class Predicate>
+		class Filter {
+		private:
+			// The wrapped predicate
+			Predicate predicate;
+		public:
+			// ctor(s)
+			constexpr Filter(const Predicate& _predicate) : predicate(_predicate) { }
+			// Checks a slot.
+			constexpr bool operator()(const ItemSlot& slot) const {
+				return predicate(slot);
+			}
+			// Operator overloading
+			template<class Other>
+			constexpr auto operator&(const Filter<Other>& other) const {
+				const Filter self = *this;
+				auto both = [self, other](const ItemSlot& slot) { return self(slot) && other(slot); };
+				return Filter<decltype(both)>(both);
+			}
+			template<class Other>
+			constexpr auto operator|(const Filter<Other>& other) const {
+				const Filter self = *this;
+				auto either = [self, other](const ItemSlot& slot) { return self(slot) || other(slot); };
+				return Filter<decltype(either)>(either);
+			}
+			constexpr auto operator!() const {
+				const Filter self = *this;
+				auto negated = [self](const ItemSlot& slot) { return !self(slot); };
+				return Filter<decltype(negated)>(negated);
+			}
+		};
+		// Makes a filter from any predicate on item slots.
+		template<class Predicate>
+		constexpr Filter<Predicate> makeFilter(const Predicate& predicate) {
+			return Filter<Predicate>(predicate);
+		}
+		// Passes every slot.
+		constexpr auto everything() {
+			return makeFilter([](const ItemSlot&) { return true; });
+		}
+		// Passes slots of a category.
+		constexpr auto inCategory(const Category& category) {
+			return makeFilter([category](const ItemSlot& slot) { return slot.getItem()->getCategory() == category; });
+		}
+		// Passes slots whose key is at least a value.
+		constexpr auto atLeast(const SortKey& key, const std::uint64_t& value) {
+			return makeFilter([key, value](const ItemSlot& slot) { return makeKey(*slot.getItem(), key) >= value; });
+		}
+		// Passes slots whose key is at most a value.
+		constexpr auto atMost(const SortKey& key, const std::uint64_t& value) {
+			return makeFilter([key, value](const ItemSlot& slot) { return makeKey(*slot.getItem(), key) <= value; });
+		}
+		// Passes slots whose item name contains some text.
+		inline auto nameContains(const std::string_view& text) {
+			return makeFilter([text](const ItemSlot& slot) { return slot.getItem()->getName().find(text) != std::string_view::npos; });
+		}
+		/* The SortedView class keeps an inventory's slots in   *
+		* sorted order. Call refresh() after changing the      *
+		* inventory: new slots are inserted in place, and the  *
+		* whole view is only sorted again after the inventory  *
+		* was compacted. Equal keys keep the inventory order.  */
+		class SortedView {
+		private:
+			// A slot and its cached sort key.
+			struct Entry {
+				std::uint64_t key;
+				unsigned int slot;
+			};
+			// The viewed inventory
+			Inventory& inventory;
+			// What to sort by, and which way
+			SortKey key;
+			bool descending;
+			// The sorted slots (and scratch space for sorting)
+			std::vector<Entry> order;
+			std::vector<Entry> scratch;
+			// The inventory's slot count and compaction count at the last refresh
+			unsigned int seen = 0;
+			unsigned int compactions = 0;
+			// Compares the full names of two entries (for names with the same key).
+			int compareNames(const Entry& a, const Entry& b) {
+				const int compared = inventory.inspectSlot(a.slot)->getItem()->getName().compare(inventory.inspectSlot(b.slot)->getItem()->getName());
+				return descending ? -compared : compared;
+			}
+			// Checks if an entry goes before another one.
+			bool before(const Entry& a, const Entry& b) {
+				if (a.key != b.key)
+					return a.key < b.key;
+				// Names with the same first 8 characters need a full compare
+				if (key == SortKey::NAME) {
+					const int compared = compareNames(a, b);
+					if (compared != 0)
+						return compared < 0;
+				}
+				return a.slot < b.slot;
+			}
+			// Gets the entry of a slot (descending keys are flipped, so the
+			// entries are always sorted low to high).
+			Entry makeEntry(const unsigned int& slot) {
+				const std::uint64_t value = makeKey(*inventory.inspectSlot(slot)->getItem(), key);
+				return Entry{ descending ? ~value : value, slot };
+			}
+			// Sorts the entries by key with a stable LSD radix sort. Bytes
+			// that are the same in every key are skipped, so small numeric
+			// keys take two passes. Equal keys stay in slot order.
+			void radixSort() {
+				scratch.resize(order.size());
+				for (unsigned int shift = 0; shift < 64; shift += 8) {
+					std::array<std::size_t, 256> counts{};
+					for (const Entry& entry : order)
+						counts[(entry.key >> shift) & 0xff]++;
+					if (counts[order.empty() ? 0 : (order[0].key >> shift) & 0xff] == order.size()) continue;
+					std::size_t position = 0;
+					for (std::size_t& count : counts) {
+						const std::size_t bucket = count;
+						count = position;
+						position += bucket;
+					}
+					for (const Entry& entry : order)
+						scratch[counts[(entry.key >> shift) & 0xff]++] = entry;
+					order.swap(scratch);
+				}
+				// Names with the same first 8 characters are sorted by the full name
+				if (key != SortKey::NAME) return;
+				for (auto run = order.begin(); run != order.end();) {
+					const auto runEnd = std::find_if(run, order.end(), [&run](const Entry& entry) { return entry.key != run->key; });
+					if (runEnd - run > 1)
+						std::stable_sort(run, runEnd, [this](const Entry& a, const Entry& b) { return compareNames(a, b) < 0; });
+					run = runEnd;
+				}
+			}
+		public:
+			// ctor(s)
+			SortedView(Inventory& _inventory, const SortKey& _key = SortKey::NAME, const bool& _descending = false)
+				: inventory(_inventory), key(_key), descending(_descending) {
+				sortBy(_key, _descending);
+			}
+			// Sorts the whole view again by a key.
+			void sortBy(const SortKey& _key, const bool& _descending = false) {
+				key = _key;
+				descending = _descending;
+				order.clear();
+				seen = inventory.getSlotCount();
+				compactions = inventory.getCompactions();
+				for (unsigned int slot = 0; slot < seen; slot++)
+					if (inventory.inspectSlot(slot) != nullptr)
+						order.push_back(makeEntry(slot));
+				radixSort();
+			}
+			// Catches up with the changes to the inventory.
+			void refresh() {
+				// Compacting moves every slot, start over
+				if (compactions != inventory.getCompactions()) {
+					sortBy(key, descending);
+					return;
+				}
+				// New slots are always added at the end, insert them in place
+				for (; seen < inventory.getSlotCount(); seen++) {
+					if (inventory.inspectSlot(seen) == nullptr) continue;
+					const Entry entry = makeEntry(seen);
+					order.insert(std::upper_bound(order.begin(), order.end(), entry, [this](const Entry& a, const Entry& b) { return before(a, b); }), entry);
+				}
+			}
+			// Calls a function with the index and slot of every slot that
+			// passes a filter, in sorted order. Deleted slots are skipped.
+			template<class Predicate, class Function>
+			void forEach(const Filter<Predicate>& filter, Function function) {
+				for (const Entry& entry : order) {
+					const ItemSlot* slot = inventory.inspectSlot(entry.slot);
+					if (slot != nullptr && filter(*slot))
+						function(entry.slot, *slot);
+				}
+			}
+			// Puts the indices of the slots that pass a filter in a vector
+			// (in sorted order), reusing its memory.
+			template<class Predicate>
+			void select(const Filter<Predicate>& filter, std::vector<unsigned int>& slots) {
+				slots.clear();
+				forEach(filter, [&slots](const unsigned int& slot, const ItemSlot&) { slots.push_back(slot); });
+			}
+		};
+	}
+	/* The Scripting namespace runs item effects. An effect  *
+	* is a small script, for example                        *
+	*     hp = min(hp + health * 2, maxhp); str += 1        *
+	* made of statements separated by ';' that set a stat  *
+	* (=, +=, -=, *=, /=) to an expression of numbers,     *
+	* stats, the item's own fields, + - * / and min()/max().*
+	* Scripts are compiled once to bytecode for a small     *
+	* register machine, with the item fields and constant  *
+	* math folded in while compiling: the built-in items'  *
+	* when an effect is first needed, and a database's     *
+	* when it loads (so a bad one fails the load).         */
+	namespace Scripting
+	{
+		// Better readability
+		using namespace ItemSystem::Items;
+		// The stats a script can read and set.
+		enum class Stat : unsigned char {
+			HP, MP, MAXHP, MAXMP, STR, DEF, ITL, SPD, CRT, DUST, LVL, EXP
+		};
+		// The number of stats.
+		constexpr std::size_t statCount = static_cast<std::size_t>(Stat::EXP) + 1;
+		// The script names of the stats (in Stat order).
+		constexpr std::array<std::string_view, statCount> statNames{
+			"hp", "mp", "maxhp", "maxmp", "str", "def", "itl", "spd", "crt", "dust", "lvl", "exp"
+		};
+		// The values of the stats a script works on.
+		using Stats = std::array<int, statCount>;
+		// The bytecode operations.
+		enum class Op : unsigned char {
+			LOADK,	// a = constant b
+			LOADS,	// a = stat b
+			STORES,	// stat a = b (clamped to int)
+			ADD, SUB, MUL, DIV, MIN, MAX,	// a = b op c
+			ADDK, MULK, MINK, MAXK, DIVK,	// a = b op constant c (DIVK's is never 0 or -1)
+			END
+		};
+		// A bytecode instruction (4 bytes).
+		struct Instruction {
+			Op op;
+			unsigned char a, b, c;
+		};
+		// The number of registers (the deepest expression a script can have).
+		constexpr unsigned char registerCount = 16;
+		// The deepest parentheses, minus signs and min()/max() can nest (the parser recurses on each).
+		constexpr unsigned int maxNesting = 64;
+		// Arithmetic that wraps around where it would overflow (signed overflow is undefined).
+		inline std::int64_t wrappingAdd(const std::int64_t& lhs, const std::int64_t& rhs) {
+			return static_cast<std::int64_t>(static_cast<std::uint64_t>(lhs) + static_cast<std::uint64_t>(rhs));
+		}
+		inline std::int64_t wrappingSub(const std::int64_t& lhs, const std::int64_t& rhs) {
+			return static_cast<std::int64_t>(static_cast<std::uint64_t>(lhs) - static_cast<std::uint64_t>(rhs));
+		}
+		inline std::int64_t wrappingMul(const std::int64_t& lhs, const std::int64_t& rhs) {
+			return static_cast<std::int64_t>(static_cast<std::uint64_t>(lhs) * static_cast<std::uint64_t>(rhs));
+		}
+		// The most steps an affine script keeps (see Script).
+		constexpr std::size_t maxSteps = 4;
+		// A step of an affine script: a stat is set to a value, or the value is added to it.
+		struct Step {
+			unsigned char stat;
+			bool add;
+			std::int64_t value;
+		};
+		/* A Script is a compiled effect: its bytecode and its  *
+		* constants. Most effects only add constants to stats  *
+		* or set them (hp += health; mp += mana). Those are    *
+		* affine, and also kept as a few Steps that run        *
+		* without the register machine.                        */
+		struct Script {
+			std::vector<Instruction> code;
+			std::vector<std::int64_t> constants;
+			bool affine = true;
+			std::array<Step, maxSteps> steps{};
+			std::size_t stepCount = 0;
+		};
+		/* The Compiler class turns effect text into a Script.  *
+		* It's a recursive descent parser that writes the      *
+		* bytecode as it goes. Throws std::runtime_error on    *
+		* errors (effects are data, like the item database).   */
+		class Compiler {
+		private:
+			// A value while compiling: a known constant, or a register.
+			struct Operand {
+				bool constant;
+				std::int64_t value;
+				unsigned char reg;
+			};
+			// The item the script belongs to (for its fields)
+			const Item& item;
+			// The script text and the read position
+			const std::string_view text;
+			std::size_t position = 0;
+			// The script being built
+			Script script;
+			// The next free register
+			unsigned char nextRegister = 0;
+			// How deep the parser is nested
+			unsigned int nesting = 0;
+			// Throws a compile error.
+			[[noreturn]] void fail(const std::string& message) const {
+				throw std::runtime_error("Item script error in " + std::string(item.getName()) + " at " + std::to_string(position) + ": " + message);
+			}
+			// Skips spaces and returns the next character (0 at the end).
+			char peek() {
+				while (position < text.size() && (text[position] == ' ' || text[position] == '\t' || text[position] == '\n'))
+					position++;
+				return position < text.size() ? text[position] : 0;
+			}
+			// Skips a character if it's next.
+			bool accept(const char& c) {
+				if (peek() != c) return false;
+				position++;
+				return true;
+			}
+			// Requires a character to be next.
+			void expect(const char& c) {
+				if (!accept(c)) fail(std::string("expected '") + c + "'");
+			}
+			// Reads a name.
+			std::string_view readName() {
+				peek();
+				const std::size_t start = position;
+				while (position < text.size() && (std::isalnum(static_cast<unsigned char>(text[position])) || text[position] == '_'))
+					position++;
+				if (start == position) fail("expected a name");
+				return text.substr(start, position - start);
+			}
+			// Finds a stat by name (statCount if it isn't one).
+			static std::size_t findStat(const std::string_view& name) {
+				return std::find(statNames.begin(), statNames.end(), name) - statNames.begin();
+			}
+			// Reads an item field by name.
+			bool readField(const std::string_view& name, std::int64_t& value) const {
+				if (name == "buy") value = item.getBuyPrice();
+				else if (name == "sell") value = item.getSellPrice();
+				else if (const Consumable* consumable = itemCast<Consumable>(&item)) {
+					if (name == "health") value = consumable->getHealth();
+					else if (name == "mana") value = consumable->getMana();
+					else return false;
+				}
+				else if (const Weapon* weapon = itemCast<Weapon>(&item)) {
+					if (name == "damage") value = weapon->getDamage();
+					else if (name == "crit") value = weapon->getCrit();
+					else if (name == "spelldam") value = weapon->getSpellDamage();
+					else if (name == "accuracy") value = weapon->getAccuracy();
+					else return false;
+				}
+				else return false;
+				return true;
+			}
+			// Adds an instruction.
+			void emit(const Op& op, const unsigned int& a = 0, const unsigned int& b = 0, const unsigned int& c = 0) {
+				script.code.push_back(Instruction{ op, static_cast<unsigned char>(a), static_cast<unsigned char>(b), static_cast<unsigned char>(c) });
+			}
+			// Adds a constant (reusing an equal one) and returns its index.
+			unsigned char addConstant(const std::int64_t& value) {
+				for (std::size_t i = 0; i < script.constants.size(); i++)
+					if (script.constants[i] == value) return static_cast<unsigned char>(i);
+				if (script.constants.size() > std::numeric_limits<unsigned char>::max()) fail("too many constants");
+				script.constants.push_back(value);
+				return static_cast<unsigned char>(script.constants.size() - 1);
+			}
+			// Goes a level deeper (leave with nesting--).
+			void nest() {
+				if (++nesting > maxNesting) fail("expression is nested too deep");
+			}
+			// Takes the next free register.
+			unsigned char allocate() {
+				if (nextRegister == registerCount) fail("expression is too deep");
+				return nextRegister++;
+			}
+			// Makes sure an operand is in a register.
+			Operand materialize(const Operand& operand) {
+				if (!operand.constant) return operand;
+				const unsigned char reg = allocate();
+				emit(Op::LOADK, reg, addConstant(operand.value));
+				return Operand{ false, 0, reg };
+			}
+			// Applies an operation to two constants (failing if the result doesn't fit).
+			std::int64_t fold(const Op& op, const std::int64_t& lhs, const std::int64_t& rhs) {
+				constexpr std::int64_t most = std::numeric_limits<std::int64_t>::max(), least = std::numeric_limits<std::int64_t>::min();
+				switch (op) {
+				case Op::ADD:
+					if (rhs > 0 ? lhs > most - rhs : lhs < least - rhs) fail("number is too big");
+					return lhs + rhs;
+				case Op::SUB:
+					if (rhs < 0 ? lhs > most + rhs : lhs < least + rhs) fail("number is too big");
+					return lhs - rhs;
+				case Op::MUL:
+					if (lhs != 0 && rhs != 0 && (lhs > 0 ? (rhs > 0 ? lhs > most / rhs : rhs < least / lhs) : (rhs > 0 ? lhs < least / rhs : rhs < most / lhs)))
+						fail("number is too big");
+					return lhs * rhs;
+				case Op::DIV:
+					if (rhs == 0) fail("division by zero");
+					if (lhs == least && rhs == -1) fail("number is too big");
+					return lhs / rhs;
+				case Op::MIN: return std::min(lhs, rhs);
+				default: return std::max(lhs, rhs);
+				}
+			}
+			// Combines two operands (rhs was compiled after lhs, so its
+			// register, if any, is the newest one).
+			Operand combine(const Op& op, const Operand& lhs, const Operand& rhs) {
+				if (lhs.constant && rhs.constant)
+					return Operand{ true, fold(op, lhs.value, rhs.value), 0 };
+				// Register and constant: use the constant forms where there is one
+				const bool commutes = op == Op::ADD || op == Op::MUL || op == Op::MIN || op == Op::MAX;
+				const auto constantForm = [](const Op& form) {
+					return form == Op::ADD ? Op::ADDK : form == Op::MUL ? Op::MULK : form == Op::MIN ? Op::MINK : Op::MAXK;
+				};
+				if (!lhs.constant && rhs.constant && (commutes || op == Op::SUB || (op == Op::DIV && rhs.value != 0 && rhs.value != -1))) {
+					if (op == Op::DIV)
+						emit(Op::DIVK, lhs.reg, lhs.reg, addConstant(rhs.value));
+					else if (op == Op::SUB) {
+						if (rhs.value == std::numeric_limits<std::int64_t>::min()) fail("number is too big");
+						emit(Op::ADDK, lhs.reg, lhs.reg, addConstant(-rhs.value));
+					}
+					else emit(constantForm(op), lhs.reg, lhs.reg, addConstant(rhs.value));
+					return lhs;
+				}
+				if (lhs.constant && commutes) {
+					emit(constantForm(op), rhs.reg, rhs.reg, addConstant(lhs.value));
+					return rhs;
+				}
+				// Both in registers (result goes to the older one)
+				if (lhs.constant) {
+					const Operand left = materialize(lhs);
+					emit(op, rhs.reg, left.reg, rhs.reg);
+					nextRegister--;
+					return rhs;
+				}
+				const Operand right = materialize(rhs);
+				emit(op, lhs.reg, lhs.reg, right.reg);
+				nextRegister--;
+				return lhs;
+			}
+			// primary: number | name | name(expr, expr) | (expr) | -primary
+			Operand parsePrimary() {
+				const char c = peek();
+				if (c == '(') {
+					position++;
+					nest();
+					const Operand inner = parseExpression();
+					expect(')');
+					nesting--;
+					return inner;
+				}
+				if (c == '-') {
+					position++;
+					nest();
+					const Operand negated = combine(Op::MUL, parsePrimary(), Operand{ true, -1, 0 });
+					nesting--;
+					return negated;
+				}
+				if (std::isdigit(static_cast<unsigned char>(c))) {
+					std::int64_t value = 0;
+					while (position < text.size() && std::isdigit(static_cast<unsigned char>(text[position]))) {
+						value = value * 10 + (text[position++] - '0');
+						if (value > std::numeric_limits<int>::max()) fail("number is too big");
+					}
+					return Operand{ true, value, 0 };
+				}
+				const std::string_view name = readName();
+				if (name == "min" || name == "max") {
+					expect('(');
+					nest();
+					const Operand lhs = parseExpression();
+					expect(',');
+					const Operand rhs = parseExpression();
+					expect(')');
+					nesting--;
+					return combine(name == "min" ? Op::MIN : Op::MAX, lhs, rhs);
+				}
+				std::int64_t value;
+				if (readField(name, value))
+					return Operand{ true, value, 0 };
+				const std::size_t stat = findStat(name);
+				if (stat == statCount) fail("unknown name '" + std::string(name) + "'");
+				const unsigned char reg = allocate();
+				emit(Op::LOADS, reg, static_cast<unsigned int>(stat));
+				return Operand{ false, 0, reg };
+			}
+			// term: primary (('*' | '/') primary)*
+			Operand parseTerm() {
+				Operand lhs = parsePrimary();
+				for (;;) {
+					if (accept('*')) lhs = combine(Op::MUL, lhs, parsePrimary());
+					else if (accept('/')) lhs = combine(Op::DIV, lhs, parsePrimary());
+					else return lhs;
+				}
+			}
+			// expression: term (('+' | '-') term)*
+			Operand parseExpression() {
+				Operand lhs = parseTerm();
+				for (;;) {
+					if (accept('+')) lhs = combine(Op::ADD, lhs, parseTerm());
+					else if (accept('-')) lhs = combine(Op::SUB, lhs, parseTerm());
+					else return lhs;
+				}
+			}
+			// statement: stat ('=' | '+=' | '-=' | '*=' | '/=') expression
+			void parseStatement() {
+				const std::string_view name = readName();
+				const std::size_t stat = findStat(name);
+				if (stat == statCount) fail("'" + std::string(name) + "' is not a stat");
+				Op op = Op::END;
+				if (accept('+')) op = Op::ADD;
+				else if (accept('-')) op = Op::SUB;
+				else if (accept('*')) op = Op::MUL;
+				else if (accept('/')) op = Op::DIV;
+				if (op != Op::END && position < text.size() && text[position] != '=') fail("expected '='");
+				expect('=');
+				Operand value;
+				if (op == Op::END)
+					value = parseExpression();
+				else {
+					const unsigned char reg = allocate();
+					emit(Op::LOADS, reg, static_cast<unsigned int>(stat));
+					value = combine(op, Operand{ false, 0, reg }, parseExpression());
+				}
+				value = materialize(value);
+				emit(Op::STORES, static_cast<unsigned int>(stat), value.reg);
+				nextRegister = 0;
+			}
+		public:
+			// ctor(s)
+			Compiler(const Item& _item, const std::string_view& _text) : item(_item), text(_text) { }
+			// Compiles the script.
+			Script compile() {
+				while (peek() != 0) {
+					const std::size_t start = script.code.size();
+					parseStatement();
+					if (!accept(';') && peek() != 0) fail("expected ';'");
+					// Keep the statement as a step if it's stat = constant, or stat += constant
+					const Instruction* statement = script.code.data() + start;
+					const std::size_t length = script.code.size() - start;
+					if (script.stepCount == maxSteps) script.affine = false;
+					else if (length == 2 && statement[0].op == Op::LOADK)
+						script.steps[script.stepCount++] = Step{ statement[1].a, false, script.constants[statement[0].b] };
+					else if (length == 3 && statement[0].op == Op::LOADS && statement[1].op == Op::ADDK && statement[0].b == statement[2].a)
+						script.steps[script.stepCount++] = Step{ statement[2].a, true, script.constants[statement[1].c] };
+					else script.affine = false;
+				}
+				emit(Op::END);
+				return script;
+			}
+		};
+		// Runs a compiled script on a set of stats.
+		inline void execute(const Script& script, Stats& stats) {
+			const auto store = [](const std::int64_t& value) {
+				return static_cast<int>(std::clamp<std::int64_t>(value, std::numeric_limits<int>::min(), std::numeric_limits<int>::max()));
+			};
+			if (script.affine) {
+				for (std::size_t i = 0; i < script.stepCount; i++) {
+					const Step& step = script.steps[i];
+					stats[step.stat] = store(step.add ? wrappingAdd(stats[step.stat], step.value) : step.value);
+				}
+				return;
+			}
+			std::int64_t r[registerCount];
+			const std::int64_t* k = script.constants.data();
+			const Instruction* ip = script.code.data();
+			// Computed gotos where the compiler has them, a switch otherwise
+#if defined(__GNUC__)
+			static const void* const labels[] = {
+				&&op_LOADK, &&op_LOADS, &&op_STORES, &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV,
+				&&op_MIN, &&op_MAX, &&op_ADDK, &&op_MULK, &&op_MINK, &&op_MAXK, &&op_DIVK, &&op_END
+			};
+#define SCRIPT_OP(name) op_##name:
+#define SCRIPT_NEXT ip++; goto *labels[static_cast<unsigned char>(ip->op)]
+			goto *labels[static_cast<unsigned char>(ip->op)];
+#else
+#define SCRIPT_OP(name) case Op::name:
+#define SCRIPT_NEXT ip++; continue
+			for (;;) switch (ip->op) {
+#endif
+			SCRIPT_OP(LOADK) r[ip->a] = k[ip->b]; SCRIPT_NEXT;
+			SCRIPT_OP(LOADS) r[ip->a] = stats[ip->b]; SCRIPT_NEXT;
+			SCRIPT_OP(STORES) stats[ip->a] = store(r[ip->b]); SCRIPT_NEXT;
+			SCRIPT_OP(ADD) r[ip->a] = wrappingAdd(r[ip->b], r[ip->c]); SCRIPT_NEXT;
+			SCRIPT_OP(SUB) r[ip->a] = wrappingSub(r[ip->b], r[ip->c]); SCRIPT_NEXT;
+			SCRIPT_OP(MUL) r[ip->a] = wrappingMul(r[ip->b], r[ip->c]); SCRIPT_NEXT;
+			// (Dividing the most negative number by -1 overflows too)
+			SCRIPT_OP(DIV) r[ip->a] = r[ip->c] == 0 ? 0 : r[ip->c] == -1 ? wrappingSub(0, r[ip->b]) : r[ip->b] / r[ip->c]; SCRIPT_NEXT;
+			SCRIPT_OP(MIN) r[ip->a] = std::min(r[ip->b], r[ip->c]); SCRIPT_NEXT;
+			SCRIPT_OP(MAX) r[ip->a] = std::max(r[ip->b], r[ip->c]); SCRIPT_NEXT;
+			SCRIPT_OP(ADDK) r[ip->a] = wrappingAdd(r[ip->b], k[ip->c]); SCRIPT_NEXT;
+			SCRIPT_OP(MULK) r[ip->a] = wrappingMul(r[ip->b], k[ip->c]); SCRIPT_NEXT;
+			SCRIPT_OP(MINK) r[ip->a] = std::min(r[ip->b], k[ip->c]); SCRIPT_NEXT;
+			SCRIPT_OP(MAXK) r[ip->a] = std::max(r[ip->b], k[ip->c]); SCRIPT_NEXT;
+			SCRIPT_OP(DIVK) r[ip->a] = r[ip->b] / k[ip->c]; SCRIPT_NEXT;
+			SCRIPT_OP(END) return;
+#if !defined(__GNUC__)
+			}
+#endif
+#undef SCRIPT_OP
+#undef SCRIPT_NEXT
+		}
+		// Compiles every effect of a pair of item tables, by item ID.
+		inline std::vector<Script> compile(const Tables::Catalog<Weapon>& weapons, const Tables::Catalog<Consumable>& consumables) {
+			std::vector<Script> compiled(weapons.size() + consumables.size());
+			for (const Weapon& weapon : weapons)
+				compiled[weapon.getID()] = Compiler(weapon, weapon.getEffect()).compile();
+			for (const Consumable& consumable : consumables)
+				compiled[consumable.getID()] = Compiler(consumable, consumable.getEffect()).compile();
+			return compiled;
+		}
+		// The compiled effects of the loaded item database, by item ID (empty if there isn't one).
+		inline std::vector<Script> installed;
+		// The compiled effects of the built-in tables, by item ID (compiled when first needed, not before main()).
+		inline const std::vector<Script>& builtinScripts() {
+			static const std::vector<Script> compiled = compile(Tables::Catalog<Weapon>(Tables::BuiltinWeapons), Tables::Catalog<Consumable>(Tables::BuiltinConsumables));
+			return compiled;
+		}
+		inline void check(const Tables::Catalog<Weapon>& weapons, const Tables::Catalog<Consumable>& consumables) {
+			compile(weapons, consumables);
+		}
+		inline void install(const Tables::Catalog<Weapon>& weapons, const Tables::Catalog<Consumable>& consumables) {
+			installed = compile(weapons, consumables);
+		}
+		// Gets the compiled effect of an item.
+		inline const Script& getScript(const Item& item) {
+			return installed.empty() ? builtinScripts()[item.getID()] : installed[item.getID()];
+		}
+		// Uses an item on a set of stats.
+		inline void use(const Item& item, Stats& stats) {
+			execute(getScript(item), stats);
+		}
+	}
+}
 
-void home();
+using namespace ItemSystem::Items;
+using namespace ItemSystem::Tables;
+using namespace ItemSystem::Container;
+using namespace ItemSystem::Sorting;
+using namespace ItemSystem::Scripting;
 
+/* The Randomness namespace has the game's random        *
+* generator: Philox4x32-10, a counter-based generator.  *
+* Every number is a pure function of a key (the seed), *
+* a stream number and a position in the stream, so     *
+* streams are independent of each other and of the     *
+* order they are used in. Give each session, fight and  *
+* subsystem its own stream (see streamID()).            */
+namespace Randomness
+{
+	// A block of Philox (four 32-bit words).
+	using Block = std::array<std::uint32_t, 4>;
+	// The Philox multipliers and key increments.
+	constexpr std::uint32_t philoxM0 = 0xD2511F53u, philoxM1 = 0xCD9E8D57u;
+	constexpr std::uint32_t philoxW0 = 0x9E3779B9u, philoxW1 = 0xBB67AE85u;
+	// Encrypts a counter block with a key (10 rounds).
+	constexpr Block philox(Block counter, std::uint32_t key0, std::uint32_t key1) {
+		for (int round = 0; round < 10; round++) {
+			const std::uint64_t product0 = static_cast<std::uint64_t>(philoxM0) * counter[0];
+			const std::uint64_t product1 = static_cast<std::uint64_t>(philoxM1) * counter[2];
+			counter = Block{
+				static_cast<std::uint32_t>(product1 >> 32) ^ counter[1] ^ key0, static_cast<std::uint32_t>(product1),
+				static_cast<std::uint32_t>(product0 >> 32) ^ counter[3] ^ key1, static_cast<std::uint32_t>(product0)
+			};
+			key0 += philoxW0;
+			key1 += philoxW1;
+		}
+		return counter;
+	}
+	// Compares blocks (std::array's == isn't constexpr until C++20).
+	constexpr bool sameBlock(const Block& a, const Block& b) {
+		return a[0] == b[0] && a[1] == b[1] && a[2] == b[2] && a[3] == b[3];
+	}
+	// Known answers from the Philox paper's reference implementation.
+	static_assert(sameBlock(philox(Block{ 0, 0, 0, 0 }, 0, 0), Block{ 0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u }), "Philox is broken");
+	static_assert(sameBlock(philox(Block{ 0x243f6a88u, 0x85a308d3u, 0x13198a2eu, 0x03707344u }, 0xa4093822u, 0x299f31d0u), Block{ 0xd16cfe09u, 0x94fdccebu, 0x5001e420u, 0x24126ea1u }), "Philox is broken");
+	// The parts of the game that draw random numbers.
+	enum class Subsystem : std::uint32_t {
+		GAME, COMBAT, LEVELING, BALANCE, BENCHMARK, BOT
+	};
+	// Gets the stream number of a subsystem's nth stream.
+	constexpr std::uint64_t streamID(const Subsystem& subsystem, const std::uint64_t& index) {
+		return (static_cast<std::uint64_t>(subsystem) << 48) ^ index;
+	}
+	// Turns text (such as a name) into a seed (64-bit FNV-1a).
+	constexpr std::uint64_t seedFromText(const std::string_view& text) {
+		std::uint64_t hash = 14695981039346656037ull;
+		for (const char c : text) {
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+	/* The Stream class draws numbers from one stream. It's *
+	* plain data: copy it to fork the rest of the stream.  *
+	* below() gives unbiased whole numbers (Lemire's       *
+	* method, in place of rand() % n), and the fill        *
+	* functions make many numbers at once, eight blocks at *
+	* a time so the compiler can vectorize the rounds.     *
+	* The fill functions start at the next whole block.    */
+	class Stream {
+	private:
+		// The key (seed) and the stream number (the high counter words)
+		std::uint32_t key0, key1;
+		std::uint64_t stream;
+		// The next block to make
+		std::uint64_t position = 0;
+		// The current block and how much of it was used
+		Block buffer{};
+		unsigned int used = 4;
+		// Makes the block at a position.
+		Block block(const std::uint64_t& at) const {
+			return philox(Block{ static_cast<std::uint32_t>(at), static_cast<std::uint32_t>(at >> 32),
+				static_cast<std::uint32_t>(stream), static_cast<std::uint32_t>(stream >> 32) }, key0, key1);
+		}
+	public:
+		// ctor(s)
+		constexpr Stream(const std::uint64_t& seed = 0, const std::uint64_t& _stream = 0)
+			: key0(static_cast<std::uint32_t>(seed)), key1(static_cast<std::uint32_t>(seed >> 32)), stream(_stream) { }
+		// Gets the next 32 random bits.
+		std::uint32_t next32() {
+			if (used == 4) {
+				buffer = block(position++);
+				used = 0;
+			}
+			return buffer[used++];
+		}
+		// Gets the next 64 random bits.
+		std::uint64_t next() {
+			const std::uint64_t high = next32();
+			return (high << 32) | next32();
+		}
+		// Gets a number from 0 to bound - 1 (bound must not be 0).
+		std::uint32_t below(const std::uint32_t& bound) {
+			std::uint64_t product = static_cast<std::uint64_t>(next32()) * bound;
+			if (static_cast<std::uint32_t>(product) < bound) {
+				// Reject the few values that would favor low numbers
+				const std::uint32_t threshold = (0u - bound) % bound;
+				while (static_cast<std::uint32_t>(product) < threshold)
+					product = static_cast<std::uint64_t>(next32()) * bound;
+			}
+			return static_cast<std::uint32_t>(product >> 32);
+		}
+		// Gets a number from 0 (inclusive) to 1 (exclusive).
+		double uniform() {
+			return (next() >> 11) * 0x1.0p-53;
+		}
+		// Fills an array with random bits.
+		void fill(std::uint32_t* out, std::size_t count) {
+			constexpr std::size_t lanes = 8;
+			// Eight blocks side by side
+			while (count >= 4 * lanes) {
+				std::uint32_t c0[lanes], c1[lanes], c2[lanes], c3[lanes];
+				for (std::size_t l = 0; l < lanes; l++) {
+					c0[l] = static_cast<std::uint32_t>(position + l);
+					c1[l] = static_cast<std::uint32_t>((position + l) >> 32);
+					c2[l] = static_cast<std::uint32_t>(stream);
+					c3[l] = static_cast<std::uint32_t>(stream >> 32);
+				}
+				std::uint32_t k0 = key0, k1 = key1;
+				for (int round = 0; round < 10; round++) {
+					for (std::size_t l = 0; l < lanes; l++) {
+						const std::uint64_t product0 = static_cast<std::uint64_t>(philoxM0) * c0[l];
+						const std::uint64_t product1 = static_cast<std::uint64_t>(philoxM1) * c2[l];
+						const std::uint32_t next0 = static_cast<std::uint32_t>(product1 >> 32) ^ c1[l] ^ k0;
+						const std::uint32_t next2 = static_cast<std::uint32_t>(product0 >> 32) ^ c3[l] ^ k1;
+						c1[l] = static_cast<std::uint32_t>(product1);
+						c3[l] = static_cast<std::uint32_t>(product0);
+						c0[l] = next0;
+						c2[l] = next2;
+					}
+					k0 += philoxW0;
+					k1 += philoxW1;
+				}
+				for (std::size_t l = 0; l < lanes; l++) {
+					out[4 * l] = c0[l];
+					out[4 * l + 1] = c1[l];
+					out[4 * l + 2] = c2[l];
+					out[4 * l + 3] = c3[l];
+				}
+				position += lanes;
+				out += 4 * lanes;
+				count -= 4 * lanes;
+			}
+			// Then one block at a time
+			while (count > 0) {
+				const Block words = block(position++);
+				const std::size_t taken = std::min<std::size_t>(count, 4);
+				std::copy(words.begin(), words.begin() + taken, out);
+				out += taken;
+				count -= taken;
+			}
+		}
+		// Fills an array with numbers from 0 to bound - 1 (bound must not be 0).
+		void fillBelow(std::uint32_t* out, const std::size_t& count, const std::uint32_t& bound) {
+			fill(out, count);
+			const std::uint32_t threshold = (0u - bound) % bound;
+			for (std::size_t i = 0; i < count; i++) {
+				std::uint64_t product = static_cast<std::uint64_t>(out[i]) * bound;
+				while (static_cast<std::uint32_t>(product) < threshold)
+					product = static_cast<std::uint64_t>(next32()) * bound;
+				out[i] = static_cast<std::uint32_t>(product >> 32);
+			}
+		}
+	};
+}
 
-void ClearScreen()
+/* The Combat namespace is the fight engine. It has no   *
+* I/O and no globals: a fight is a State (both fighters *
+* and the random generator), and step() plays one round *
+* of it for a player action, giving back the next State  *
+* and the Events that happened. Front ends (the text UI, *
+* simulations) own the state and read the events.        */
+namespace Combat
 {
-	system("CLS");
+	// Better readability
+	using namespace ItemSystem::Items;
+	// Fights draw from a random stream (see the Randomness namespace).
+	using Random = Randomness::Stream;
+	// The parts of the body a hit can land on.
+	enum class BodyPart : unsigned char {
+		HEAD, CHEST, RIGHTARM, LEFTARM, RIGHTLEG, LEFTLEG
+	};
+	// The number of body parts.
+	constexpr std::size_t bodyPartCount = static_cast<std::size_t>(BodyPart::LEFTLEG) + 1;
+	// The damage multiplier of each body part (hits to the head hurt double).
+	constexpr std::array<double, bodyPartCount> partDamage{ 2.00, 1.00, 1.00, 1.00, 1.00, 1.00 };
+	// How much health a body part loses per hit.
+	constexpr double partWear = 0.1;
+	// The mana a spell costs.
+	constexpr int castCost = 5;
+	// The hit chance (percent) without a weapon.
+	constexpr int unarmedAccuracy = 75;
+	/* The HitTable struct is where a fighter's blows land:   *
+	* a miss (weighted by the weapon's accuracy) or a body   *
+	* part (by its weight), as a Walker alias table so one   *
+	* 32 bit draw picks the outcome. Built from the accuracy *
+	* and weights, and rebuilt only when those change (on    *
+	* equipping, or a profession). Also holds the damage     *
+	* multiplier of each part.                               */
+	struct HitTable {
+		// A miss, then each body part
+		static constexpr std::size_t outcomes = bodyPartCount + 1;
+		int accuracy;
+		std::array<int, bodyPartCount> weights;
+		std::array<double, bodyPartCount> damage;
+		std::array<std::uint32_t, outcomes> threshold{};
+		std::array<std::uint8_t, outcomes> alias{};
+		// ctor(s)
+		constexpr HitTable(const int& _accuracy, const std::array<int, bodyPartCount>& _weights, const std::array<double, bodyPartCount>& _damage)
+			: accuracy(_accuracy), weights(_weights), damage(_damage) {
+			build();
+		}
+		/* Vose's method, in whole numbers: each outcome's share  *
+		* times the outcome count, against a full column of     *
+		* 100 times the total weight. Only the thresholds are   *
+		* rounded.                                              */
+		constexpr void build() {
+			std::uint64_t total = 0;
+			for (const int& weight : weights) {
+				if (weight < 0) throw std::invalid_argument("Body part weights can't be negative");
+				total += static_cast<std::uint64_t>(weight);
+			}
+			if (total == 0) throw std::invalid_argument("A hit table needs a body part to hit");
+			const std::uint64_t hit = static_cast<std::uint64_t>(std::clamp(accuracy, 0, 100));
+			const std::uint64_t full = 100 * total;
+			std::array<std::uint64_t, outcomes> scaled{};
+			scaled[0] = (100 - hit) * total * outcomes;
+			for (std::size_t p = 0; p < bodyPartCount; p++)
+				scaled[p + 1] = hit * static_cast<std::uint64_t>(weights[p]) * outcomes;
+			std::array<std::uint8_t, outcomes> small{}, large{};
+			std::size_t smalls = 0, larges = 0;
+			for (std::size_t i = 0; i < outcomes; i++) {
+				if (scaled[i] < full) small[smalls++] = static_cast<std::uint8_t>(i);
+				else large[larges++] = static_cast<std::uint8_t>(i);
+			}
+			// Top up each short column from a long one
+			while (smalls > 0 && larges > 0) {
+				const std::uint8_t s = small[--smalls];
+				const std::uint8_t l = large[--larges];
+				threshold[s] = static_cast<std::uint32_t>(std::min(static_cast<double>(scaled[s]) / full * 4294967296.0, 4294967295.0));
+				alias[s] = l;
+				scaled[l] -= full - scaled[s];
+				if (scaled[l] < full) small[smalls++] = l;
+				else large[larges++] = l;
+			}
+			// What's left is full
+			while (larges > 0) {
+				const std::uint8_t l = large[--larges];
+				threshold[l] = 0xFFFFFFFFu;
+				alias[l] = l;
+			}
+			while (smalls > 0) {
+				const std::uint8_t s = small[--smalls];
+				threshold[s] = 0xFFFFFFFFu;
+				alias[s] = s;
+			}
+		}
+		// Rebuilds the table for a new weapon accuracy (if it changed).
+		void aim(const int& _accuracy) {
+			if (_accuracy == accuracy) return;
+			accuracy = _accuracy;
+			build();
+		}
+		/* Turns a random number into an outcome: -1 for a miss, *
+		* or the index of the body part hit. The high bits pick *
+		* the column and the low bits are the coin.             */
+		constexpr int pick(const std::uint32_t& number) const {
+			const std::uint64_t product = static_cast<std::uint64_t>(number) * outcomes;
+			const std::size_t column = static_cast<std::size_t>(product >> 32);
+			const std::uint8_t outcome = static_cast<std::uint32_t>(product) < threshold[column] ? static_cast<std::uint8_t>(column) : alias[column];
+			return static_cast<int>(outcome) - 1;
+		}
+		int sample(Random& random) const {
+			return pick(random.next32());
+		}
+		// Draws count outcomes at once (the same ones as count sample() calls).
+		void sample(Random& random, int* out, const std::size_t& count) const {
+			std::uint32_t* numbers = reinterpret_cast<std::uint32_t*>(out);
+			random.fill(numbers, count);
+			for (std::size_t i = 0; i < count; i++)
+				out[i] = pick(numbers[i]);
+		}
+	};
+	// Every body part as likely to be hit, with an unarmed fighter's accuracy.
+	inline constexpr HitTable defaultHits{ unarmedAccuracy, { 1, 1, 1, 1, 1, 1 }, partDamage };
+	/* A Fighter is one side of a fight: stats, the weapon  *
+	* numbers (all 0 without a weapon), where its blows    *
+	* land, and the health of each body part (1.00 is      *
+	* unhurt). Hurt arms weaken attacks and hurt legs slow *
+	* the fighter down.                                    */
+	struct Fighter {
+		int hp, maxHP, mp, maxMP;
+		int str, def, itl, spd, crt, lvl;
+		int damage = 0, weaponCrit = 0, spellDamage = 0;
+		HitTable hits = defaultHits;
+		std::array<double, bodyPartCount> parts{ 1.00, 1.00, 1.00, 1.00, 1.00, 1.00 };
+		// Gets the health of a body part.
+		double part(const BodyPart& bodyPart) const {
+			return parts[static_cast<std::size_t>(bodyPart)];
+		}
+	};
+	// Sets a fighter's weapon numbers (from the weapon, or unarmed for nullptr).
+	inline void arm(Fighter& fighter, const Weapon* weapon) {
+		fighter.damage = weapon != nullptr ? weapon->getDamage() : 0;
+		fighter.weaponCrit = weapon != nullptr ? weapon->getCrit() : 0;
+		fighter.spellDamage = weapon != nullptr ? weapon->getSpellDamage() : 0;
+		fighter.hits.aim(weapon != nullptr ? weapon->getAccuracy() : unarmedAccuracy);
+	}
+	// How a fight stands.
+	enum class Outcome : unsigned char {
+		ONGOING, WON, LOST, FLED
+	};
+	/* The State struct is a whole fight. Copy it freely;   *
+	* it's plain data.                                     */
+	struct State {
+		Fighter player;
+		Fighter enemy;
+		Random random;
+		unsigned int round = 0;
+		Outcome outcome = Outcome::ONGOING;
+	};
+	// What the player does in a round (the item is used for USE only).
+	struct Action {
+		enum class Type : unsigned char {
+			ATTACK, CAST, USE, RUN
+		} type;
+		const Consumable* item = nullptr;
+	};
+	// Which fighter an event is about.
+	enum class Side : unsigned char {
+		PLAYER, ENEMY
+	};
+	/* An Event is something that happened in a round, for  *
+	* the front end to show:                               *
+	* HIT (value damage, part, critical), MISS, CAST       *
+	* (value damage), NO_MANA, USE (value HP, value2 MP    *
+	* restored), ESCAPE, NO_ESCAPE, DEFEAT (the side lost) */
+	struct Event {
+		enum class Type : unsigned char {
+			HIT, MISS, CAST, NO_MANA, USE, ESCAPE, NO_ESCAPE, DEFEAT
+		} type;
+		Side side;
+		BodyPart part = BodyPart::CHEST;
+		bool critical = false;
+		int value = 0;
+		int value2 = 0;
+	};
+	// The events of one round (there are never more than a few).
+	struct Events {
+		std::array<Event, 8> list;
+		unsigned int count = 0;
+		void push(const Event& event) {
+			list[count++] = event;
+		}
+		const Event* begin() const {
+			return list.data();
+		}
+		const Event* end() const {
+			return list.data() + count;
+		}
+	};
+	// The result of a round: the next state and what happened.
+	struct Turn {
+		State state;
+		Events events;
+	};
+	// The average health of two body parts.
+	inline double pair(const Fighter& fighter, const BodyPart& a, const BodyPart& b) {
+		return (fighter.part(a) + fighter.part(b)) / 2;
+	}
+	// A weapon attack.
+	inline void attack(Fighter& attacker, Fighter& defender, const Side& side, Random& random, Events& events) {
+		const int outcome = attacker.hits.sample(random);
+		if (outcome < 0) {
+			events.push(Event{ Event::Type::MISS, side });
+			return;
+		}
+		const BodyPart part = static_cast<BodyPart>(outcome);
+		const bool critical = static_cast<int>(random.below(100)) < attacker.crt + attacker.weaponCrit;
+		double damage = (attacker.damage + attacker.str) * pair(attacker, BodyPart::RIGHTARM, BodyPart::LEFTARM) * attacker.hits.damage[static_cast<std::size_t>(outcome)];
+		if (critical) damage *= 2;
+		const int dealt = std::max(1, static_cast<int>(damage) - defender.def / 2);
+		defender.hp -= dealt;
+		double& partHealth = defender.parts[static_cast<std::size_t>(part)];
+		partHealth = std::max(0.0, partHealth - partWear);
+		events.push(Event{ Event::Type::HIT, side, part, critical, dealt });
+	}
+	// A spell (always hits, costs mana).
+	inline void cast(Fighter& caster, Fighter& target, const Side& side, Events& events) {
+		if (caster.mp < castCost) {
+			events.push(Event{ Event::Type::NO_MANA, side });
+			return;
+		}
+		caster.mp -= castCost;
+		const int dealt = std::max(1, caster.spellDamage + caster.itl * 2 - target.itl / 2);
+		target.hp -= dealt;
+		events.push(Event{ Event::Type::CAST, side, BodyPart::CHEST, false, dealt });
+	}
+	// Uses a consumable (runs its effect script on the fighter).
+	inline void use(Fighter& fighter, const Consumable& item, const Side& side, Events& events) {
+		ItemSystem::Scripting::Stats stats{ fighter.hp, fighter.mp, fighter.maxHP, fighter.maxMP, fighter.str, fighter.def, fighter.itl, fighter.spd, fighter.crt, 0, fighter.lvl, 0 };
+		ItemSystem::Scripting::use(item, stats);
+		events.push(Event{ Event::Type::USE, side, BodyPart::CHEST, false, stats[0] - fighter.hp, stats[1] - fighter.mp });
+		fighter.hp = stats[0]; fighter.mp = stats[1]; fighter.maxHP = stats[2]; fighter.maxMP = stats[3];
+		fighter.str = stats[4]; fighter.def = stats[5]; fighter.itl = stats[6]; fighter.spd = stats[7];
+		fighter.crt = stats[8]; fighter.lvl = stats[10];
+	}
+	// Tries to run away (easier the faster the player is).
+	inline bool escape(const Fighter& player, const Fighter& enemy, Random& random, Events& events) {
+		const double playerSpeed = player.spd * pair(player, BodyPart::RIGHTLEG, BodyPart::LEFTLEG);
+		const double enemySpeed = enemy.spd * pair(enemy, BodyPart::RIGHTLEG, BodyPart::LEFTLEG);
+		const int chance = std::clamp(50 + static_cast<int>((playerSpeed - enemySpeed) * 5), 10, 90);
+		const bool escaped = static_cast<int>(random.below(100)) < chance;
+		events.push(Event{ escaped ? Event::Type::ESCAPE : Event::Type::NO_ESCAPE, Side::PLAYER });
+		return escaped;
+	}
+	// Checks whether a turn ended the fight (only one side takes damage
+	// in a turn, so the order of the checks doesn't matter).
+	inline bool settle(State& state, Events& events) {
+		if (state.enemy.hp <= 0) {
+			state.outcome = Outcome::WON;
+			events.push(Event{ Event::Type::DEFEAT, Side::ENEMY });
+		}
+		else if (state.player.hp <= 0) {
+			state.outcome = Outcome::LOST;
+			events.push(Event{ Event::Type::DEFEAT, Side::PLAYER });
+		}
+		return state.outcome != Outcome::ONGOING;
+	}
+	/* Plays one round: both sides roll for who goes first  *
+	* (speed, slowed by hurt legs, plus 1-5), then act.    *
+	* Enemies cast when they have the mana and are smarter *
+	* than they are strong, and attack otherwise. A round  *
+	* of a finished fight changes nothing.                 */
+	inline Turn step(const State& current, const Action& action) {
+		Turn turn{ current, Events{} };
+		State& state = turn.state;
+		if (state.outcome != Outcome::ONGOING) return turn;
+		state.round++;
+		const double playerSpeed = state.player.spd * pair(state.player, BodyPart::RIGHTLEG, BodyPart::LEFTLEG) + (state.random.below(5) + 1);
+		const double enemySpeed = state.enemy.spd * pair(state.enemy, BodyPart::RIGHTLEG, BodyPart::LEFTLEG) + (state.random.below(5) + 1);
+		const auto playerTurn = [&] {
+			switch (action.type) {
+			case Action::Type::ATTACK:
+				attack(state.player, state.enemy, Side::PLAYER, state.random, turn.events);
+				break;
+			case Action::Type::CAST:
+				cast(state.player, state.enemy, Side::PLAYER, turn.events);
+				break;
+			case Action::Type::USE:
+				if (action.item != nullptr) use(state.player, *action.item, Side::PLAYER, turn.events);
+				break;
+			case Action::Type::RUN:
+				if (escape(state.player, state.enemy, state.random, turn.events))
+					state.outcome = Outcome::FLED;
+				break;
+			}
+			return settle(state, turn.events) || state.outcome == Outcome::FLED;
+		};
+		const auto enemyTurn = [&] {
+			if (state.enemy.mp >= castCost && state.enemy.itl > state.enemy.str)
+				cast(state.enemy, state.player, Side::ENEMY, turn.events);
+			else
+				attack(state.enemy, state.player, Side::ENEMY, state.random, turn.events);
+			return settle(state, turn.events);
+		};
+		if (playerSpeed > enemySpeed) {
+			if (!playerTurn()) enemyTurn();
+		}
+		else if (!enemyTurn()) playerTurn();
+		return turn;
+	}
+	/* Rolls an enemy for a player (stronger with the       *
+	* player's level and the difficulty).                  */
+	inline Fighter generateEnemy(const Fighter& player, const double& difficulty, Random& random) {
+		Fighter enemy{};
+		enemy.lvl = static_cast<int>(random.below(std::max(player.lvl, 1)) * difficulty);
+		enemy.str = std::max(1, static_cast<int>(random.below(std::max(player.str, 1)) + player.lvl * difficulty));
+		enemy.itl = std::max(1, static_cast<int>(random.below(std::max(player.itl, 1)) + player.lvl * difficulty));
+		enemy.def = std::max(1, static_cast<int>(random.below(std::max(player.def, 1)) + player.lvl * difficulty));
+		enemy.spd = std::max(1, static_cast<int>(random.below(std::max(player.spd, 1)) + player.lvl * difficulty));
+		enemy.crt = std::min(100, static_cast<int>(random.below(std::max(player.crt, 1))) + player.lvl);
+		enemy.maxHP = static_cast<int>((enemy.str * 2) + (enemy.def * 3) + enemy.lvl * 2 * difficulty);
+		enemy.maxMP = std::max(1, enemy.str - enemy.def + (enemy.itl + 2) + enemy.lvl);
+		if (enemy.maxHP < 9) enemy.maxHP = 10;
+		if (enemy.lvl < 1) enemy.lvl = 1;
+		enemy.hp = enemy.maxHP;
+		enemy.mp = enemy.maxMP;
+		return enemy;
+	}
+	/* The EnemyBatch struct holds many enemies as columns     *
+	* (one vector per stat) so that generation and damage     *
+	* can run over whole columns at once. The roll columns    *
+	* hold the last volley's dice (part is -1 for a miss) and *
+	* dealt its damage.                                       */
+	struct EnemyBatch {
+		std::vector<int> lvl, str, itl, def, spd, crt, maxHP, maxMP, hp, mp;
+		std::array<std::vector<double>, bodyPartCount> parts;
+		std::vector<int> part, critRoll, dealt;
+		std::size_t size() const {
+			return hp.size();
+		}
+		void resize(const std::size_t& count) {
+			for (std::vector<int>* column : { &lvl, &str, &itl, &def, &spd, &crt, &maxHP, &maxMP, &hp, &mp, &part, &critRoll, &dealt })
+				column->resize(count);
+			for (std::vector<double>& column : parts)
+				column.resize(count);
+		}
+		// Copies one enemy out as a Fighter (to fight it with step()).
+		Fighter get(const std::size_t& i) const {
+			Fighter enemy{};
+			enemy.hp = hp[i]; enemy.maxHP = maxHP[i]; enemy.mp = mp[i]; enemy.maxMP = maxMP[i];
+			enemy.str = str[i]; enemy.def = def[i]; enemy.itl = itl[i]; enemy.spd = spd[i]; enemy.crt = crt[i]; enemy.lvl = lvl[i];
+			for (std::size_t p = 0; p < bodyPartCount; p++)
+				enemy.parts[p] = parts[p][i];
+			return enemy;
+		}
+		// Copies a Fighter back in.
+		void set(const std::size_t& i, const Fighter& enemy) {
+			hp[i] = enemy.hp; maxHP[i] = enemy.maxHP; mp[i] = enemy.mp; maxMP[i] = enemy.maxMP;
+			str[i] = enemy.str; def[i] = enemy.def; itl[i] = enemy.itl; spd[i] = enemy.spd; crt[i] = enemy.crt; lvl[i] = enemy.lvl;
+			for (std::size_t p = 0; p < bodyPartCount; p++)
+				parts[p][i] = enemy.parts[p];
+		}
+	};
+	/* The lane structs are the few vector operations the    *
+	* batch kernels need, once per instruction set. I holds  *
+	* ints and D the same number of doubles, so every        *
+	* formula keeps the scalar engine's double maths and     *
+	* rounds exactly like generateEnemy() and attack().      *
+	* Masks are all ones (true) or zero (false) per lane.    */
+	struct ScalarLanes {
+		using I = int;
+		using D = double;
+		static constexpr std::size_t lanes = 1;
+		static constexpr const char* name = "scalar";
+		static I load(const int* p) { return *p; }
+		static void store(int* p, const I& a) { *p = a; }
+		static I set1(const int& a) { return a; }
+		static I add(const I& a, const I& b) { return a + b; }
+		static I sub(const I& a, const I& b) { return a - b; }
+		static I max(const I& a, const I& b) { return std::max(a, b); }
+		static I min(const I& a, const I& b) { return std::min(a, b); }
+		static I half(const I& a) { return a / 2; }
+		static I less(const I& a, const I& b) { return -static_cast<int>(a < b); }
+		static I both(const I& a, const I& b) { return a & b; }
+		static I select(const I& mask, const I& a, const I& b) { return mask ? a : b; }
+		static D toDouble(const I& a) { return a; }
+		static I truncate(const D& a) { return static_cast<int>(a); }
+		static D dset1(const double& a) { return a; }
+		static D dadd(const D& a, const D& b) { return a + b; }
+		static D dmul(const D& a, const D& b) { return a * b; }
+		static D gather(const double* table, const I& index) { return table[index]; }
+	};
+#if defined(__AVX2__)
+	// Four lanes (ints in SSE registers, doubles in AVX ones).
+	struct VectorLanes {
+		using I = __m128i;
+		using D = __m256d;
+		static constexpr std::size_t lanes = 4;
+		static constexpr const char* name = "AVX2";
+		static I load(const int* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+		static void store(int* p, const I& a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), a); }
+		static I set1(const int& a) { return _mm_set1_epi32(a); }
+		static I add(const I& a, const I& b) { return _mm_add_epi32(a, b); }
+		static I sub(const I& a, const I& b) { return _mm_sub_epi32(a, b); }
+		static I max(const I& a, const I& b) { return _mm_max_epi32(a, b); }
+		static I min(const I& a, const I& b) { return _mm_min_epi32(a, b); }
+		static I half(const I& a) { return _mm_srai_epi32(_mm_add_epi32(a, _mm_srli_epi32(a, 31)), 1); }
+		static I less(const I& a, const I& b) { return _mm_cmplt_epi32(a, b); }
+		static I both(const I& a, const I& b) { return _mm_and_si128(a, b); }
+		static I select(const I& mask, const I& a, const I& b) { return _mm_blendv_epi8(b, a, mask); }
+		static D toDouble(const I& a) { return _mm256_cvtepi32_pd(a); }
+		static I truncate(const D& a) { return _mm256_cvttpd_epi32(a); }
+		static D dset1(const double& a) { return _mm256_set1_pd(a); }
+		static D dadd(const D& a, const D& b) { return _mm256_add_pd(a, b); }
+		static D dmul(const D& a, const D& b) { return _mm256_mul_pd(a, b); }
+		static D gather(const double* table, const I& index) { return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), table, index, _mm256_castsi256_pd(_mm256_set1_epi64x(-1)), 8); }
+	};
+#elif defined(__SSE2__) || defined(_M_X64)
+	// Two lanes (the low half of an SSE register holds the ints).
+	struct VectorLanes {
+		using I = __m128i;
+		using D = __m128d;
+		static constexpr std::size_t lanes = 2;
+		static constexpr const char* name = "SSE2";
+		static I load(const int* p) { return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)); }
+		static void store(int* p, const I& a) { _mm_storel_epi64(reinterpret_cast<__m128i*>(p), a); }
+		static I set1(const int& a) { return _mm_set1_epi32(a); }
+		static I add(const I& a, const I& b) { return _mm_add_epi32(a, b); }
+		static I sub(const I& a, const I& b) { return _mm_sub_epi32(a, b); }
+		static I max(const I& a, const I& b) { return select(_mm_cmpgt_epi32(a, b), a, b); }
+		static I min(const I& a, const I& b) { return select(_mm_cmplt_epi32(a, b), a, b); }
+		static I half(const I& a) { return _mm_srai_epi32(_mm_add_epi32(a, _mm_srli_epi32(a, 31)), 1); }
+		static I less(const I& a, const I& b) { return _mm_cmplt_epi32(a, b); }
+		static I both(const I& a, const I& b) { return _mm_and_si128(a, b); }
+		static I select(const I& mask, const I& a, const I& b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+		static D toDouble(const I& a) { return _mm_cvtepi32_pd(a); }
+		static I truncate(const D& a) { return _mm_cvttpd_epi32(a); }
+		static D dset1(const double& a) { return _mm_set1_pd(a); }
+		static D dadd(const D& a, const D& b) { return _mm_add_pd(a, b); }
+		static D dmul(const D& a, const D& b) { return _mm_mul_pd(a, b); }
+		static D gather(const double* table, const I& index) {
+			return _mm_set_pd(table[_mm_cvtsi128_si32(_mm_srli_si128(index, 4))], table[_mm_cvtsi128_si32(index)]);
+		}
+	};
+#else
+	using VectorLanes = ScalarLanes;
+#endif
+	/* Turns the rolls already in a batch's stat columns into   *
+	* enemies, from index i onwards in steps of L::lanes.       *
+	* Same formulas and clamps as generateEnemy(). Returns      *
+	* where it stopped (the tail that doesn't fill a vector).   */
+	template<class L>
+	std::size_t generateKernel(EnemyBatch& batch, std::size_t i, const Fighter& player, const double& difficulty) {
+		using I = typename L::I;
+		using D = typename L::D;
+		const I one = L::set1(1), two = L::set1(2), nine = L::set1(9), ten = L::set1(10), hundred = L::set1(100);
+		const I playerLevel = L::set1(player.lvl);
+		const D levelBonus = L::dset1(player.lvl * difficulty);
+		const D scale = L::dset1(difficulty);
+		const D twiceScale = L::dset1(2 * difficulty);
+		for (; i + L::lanes <= batch.size(); i += L::lanes) {
+			const I lvl = L::truncate(L::dmul(L::toDouble(L::load(&batch.lvl[i])), scale));
+			const I str = L::max(one, L::truncate(L::dadd(L::toDouble(L::load(&batch.str[i])), levelBonus)));
+			const I itl = L::max(one, L::truncate(L::dadd(L::toDouble(L::load(&batch.itl[i])), levelBonus)));
+			const I def = L::max(one, L::truncate(L::dadd(L::toDouble(L::load(&batch.def[i])), levelBonus)));
+			const I spd = L::max(one, L::truncate(L::dadd(L::toDouble(L::load(&batch.spd[i])), levelBonus)));
+			const I crt = L::min(hundred, L::add(L::load(&batch.crt[i]), playerLevel));
+			const I base = L::add(L::add(str, str), L::add(L::add(def, def), def));
+			I maxHP = L::truncate(L::dadd(L::toDouble(base), L::dmul(L::toDouble(lvl), twiceScale)));
+			maxHP = L::select(L::less(maxHP, nine), ten, maxHP);
+			const I maxMP = L::max(one, L::add(L::add(L::sub(str, def), L::add(itl, two)), lvl));
+			L::store(&batch.lvl[i], L::max(lvl, one));
+			L::store(&batch.str[i], str);
+			L::store(&batch.itl[i], itl);
+			L::store(&batch.def[i], def);
+			L::store(&batch.spd[i], spd);
+			L::store(&batch.crt[i], crt);
+			L::store(&batch.maxHP[i], maxHP);
+			L::store(&batch.maxMP[i], maxMP);
+		}
+		return i;
+	}
+	/* Fills a batch with count enemies for a player, like    *
+	* generateEnemy() but drawing each stat's rolls for the  *
+	* whole batch at once (so not the same enemies as count  *
+	* generateEnemy() calls on the same stream).             */
+	inline void generateEnemies(const Fighter& player, const double& difficulty, Random& random, EnemyBatch& batch, const std::size_t& count) {
+		batch.resize(count);
+		// The rolls go straight into the columns (int and uint32_t may alias)
+		const auto roll = [&](std::vector<int>& column, const int& stat) {
+			random.fillBelow(reinterpret_cast<std::uint32_t*>(column.data()), count, static_cast<std::uint32_t>(std::max(stat, 1)));
+		};
+		roll(batch.lvl, player.lvl);
+		roll(batch.str, player.str);
+		roll(batch.itl, player.itl);
+		roll(batch.def, player.def);
+		roll(batch.spd, player.spd);
+		roll(batch.crt, player.crt);
+		generateKernel<ScalarLanes>(batch, generateKernel<VectorLanes>(batch, 0, player, difficulty), player, difficulty);
+		batch.hp = batch.maxHP;
+		batch.mp = batch.maxMP;
+		for (std::vector<double>& column : batch.parts)
+			std::fill(column.begin(), column.end(), 1.00);
+	}
+	/* Works out the damage of a volley from the rolls in a    *
+	* batch, like attack(): dead enemies and misses take 0.   *
+	* Leaves it in the dealt column and takes it off hp.      */
+	template<class L>
+	std::size_t volleyKernel(EnemyBatch& batch, std::size_t i, const Fighter& attacker) {
+		using I = typename L::I;
+		using D = typename L::D;
+		const I zero = L::set1(0), one = L::set1(1), miss = L::set1(-1);
+		const I critChance = L::set1(attacker.crt + attacker.weaponCrit);
+		const D base = L::dset1((attacker.damage + attacker.str) * pair(attacker, BodyPart::RIGHTARM, BodyPart::LEFTARM));
+		for (; i + L::lanes <= batch.size(); i += L::lanes) {
+			const I hp = L::load(&batch.hp[i]);
+			const I part = L::load(&batch.part[i]);
+			const I hits = L::both(L::less(zero, hp), L::less(miss, part));
+			// 2 for a critical, 1 otherwise
+			const I factor = L::sub(one, L::less(L::load(&batch.critRoll[i]), critChance));
+			const D damage = L::dmul(L::dmul(base, L::gather(attacker.hits.damage.data(), L::max(part, zero))), L::toDouble(factor));
+			const I dealt = L::both(hits, L::max(one, L::sub(L::truncate(damage), L::half(L::load(&batch.def[i])))));
+			L::store(&batch.dealt[i], dealt);
+			L::store(&batch.hp[i], L::sub(hp, dealt));
+		}
+		return i;
+	}
+	// Every living enemy in a batch takes one weapon attack. Returns how many fell.
+	inline std::size_t volley(const Fighter& attacker, EnemyBatch& batch, Random& random) {
+		const std::size_t count = batch.size();
+		attacker.hits.sample(random, batch.part.data(), count);
+		random.fillBelow(reinterpret_cast<std::uint32_t*>(batch.critRoll.data()), count, 100);
+		volleyKernel<ScalarLanes>(batch, volleyKernel<VectorLanes>(batch, 0, attacker), attacker);
+		// Wear on the parts hit (scattered, so one at a time)
+		std::size_t fallen = 0;
+		for (std::size_t i = 0; i < count; i++) {
+			if (batch.dealt[i] == 0) continue;
+			double& partHealth = batch.parts[static_cast<std::size_t>(batch.part[i])][i];
+			partHealth = std::max(0.0, partHealth - partWear);
+			fallen += batch.hp[i] <= 0;
+		}
+		return fallen;
+	}
+	// The dust and experience for beating an enemy.
+	struct Rewards {
+		int dust;
+		int exp;
+	};
+	inline Rewards reward(const Fighter& enemy, const double& difficulty, Random& random) {
+		return Rewards{
+			static_cast<int>(random.below(15)) + enemy.lvl,
+			static_cast<int>(((enemy.maxHP + enemy.str + enemy.def + enemy.itl + enemy.spd) * enemy.lvl) / difficulty)
+		};
+	}
 }
 
-void wait_enter(void) //Method of wait_enter, call it to create a Press Enter to continue screen.
+/* The Leveling namespace works out level ups in one go:   *
+* how many levels some experience is worth (solved, not   *
+* looped), where their points go (asked, scripted or      *
+* automatic), and what the points roll (each is worth 1   *
+* or 2, so a batch is a count plus the bits set in a few  *
+* random words). No input or output happens here.         */
+namespace Leveling
 {
-	cin.ignore();
-	cout << "Press ENTER to continue...";
-	cin.ignore();
+	// The stats a level can raise (in the order victory() lists them).
+	enum class Stat : unsigned char {
+		STR, ITL, SPD, DEF
+	};
+	constexpr std::size_t statCount = static_cast<std::size_t>(Stat::DEF) + 1;
+	// Points (or gains) per stat, in Stat order.
+	using Allocation = std::array<int, statCount>;
+	// The experience needed to go past a level.
+	inline double threshold(const int& lvl, const double& difficulty, const double& expmultiplier) {
+		return (int)((lvl * 50 * difficulty)) * expmultiplier;
+	}
+	// The experience multiplier grows by a quarter each level.
+	constexpr double multiplierAfter(const double& expmultiplier, const int& levels) {
+		return expmultiplier + .25 * levels;
+	}
+	/* How many levels a total of exp gets a character at lvl. *
+	* Leveling from lvl with multiplier m needs exp past      *
+	* 50d(lvl + k)(m + k/4) after k levels, a quadratic in k, *
+	* so the root is a first guess and threshold() (which     *
+	* rounds) settles the last step either way.               */
+	inline int levelsFor(const int& exp, const int& lvl, const double& difficulty, const double& expmultiplier) {
+		if (!(exp > threshold(lvl, difficulty, expmultiplier))) return 0;
+		const double b = 4 * expmultiplier + lvl;
+		const double c = 4 * (lvl * expmultiplier - exp / (50 * difficulty));
+		int levels = std::max(1, static_cast<int>(std::ceil((std::sqrt(b * b - 4 * c) - b) / 2)));
+		while (levels > 1 && !(exp > threshold(lvl + levels - 1, difficulty, multiplierAfter(expmultiplier, levels - 1))))
+			levels--;
+		while (exp > threshold(lvl + levels, difficulty, multiplierAfter(expmultiplier, levels)))
+			levels++;
+		return levels;
+	}
+	// Counts the bits set in a number.
+	constexpr int popcount(std::uint32_t bits) {
+		bits = bits - ((bits >> 1) & 0x55555555u);
+		bits = (bits & 0x33333333u) + ((bits >> 2) & 0x33333333u);
+		return static_cast<int>((((bits + (bits >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24);
+	}
+	// Rolls points worth 1 or 2 each (one random bit per point).
+	inline int roll(int points, Randomness::Stream& random) {
+		int total = points;
+		for (; points >= 32; points -= 32)
+			total += popcount(random.next32());
+		if (points > 0)
+			total += popcount(random.next32() >> (32 - points));
+		return total;
+	}
+	inline Allocation roll(const Allocation& points, Randomness::Stream& random) {
+		Allocation gains{};
+		for (std::size_t i = 0; i < statCount; i++)
+			gains[i] = roll(points[i], random);
+		return gains;
+	}
+	/* The Policy struct decides where a level up's points    *
+	* go: ASK leaves them to the front end (a scene asks),   *
+	* SCRIPT takes one stat per level from a list (keeping   *
+	* to the last one when it runs out), and AUTO puts every *
+	* point into one stat.                                   */
+	struct Policy {
+		enum class Kind : unsigned char {
+			ASK, SCRIPT, AUTO
+		};
+		Kind kind = Kind::AUTO;
+		Stat stat = Stat::STR;
+		std::vector<Stat> script;
+		std::size_t next = 0;
+		static Policy asking() {
+			Policy policy;
+			policy.kind = Kind::ASK;
+			return policy;
+		}
+		static Policy scripted(const std::vector<Stat>& _script) {
+			if (_script.empty()) throw std::invalid_argument("A level up script needs at least one stat");
+			Policy policy;
+			policy.kind = Kind::SCRIPT;
+			policy.script = _script;
+			return policy;
+		}
+		static Policy automatic(const Stat& _stat) {
+			Policy policy;
+			policy.stat = _stat;
+			return policy;
+		}
+		// Decides where the points of some levels go.
+		Allocation allocate(const int& levels) {
+			Allocation points{};
+			switch (kind) {
+			case Kind::ASK:
+				throw std::logic_error("Asked level ups are placed by the front end");
+			case Kind::SCRIPT:
+				for (int i = 0; i < levels; i++) {
+					points[static_cast<std::size_t>(script[next])]++;
+					if (next + 1 < script.size()) next++;
+				}
+				return points;
+			case Kind::AUTO:
+				points[static_cast<std::size_t>(stat)] = levels;
+				return points;
+			}
+			return points;
+		}
+	};
 }
 
-void weaponinv() {
-	ClearScreen();
-	cout << "-*- Inventory -*-\nCurrent Weapon: " << Charac.equipped->getName() << "\nDescription: " << Charac.equipped->getDesc() << endl;
-	cout << "\n-*- Weapon Stats -*-\nDamage: " << Charac.equipped->getDamage() << "\nCrit Bonus: " << Charac.equipped->getCrit() << "\nSpell Damage: " << Charac.equipped->getSpellDamage() << "\nAccuracy: " << Charac.equipped->getAccuracy() << "\nWeapon Cost: " << Charac.equipped->getBuyPrice() << "\n" << endl;
-	int index = 1;
-	cout << "0) Exit" << endl;
-	std::vector<Weapon*> weapons;
-	for (const auto& item : Charac.inventory.getAll()) {
-		if (item.getItem()->getCategory() == Category::WEAPON) {
-			auto toCast = item.getItem().get();
-			auto weapon = const_cast<Weapon*>(dynamic_cast<const Weapon*>(toCast));
-			weapons.push_back(weapon);
-		}
-	}
-	for (const auto& wep : weapons)
-	{
-		cout << index << ") " << wep->getName() << std::endl;
-		index++;
+/* The Terminal namespace is the game's output. cout       *
+* writes into a Screen, which sends a whole frame in one   *
+* write just before cin reads (endl's flushes are          *
+* skipped). On a terminal the frame is a page of lines,    *
+* diffed against what's on screen so only the changed     *
+* cells go out, as ANSI escapes. The terminal echoes the   *
+* lines the player types, so those are copied onto both    *
+* sides as they're read. Anywhere else (a pipe or a file)  *
+* the bytes pass through unchanged, a frame at a time.     */
+namespace Terminal
+{
+#if defined(_WIN32) && !defined(ENABLE_VIRTUAL_TERMINAL_PROCESSING)
+#define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004
+#endif
+	// What the output has cost, for the screen so far and the whole run.
+	struct Counters {
+		std::size_t writes = 0;
+		std::size_t bytes = 0;
+		// Flushes asked for (by endl) and skipped
+		std::size_t flushes = 0;
+	};
+	inline Counters counters, totals;
+	// Prints the counters at each new screen (--count-writes).
+	inline bool reporting = false;
+	// Writes bytes to stdout in one call (more only if the OS takes part of them).
+	inline void writeOut(const std::string& bytes) {
+#if defined(_WIN32)
+		DWORD written = 0;
+		WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), bytes.data(), static_cast<DWORD>(bytes.size()), &written, nullptr);
+		counters.writes++;
+#else
+		std::size_t done = 0;
+		while (done < bytes.size()) {
+			const ssize_t written = ::write(STDOUT_FILENO, bytes.data() + done, bytes.size() - done);
+			counters.writes++;
+			if (written < 0 && errno == EINTR) continue;
+			if (written < 0) return;
+			done += static_cast<std::size_t>(written);
+		}
+#endif
+		counters.bytes += bytes.size();
+	}
+	// Adds up a screen's counters (printing them to stderr, if reporting).
+	inline void tally(const char* what) {
+		if (reporting)
+			std::fprintf(stderr, "%s: %zu writes, %zu bytes, %zu flushes skipped\n", what, counters.writes, counters.bytes, counters.flushes);
+		totals.writes += counters.writes;
+		totals.bytes += counters.bytes;
+		totals.flushes += counters.flushes;
+		counters = Counters{};
+	}
+	// Is stdout a terminal that takes ANSI escapes? (Turns them on, on Windows.)
+	inline bool outputIsTerminal() {
+#if defined(_WIN32)
+		const HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+		DWORD mode = 0;
+		return GetConsoleMode(out, &mode) && SetConsoleMode(out, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+#else
+		return isatty(STDOUT_FILENO) != 0;
+#endif
+	}
+	// Is stdin a terminal (which echoes what's typed)?
+	inline bool inputIsTerminal() {
+#if defined(_WIN32)
+		DWORD mode = 0;
+		return GetConsoleMode(GetStdHandle(STD_INPUT_HANDLE), &mode) != 0;
+#else
+		return isatty(STDIN_FILENO) != 0;
+#endif
+	}
+	// The terminal's size in cells (80 by 24 if it can't be asked).
+	struct Size {
+		std::size_t width = 80;
+		std::size_t height = 24;
+		bool operator==(const Size& other) const {
+			return width == other.width && height == other.height;
+		}
+	};
+	inline Size size() {
+#if defined(_WIN32)
+		CONSOLE_SCREEN_BUFFER_INFO info;
+		if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info))
+			return Size{ static_cast<std::size_t>(info.srWindow.Right - info.srWindow.Left + 1), static_cast<std::size_t>(info.srWindow.Bottom - info.srWindow.Top + 1) };
+#else
+		winsize window{};
+		if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &window) == 0 && window.ws_col > 0 && window.ws_row > 0)
+			return Size{ window.ws_col, window.ws_row };
+#endif
+		return Size{};
+	}
+	/* The Screen class is cout's buffer. On a terminal the   *
+	* page is everything written since the last clear(), the *
+	* front is what the terminal shows (its bottom rows when *
+	* the page is taller). The cursor is always at the end   *
+	* of the page, as it would be on a plain terminal.       *
+	* Otherwise the frame's bytes just wait in out.          */
+	class Screen : public std::streambuf {
+	private:
+		// Passing through holds at most this much before writing
+		static constexpr std::size_t passLimit = 1 << 16;
+		const bool terminal;
+		Size dimensions;
+		std::vector<std::string> page{ std::string() };
+		std::size_t column = 0;
+		std::vector<std::string> front;
+		// Whether the front is known (false until the first draw, or after a resize)
+		bool drawn = false;
+		std::size_t cursorRow = 0, cursorColumn = 0;
+		// The frame's bytes (escapes, on a terminal), kept between frames
+		std::string out;
+		// The first page row on screen.
+		std::size_t top() const {
+			return page.size() > dimensions.height ? page.size() - dimensions.height : 0;
+		}
+		// Moves the terminal's cursor (rows and columns from 0).
+		void move(const std::size_t& row, const std::size_t& col) {
+			out += "\x1b[";
+			out += std::to_string(row + 1);
+			out += ';';
+			out += std::to_string(col + 1);
+			out += 'H';
+		}
+		// Starts a new line. Echoed at the bottom, the terminal scrolls.
+		void newline(const bool& echoed) {
+			page.emplace_back();
+			column = 0;
+			if (echoed && drawn && page.size() > dimensions.height) {
+				front.erase(front.begin());
+				front.emplace_back();
+			}
+		}
+		// Writes a character at the cursor (onto the front too, if the terminal echoed it).
+		void put(const char& c, const bool& echoed) {
+			switch (c) {
+			case '\n':
+				newline(echoed);
+				return;
+			case '\r':
+				column = 0;
+				return;
+			case '\t':
+				do put(' ', echoed); while (column % 8 != 0 && column < dimensions.width);
+				return;
+			}
+			if (static_cast<unsigned char>(c) < ' ') return;
+			if (column >= dimensions.width) newline(echoed);
+			std::string& line = page.back();
+			if (line.size() <= column) line.resize(column + 1, ' ');
+			line[column] = c;
+			if (echoed && drawn) {
+				std::string& row = front[page.size() - 1 - top()];
+				if (row.size() <= column) row.resize(column + 1, ' ');
+				row[column] = c;
+			}
+			column++;
+		}
+	protected:
+		int_type overflow(int_type c) override {
+			if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+			if (!terminal) {
+				out.push_back(traits_type::to_char_type(c));
+				if (out.size() >= passLimit) present();
+			}
+			else put(traits_type::to_char_type(c), false);
+			return c;
+		}
+		std::streamsize xsputn(const char* text, std::streamsize count) override {
+			if (!terminal) {
+				out.append(text, static_cast<std::size_t>(count));
+				if (out.size() >= passLimit) present();
+			}
+			else for (std::streamsize i = 0; i < count; i++) put(text[i], false);
+			return count;
+		}
+		// A flush (endl) waits for the end of the frame.
+		int sync() override {
+			counters.flushes++;
+			return 0;
+		}
+	public:
+		// ctor(s)
+		explicit Screen(const bool& _terminal) : terminal(_terminal), dimensions(_terminal ? size() : Size{}) {}
+		// Starts a new page (drawn over the old one at the next frame).
+		void clear() {
+			if (!terminal) return;
+			page.assign(1, std::string());
+			column = 0;
+			const Size now = size();
+			if (!(now == dimensions)) {
+				dimensions = now;
+				drawn = false;
+			}
+		}
+		// Copies a line the terminal echoed onto the page and the front.
+		void echo(const std::string& line) {
+			for (const char& c : line) put(c, true);
+			cursorRow = page.size() - 1 - top();
+			cursorColumn = std::min(column, dimensions.width - 1);
+		}
+		// Ends a frame: sends the bytes, or the cells that changed since the last one.
+		void present() {
+			if (!terminal) {
+				if (!out.empty()) writeOut(out);
+				out.clear();
+				return;
+			}
+			out.clear();
+			if (!drawn) {
+				out += "\x1b[H\x1b[2J";
+				front.assign(dimensions.height, std::string());
+				drawn = true;
+			}
+			const std::size_t first = top();
+			const std::string blank;
+			for (std::size_t row = 0; row < dimensions.height; row++) {
+				const std::string& want = first + row < page.size() ? page[first + row] : blank;
+				std::string& have = front[row];
+				if (want == have) continue;
+				std::size_t from = 0;
+				while (from < want.size() && from < have.size() && want[from] == have[from]) from++;
+				std::size_t to = want.size();
+				if (want.size() == have.size())
+					while (to > from && want[to - 1] == have[to - 1]) to--;
+				move(row, from);
+				out.append(want, from, to - from);
+				if (have.size() > want.size()) out += "\x1b[K";
+				have = want;
+			}
+			const std::size_t row = page.size() - 1 - first;
+			const std::size_t col = std::min(column, dimensions.width - 1);
+			if (out.empty() && row == cursorRow && col == cursorColumn) return;
+			move(row, col);
+			cursorRow = row;
+			cursorColumn = col;
+			writeOut(out);
+		}
+	};
+	/* The Echo class is cin's buffer on a terminal: it reads *
+	* a line at a time from the real one and shows the line  *
+	* to the Screen, since the terminal already printed it.  */
+	class Echo : public std::streambuf {
+	private:
+		std::streambuf* source;
+		Screen& screen;
+		std::string line;
+	protected:
+		int_type underflow() override {
+			line.clear();
+			for (int_type c = source->sbumpc(); !traits_type::eq_int_type(c, traits_type::eof()); c = source->sbumpc()) {
+				line.push_back(traits_type::to_char_type(c));
+				if (line.back() == '\n') break;
+			}
+			if (line.empty()) return traits_type::eof();
+			screen.echo(line);
+			setg(&line[0], &line[0], &line[0] + line.size());
+			return traits_type::to_int_type(line[0]);
+		}
+	public:
+		// ctor(s)
+		Echo(std::streambuf* _source, Screen& _screen) : source(_source), screen(_screen) {}
+	};
+	/* The Presenter class ends a frame when it's flushed.    *
+	* cin is tied to a stream on one, so a frame goes out    *
+	* just before each read.                                 */
+	class Presenter : public std::streambuf {
+	private:
+		Screen& screen;
+	protected:
+		int sync() override {
+			screen.present();
+			return 0;
+		}
+	public:
+		// ctor(s)
+		explicit Presenter(Screen& _screen) : screen(_screen) {}
+	};
+	// The installed screen (nullptr before install()).
+	inline Screen* screen = nullptr;
+	/* Puts cout on a Screen and ties cin to its frames. The *
+	* old buffers come back (after a last frame) when the   *
+	* program exits.                                        */
+	inline void install() {
+		if (screen != nullptr) return;
+		const bool terminal = outputIsTerminal();
+		static Screen instance(terminal);
+		static Echo echo(cin.rdbuf(), instance);
+		static Presenter presenter(instance);
+		static std::ostream frames(&presenter);
+		static struct Installation {
+			std::streambuf* out;
+			std::streambuf* in;
+			~Installation() {
+				cout.flush();
+				screen->present();
+				tally("last screen");
+				if (reporting)
+					std::fprintf(stderr, "in all: %zu writes, %zu bytes, %zu flushes skipped\n", totals.writes, totals.bytes, totals.flushes);
+				cout.rdbuf(out);
+				cin.rdbuf(in);
+				cin.tie(&cout);
+				screen = nullptr;
+			}
+		} installation{ cout.rdbuf(&instance), terminal && inputIsTerminal() ? cin.rdbuf(&echo) : cin.rdbuf() };
+		cin.tie(&frames);
+		screen = &instance;
+	}
+	// Starts a new screen (a new page, on a terminal).
+	inline void clear() {
+		if (screen == nullptr) return;
+		tally("screen");
+		screen->clear();
+	}
+}
+
+////////////////WEAPONSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSSS STructs.
+/*
+struct Weapon {
+string wep_name;
+string wep_desc;
+int getDamage();
+int getCrit();
+int wep_type;
+int wep_spelldam;
+int getBuyPrice();
+int getAccuracy();
+};
+
+struct Consumable {
+string con_name;
+int con_healgain;
+int con_managain;
+int con_type;
+int con_cost;
+};
+*/
+
+struct Accuracy {
+
+	///Bodypart Hit Weight (how likely a hit lands there)
+	int head = 1;
+	int chest = 1;
+	int rightarm = 1;
+	int leftarm = 1;
+	int rightleg = 1;
+	int leftleg = 1;
+	///Bodypart Damage Multiplier
+	double headdamagex = 2.00;
+	double chestdamagex = 1.00;
+	double rightarmdamagex = 1.00;
+	double leftarmdamagex = 1.00;
+	double rightlegdamagex = 1.00;
+	double leftlegdamagex = 1.00;
+};
+
+
+/*
+const vector<Consumable> consumableTable{
+What does this mean... though?
+Name
+Health Gain
+Mana Gain
+Type (1 = Health Potion, 2 = Mana Potion)
+Cost
+///Health Potions
+{ "Normal Health Potion", 25, 0, 1, 5 },
+{ "Greater Health Potion", 100, 0, 1, 15, },
+{ "Super Health Potion", 500, 0, 1, 50 },
+{ "Full Health Potion", 9999, 0, 1, 150 },
+///Mana Potions
+{ "Normal Mana Potion", 0, 5, 2, 5 },
+{ "Greater Mana Potion", 0, 25, 2, 10 },
+{ "Super Mana Potion", 0, 100, 2, 35 },
+{ "Full Mana Potion", 0, 9999, 2, 100 }
+
+};
+
+*/
+
+
+
+
+struct Character
+{
+	///Everything not related to the things below
+	string name = "None";
+	string race = "None";
+	string clas = "None";
+	string difficultyN = "Normal";
+	string profession = "None";
+	string dad;
+	double difficultyD = 1;
+	double expmultiplier = 1;
+	int dust = 15;
+	///Stats
+	int lvl = 1;
+	int exp = 0;
+	int maxHP;
+	int maxMP;
+	int hp;
+	int mp;
+	int str = 1;
+	int def = 1;
+	int crt = 1;
+	int spd = 1;
+	int itl = 1;
+	///Bodypart Health
+	double headhp = 1.00;
+	double chesthp = 1.00;
+	double rightarmhp = 1.00;
+	double leftarmhp = 1.00;
+	double rightleghp = 1.00;
+	double leftleghp = 1.00;
+	///Skill Professions start here
+	double strprof = 1.00;
+	double defprof = 1.00;
+	double spdprof = 1.00;
+	double itlprof = 1.00;
+	///Weapon Professions start here
+	double bowprof = 1.00;
+	double swordprof = 1.00;
+	double staffprof = 1.00;
+	double unarmedprof = 1.00;
+	///Randomness (the seed comes from the father's name)
+	std::uint64_t seed = 0;
+	unsigned int fights = 0;
+	///Where level up points go
+	Leveling::Policy leveling = Leveling::Policy::asking();
+	bool blackmarketfirst = false;
+	bool workshopfirst = false;
+	///Body Mods/workshop
+	string modsot[4] = { "Dust Grip - (Sword Prof +.25) - 50 Dust", "Dust String - (Bow Prof +.25) - 50 Dust", "Casting Serum - (Staff Prof +.25) - 50 Dust", "Knuckle Dust - (Unarmed Prof +.25) - 50 Dust" };
+	int modsmt[4] = { 15, 15, 15, 15 };
+	// Inventory
+	Inventory inventory;
+	// The inventory slot of the equipped weapon
+	Inventory::Handle equipped;
+	// Where the character's blows land (see Combat::HitTable)
+	Combat::HitTable hits = Combat::defaultHits;
+	// Gets the equipped weapon (nullptr if there is none).
+	const Weapon* getWeapon() {
+		return inventory.inspectItem<Weapon>(equipped);
+	}
+	// Equips the weapon in a slot (and re-aims for its accuracy).
+	void equip(const Inventory::Handle& handle) {
+		equipped = handle;
+		const Weapon* weapon = getWeapon();
+		hits.aim(weapon != nullptr ? weapon->getAccuracy() : Combat::unarmedAccuracy);
+	}
+	// Rebuilds where blows land from the part weights and multipliers.
+	void aim(const Accuracy& accuracy) {
+		const Weapon* weapon = getWeapon();
+		hits = Combat::HitTable(weapon != nullptr ? weapon->getAccuracy() : Combat::unarmedAccuracy,
+			{ accuracy.head, accuracy.chest, accuracy.rightarm, accuracy.leftarm, accuracy.rightleg, accuracy.leftleg },
+			{ accuracy.headdamagex, accuracy.chestdamagex, accuracy.rightarmdamagex, accuracy.leftarmdamagex, accuracy.rightlegdamagex, accuracy.leftlegdamagex });
+	}
+	// The stats item scripts work on (in Stat order).
+	Stats getStats() const {
+		return Stats{ hp, mp, maxHP, maxMP, str, def, itl, spd, crt, dust, lvl, exp };
+	}
+	void setStats(const Stats& stats) {
+		hp = stats[0]; mp = stats[1]; maxHP = stats[2]; maxMP = stats[3];
+		str = stats[4]; def = stats[5]; itl = stats[6]; spd = stats[7];
+		crt = stats[8]; dust = stats[9]; lvl = stats[10]; exp = stats[11];
+	}
+};
+
+
+void ClearScreen()
+{
+	Terminal::clear();
+}
+
+void statcheck(Character& character) {
+	if (character.maxHP > character.hp) {
+		character.hp = character.maxHP;
+	}
+	if (character.maxMP > character.mp) {
+		character.mp = character.maxMP;
+	}
+}
+
+
+// A character as a fighter.
+Combat::Fighter toFighter(Character& character) {
+	Combat::Fighter player{};
+	player.hp = character.hp; player.maxHP = character.maxHP; player.mp = character.mp; player.maxMP = character.maxMP;
+	player.str = character.str; player.def = character.def; player.itl = character.itl; player.spd = character.spd;
+	player.crt = character.crt; player.lvl = character.lvl;
+	player.hits = character.hits;
+	Combat::arm(player, character.getWeapon());
+	player.parts = { character.headhp, character.chesthp, character.rightarmhp, character.leftarmhp, character.rightleghp, character.leftleghp };
+	return player;
+}
+
+// Puts the player's state after a fight back on the character.
+void keepFighter(Character& character, const Combat::Fighter& player) {
+	character.hp = player.hp; character.maxHP = player.maxHP; character.mp = player.mp; character.maxMP = player.maxMP;
+	character.str = player.str; character.def = player.def; character.itl = player.itl; character.spd = player.spd;
+	character.crt = player.crt; character.lvl = player.lvl;
+	character.headhp = player.parts[0]; character.chesthp = player.parts[1];
+	character.rightarmhp = player.parts[2]; character.leftarmhp = player.parts[3];
+	character.rightleghp = player.parts[4]; character.leftleghp = player.parts[5];
+}
+
+// Prints what happened in a round.
+void showEvents(std::ostream& out, const Combat::Events& events) {
+	const string partNames[Combat::bodyPartCount] = { "head", "chest", "right arm", "left arm", "right leg", "left leg" };
+	for (const Combat::Event& event : events) {
+		const bool player = event.side == Combat::Side::PLAYER;
+		const string& part = partNames[static_cast<std::size_t>(event.part)];
+		switch (event.type) {
+		case Combat::Event::Type::HIT:
+			if (event.critical) out << "Critical hit! ";
+			if (player) out << "You hit the enemy's " << part << " for " << event.value << " damage!" << endl;
+			else out << "The enemy hits your " << part << " for " << event.value << " damage!" << endl;
+			break;
+		case Combat::Event::Type::MISS:
+			out << (player ? "You miss!" : "The enemy misses!") << endl;
+			break;
+		case Combat::Event::Type::CAST:
+			if (player) out << "You cast a spell for " << event.value << " damage!" << endl;
+			else out << "The enemy casts a spell at you for " << event.value << " damage!" << endl;
+			break;
+		case Combat::Event::Type::NO_MANA:
+			out << (player ? "You don't have enough mana!" : "The enemy's spell fizzles out.") << endl;
+			break;
+		case Combat::Event::Type::USE:
+			out << "You restore " << event.value << " HP and " << event.value2 << " MP!" << endl;
+			break;
+		case Combat::Event::Type::ESCAPE:
+			out << "You run away!" << endl;
+			break;
+		case Combat::Event::Type::NO_ESCAPE:
+			out << "You couldn't get away!" << endl;
+			break;
+		case Combat::Event::Type::DEFEAT:
+			break;
+		}
+	}
+}
+
+/* The starting choices. Character creation and the      *
+* balance harness both build characters from these, so *
+* the numbers only live here.                          */
+// The races (name, then the bonus to str, def, itl, spd and crt).
+struct RaceBonus {
+	const char* name;
+	int str, def, itl, spd, crt;
+};
+const RaceBonus races[6] = {
+	{ "Human Skeleton", 3, 2, 0, 0, 0 },
+	{ "Kobold Skeleton", 0, 0, 0, 2, 3 },
+	{ "Bone Dragonborn", 5, 0, 0, 0, 0 },
+	{ "Skeleton Scholar", 0, 0, 4, 1, 0 },
+	{ "Coag Skeleton", 0, 5, 0, 0, 0 },
+	{ "Dust Skeleton", 1, 1, 1, 1, 1 }
+};
+const char* const classNames[4] = { "Skeleton Warrior", "Skeleton Mage", "Skeleton Warlock", "Bone Baron" };
+// Where the character came from sets the difficulty.
+struct Origin {
+	const char* difficultyName;
+	double difficulty;
+};
+const Origin origins[6] = {
+	{ "Easiest", .5 }, { "Easy", .75 }, { "Normal", 1 }, { "Hard", 1.5 }, { "Doom", 2.25 }, { "Brutal", 3 }
+};
+const char* const professionNames[5] = { "Fighter", "Summoner", "Hunter", "Scout", "Soldier" };
+
+// Applies a race (1-6) to fresh stats.
+void applyRace(Character& character, const int& race) {
+	const RaceBonus& bonus = races[race - 1];
+	character.race = bonus.name;
+	character.str += bonus.str;
+	character.def += bonus.def;
+	character.itl += bonus.itl;
+	character.spd += bonus.spd;
+	character.crt += bonus.crt;
+}
+
+// Applies an origin (1-6).
+void applyOrigin(Character& character, const int& origin) {
+	character.difficultyN = origins[origin - 1].difficultyName;
+	character.difficultyD = origins[origin - 1].difficulty;
+}
+
+// Applies a past profession (1-5).
+void applyProfession(Character& character, Accuracy& accuracy, const int& profession) {
+	switch (profession) {
+	case 1:
+		character.strprof = character.strprof + .1;
+		break;
+	case 2:
+		character.itlprof = character.itlprof + .1;
+		break;
+	case 3:
+		character.crt = character.crt + 2;
+		accuracy.headdamagex = accuracy.headdamagex + .25;
+		accuracy.chestdamagex = accuracy.chestdamagex + .15;
+		accuracy.rightarmdamagex = accuracy.rightarmdamagex + .1;
+		accuracy.leftarmdamagex = accuracy.leftarmdamagex + .1;
+		accuracy.rightlegdamagex = accuracy.rightlegdamagex + .1;
+		accuracy.leftlegdamagex = accuracy.leftlegdamagex + .1;
+		break;
+	case 4:
+		character.spdprof = character.spdprof + .1;
+		break;
+	case 5:
+		character.defprof = character.defprof + .1;
+		break;
+	}
+	character.profession = professionNames[profession - 1];
+	character.aim(accuracy);
+}
+
+// Applies who necromanced the character (1-3).
+void applyNecromancer(Character& character, const int& who) {
+	switch (who) {
+	case 1:
+		character.str = character.str + 1;
+		character.itl = character.itl + 1;
+		break;
+	case 2:
+		character.def = character.def + 3;
+		break;
+	case 3:
+		character.crt = character.crt + 1;
+		character.spdprof = character.spdprof + .05;
+	}
+}
+
+// Applies the weapon the character was skilled with (1-4).
+void applyWeaponSkill(Character& character, const int& weapon) {
+	switch (weapon) {
+	case 1:
+		character.bowprof = character.bowprof + .1;
+		break;
+	case 2:
+		character.swordprof = character.swordprof + .1;
+		break;
+	case 3:
+		character.staffprof = character.staffprof + .1;
+		break;
+	case 4:
+		character.unarmedprof = character.unarmedprof + .1;
+		break;
+	}
+}
+
+// Works out the starting health and mana from the stats.
+void rollStartingStats(Character& character) {
+	character.maxHP = character.str * character.def * character.lvl + character.difficultyD;
+	character.maxMP = character.itl * character.def * character.lvl + character.difficultyD;
+	character.hp = character.maxHP;
+	character.mp = character.maxMP;
+	if (character.maxHP < 10) {
+		character.maxHP = 10;
+		character.hp = 10;
+	}
+	if (character.maxMP < 5) {
+		character.maxMP = 5;
+		character.mp = 5;
+	}
+}
+
+/* The Saves namespace saves the character to a small     *
+* binary file and loads it back. The file is a header     *
+* and then records: a tag, a length and the fields, all   *
+* little-endian. Readers skip records they don't know and *
+* fields past the ones they know, and fields missing from *
+* an older file keep their defaults, so new fields go on  *
+* the end of a record (or in a new record) without a new  *
+* version. Bump compatibleVersion only for changes older  *
+* readers can't skip. Loading maps the file and reads the *
+* fields straight out of it.                              *
+* Between saves, a Journal appends what changed (as the   *
+* same records) to a journal file next to the save, and   *
+* now and then folds it into a new save. Saves are        *
+* written from snapshots, on the journal's thread.        */
+namespace Saves
+{
+	// The save the game writes and loads.
+	constexpr const char* defaultPath = "bones.sav";
+	// File identification
+	constexpr char fileMagic[4] = { 'B', 'N', 'S', 'V' };
+	// The version written, and the oldest reader that can read it.
+	// (Version 2 packs the inventory into a SLOTS record, and still writes the
+	// INVENTORY record version 1 reads.)
+	constexpr std::uint32_t fileVersion = 2;
+	constexpr std::uint32_t compatibleVersion = 1;
+	constexpr std::uint32_t headerSize = 16;
+	constexpr std::uint32_t recordHeaderSize = 8;
+	// What a record holds. SLOT and EQUIPPED are written by journals,
+	// INVENTORY for version 1 readers (newer ones read SLOTS).
+	enum class Tag : std::uint16_t {
+		IDENTITY = 1, STATS, PROFICIENCIES, WORKSHOP, LEVELING, ACCURACY, INVENTORY, JOURNAL, SLOTS,
+		SLOT = 64, EQUIPPED
+	};
+	// The records that hold the character's fields (everything but the inventory).
+	constexpr Tag fieldTags[] = { Tag::IDENTITY, Tag::STATS, Tag::PROFICIENCIES, Tag::WORKSHOP, Tag::LEVELING, Tag::ACCURACY };
+	// Stands for "no slot" in the inventory record, and "no item" in the equipped record.
+	constexpr std::uint32_t noSlot = 0xFFFFFFFFu;
+	constexpr std::uint16_t noItem = 0xFFFFu;
+	/* The Writer class builds a save (or a journal entry)   *
+	* in memory. Records are padded to 4 bytes.             */
+	class Writer {
+	private:
+		std::string bytes;
+		// Where the open record starts
+		std::size_t record = 0;
+		void put32At(const std::size_t& offset, const std::uint32_t& value) {
+			for (std::size_t i = 0; i < 4; i++)
+				bytes[offset + i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+		}
+	public:
+		// ctor(s) (a save starts with its header, the size is filled in by finish())
+		explicit Writer(const bool& header = true) {
+			if (!header) return;
+			bytes.append(fileMagic, sizeof(fileMagic));
+			put32(fileVersion);
+			put32(compatibleVersion);
+			put32(0);
+		}
+		// Writes numbers.
+		void put8(const std::uint8_t& value) {
+			bytes.push_back(static_cast<char>(value));
+		}
+		void put16(const std::uint16_t& value) {
+			put8(static_cast<std::uint8_t>(value & 0xFF));
+			put8(static_cast<std::uint8_t>(value >> 8));
+		}
+		void put32(const std::uint32_t& value) {
+			put16(static_cast<std::uint16_t>(value & 0xFFFF));
+			put16(static_cast<std::uint16_t>(value >> 16));
+		}
+		void putInt(const int& value) {
+			put32(static_cast<std::uint32_t>(value));
+		}
+		void put64(const std::uint64_t& value) {
+			put32(static_cast<std::uint32_t>(value));
+			put32(static_cast<std::uint32_t>(value >> 32));
+		}
+		// Writes a double as its IEEE 754 bits.
+		void putDouble(const double& value) {
+			std::uint64_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			put64(bits);
+		}
+		// Writes a varint (7 bits a byte, low bits first), so small numbers take a byte.
+		void putVarint(std::uint64_t value) {
+			for (; value >= 0x80; value >>= 7)
+				put8(static_cast<std::uint8_t>(value | 0x80));
+			put8(static_cast<std::uint8_t>(value));
+		}
+		// Writes a string (length, then the bytes).
+		void putString(const std::string_view& text) {
+			put32(static_cast<std::uint32_t>(text.size()));
+			bytes += text;
+		}
+		// Writes bytes as they are (such as a whole record).
+		void putBytes(const std::string_view& raw) {
+			bytes += raw;
+		}
+		// Starts and ends a record.
+		void begin(const Tag& tag) {
+			record = bytes.size();
+			put16(static_cast<std::uint16_t>(tag));
+			put16(0);
+			put32(0);
+		}
+		void end() {
+			put32At(record + 4, static_cast<std::uint32_t>(bytes.size() - record - recordHeaderSize));
+			while (bytes.size() % 4 != 0) put8(0);
+		}
+		// Fills in the file size and returns the save.
+		const std::string& finish() {
+			put32At(12, static_cast<std::uint32_t>(bytes.size()));
+			return bytes;
+		}
+		// Getter functions
+		const std::string& getBytes() const {
+			return bytes;
+		}
+		bool isEmpty() const {
+			return bytes.empty();
+		}
+		void clear() {
+			bytes.clear();
+		}
+	};
+	/* The Reader class reads the fields of a record. A     *
+	* field past the end of the record is left as it was   *
+	* (the file is older than the field).                  */
+	class Reader {
+	private:
+		const unsigned char* at;
+		const unsigned char* end;
+		// Reads count little-endian bytes (false if the record ran out).
+		bool take(std::uint64_t& value, const std::size_t& count) {
+			if (static_cast<std::size_t>(end - at) < count) {
+				at = end;
+				return false;
+			}
+			value = 0;
+			for (std::size_t i = 0; i < count; i++)
+				value |= static_cast<std::uint64_t>(at[i]) << (8 * i);
+			at += count;
+			return true;
+		}
+	public:
+		// ctor(s)
+		Reader(const unsigned char* _at, const std::size_t& size)
+			: at(_at), end(_at + size) { }
+		// Reads fields.
+		void get(std::uint8_t& value) {
+			std::uint64_t raw;
+			if (take(raw, 1)) value = static_cast<std::uint8_t>(raw);
+		}
+		void get(std::uint16_t& value) {
+			std::uint64_t raw;
+			if (take(raw, 2)) value = static_cast<std::uint16_t>(raw);
+		}
+		void get(std::uint32_t& value) {
+			std::uint64_t raw;
+			if (take(raw, 4)) value = static_cast<std::uint32_t>(raw);
+		}
+		void get(int& value) {
+			std::uint64_t raw;
+			if (take(raw, 4)) value = static_cast<int>(static_cast<std::uint32_t>(raw));
+		}
+		void get(std::uint64_t& value) {
+			take(value, 8);
+		}
+		void get(double& value) {
+			std::uint64_t raw;
+			if (take(raw, 8)) std::memcpy(&value, &raw, sizeof(value));
+		}
+		void get(bool& value) {
+			std::uint64_t raw;
+			if (take(raw, 1)) value = raw != 0;
+		}
+		void get(std::string& text) {
+			std::uint64_t length;
+			if (!take(length, 4)) return;
+			if (length > static_cast<std::size_t>(end - at)) throw std::runtime_error("Not a valid save (a string runs past its record)");
+			text.assign(reinterpret_cast<const char*>(at), static_cast<std::size_t>(length));
+			at += length;
+		}
+		// Reads a string as a view of the bytes (which must outlive it). Returns false if the record ran out.
+		bool getView(std::string_view& text) {
+			std::uint64_t length;
+			if (!take(length, 4) || length > static_cast<std::size_t>(end - at)) {
+				at = end;
+				return false;
+			}
+			text = std::string_view(reinterpret_cast<const char*>(at), static_cast<std::size_t>(length));
+			at += length;
+			return true;
+		}
+		// Reads a varint. Returns false if the record ran out (or it's too long).
+		bool getVarint(std::uint64_t& value) {
+			value = 0;
+			for (unsigned int shift = 0; shift < 64 && at < end; shift += 7) {
+				const unsigned char byte = *at++;
+				value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0) return true;
+			}
+			at = end;
+			return false;
+		}
+		// Getter functions
+		std::size_t getLeft() const {
+			return static_cast<std::size_t>(end - at);
+		}
+	};
+	// Throws std::runtime_error for a damaged save.
+	[[noreturn]] inline void fail(const std::string& reason) {
+		throw std::runtime_error("Not a valid save (" + reason + ")");
+	}
+	// Gets the ID of the equipped item (noItem if nothing is).
+	inline std::uint16_t equippedID(Character& character) {
+		const Item* item = character.inventory.inspectItem(character.equipped);
+		return item != nullptr ? item->getID() : noItem;
+	}
+
+	// Writes one of the records of a character's fields.
+	inline void putRecord(Writer& out, const Tag& tag, const Character& character, const Accuracy& accuracy) {
+		out.begin(tag);
+		switch (tag) {
+		case Tag::IDENTITY:
+			for (const std::string* text : { &character.name, &character.race, &character.clas, &character.difficultyN, &character.profession, &character.dad })
+				out.putString(*text);
+			out.put64(character.seed);
+			break;
+		case Tag::STATS:
+			for (const int value : { character.lvl, character.exp, character.maxHP, character.maxMP, character.hp, character.mp,
+				character.str, character.def, character.crt, character.spd, character.itl, character.dust })
+				out.putInt(value);
+			out.put32(character.fights);
+			out.putDouble(character.difficultyD);
+			out.putDouble(character.expmultiplier);
+			break;
+		case Tag::PROFICIENCIES:
+			for (const double value : { character.headhp, character.chesthp, character.rightarmhp, character.leftarmhp, character.rightleghp, character.leftleghp,
+				character.strprof, character.defprof, character.spdprof, character.itlprof,
+				character.bowprof, character.swordprof, character.staffprof, character.unarmedprof })
+				out.putDouble(value);
+			break;
+		case Tag::WORKSHOP:
+			out.put8(character.blackmarketfirst);
+			out.put8(character.workshopfirst);
+			for (const std::string& mod : character.modsot)
+				out.putString(mod);
+			for (const int& cost : character.modsmt)
+				out.putInt(cost);
+			break;
+		case Tag::LEVELING:
+			out.put8(static_cast<std::uint8_t>(character.leveling.kind));
+			out.put8(static_cast<std::uint8_t>(character.leveling.stat));
+			out.put32(static_cast<std::uint32_t>(character.leveling.next));
+			out.put32(static_cast<std::uint32_t>(character.leveling.script.size()));
+			for (const Leveling::Stat& stat : character.leveling.script)
+				out.put8(static_cast<std::uint8_t>(stat));
+			break;
+		case Tag::ACCURACY:
+			for (const int value : { accuracy.head, accuracy.chest, accuracy.rightarm, accuracy.leftarm, accuracy.rightleg, accuracy.leftleg })
+				out.putInt(value);
+			for (const double value : { accuracy.headdamagex, accuracy.chestdamagex, accuracy.rightarmdamagex, accuracy.leftarmdamagex, accuracy.rightlegdamagex, accuracy.leftlegdamagex })
+				out.putDouble(value);
+			break;
+		default:
+			throw std::logic_error("Not a field record");
+		}
+		out.end();
+	}
+
+	// An inventory slot in a snapshot (the holes deleted slots leave have noItem).
+	struct SlotEntry {
+		std::uint16_t id;
+		std::uint16_t stack;
+	};
+	// A chunk of a snapshot's slots (Inventory::chunkSlots of them, fewer in the last one).
+	using SlotChunk = std::vector<SlotEntry>;
+	/* The Snapshot struct is a character frozen for saving: *
+	* the field records, and the inventory in chunks. A     *
+	* chunk never changes once it's made, so snapshots      *
+	* share the chunks that didn't change between them, and *
+	* one can be written on another thread while the game   *
+	* goes on.                                              */
+	struct Snapshot {
+		std::array<std::string, std::size(fieldTags)> records;
+		std::vector<std::shared_ptr<const SlotChunk>> chunks;
+		// The equipped slot (its index among the chunks' slots, holes included)
+		std::uint32_t equipped = noSlot;
+		// The journal that goes on from the save
+		std::uint64_t generation = 0;
+	};
+	// Copies a chunk of an inventory's slots.
+	inline std::shared_ptr<const SlotChunk> copyChunk(Inventory& inventory, const unsigned int& chunk) {
+		const unsigned int first = chunk * Inventory::chunkSlots;
+		const unsigned int last = std::min(first + Inventory::chunkSlots, inventory.getSlotCount());
+		auto slots = std::make_shared<SlotChunk>();
+		slots->reserve(last - first);
+		for (unsigned int i = first; i < last; i++) {
+			const ItemSlot* slot = inventory.inspectSlot(i);
+			if (slot == nullptr) slots->push_back(SlotEntry{ noItem, 0 });
+			else slots->push_back(SlotEntry{ slot->getItem()->getID(), slot->getStackAmount() });
+		}
+		return slots;
+	}
+	// Gets the index of the equipped slot (noSlot if nothing is equipped).
+	inline std::uint32_t equippedSlot(const Character& character) {
+		const unsigned int slot = character.inventory.getSlotIndex(character.equipped);
+		return slot != Inventory::npos ? slot : noSlot;
+	}
+	// Takes a whole snapshot of a character (a Journal takes them sharing the last one's chunks).
+	inline Snapshot freeze(Character& character, const Accuracy& accuracy, const std::uint64_t& generation = 0) {
+		Snapshot snapshot;
+		for (std::size_t i = 0; i < std::size(fieldTags); i++) {
+			Writer out(false);
+			putRecord(out, fieldTags[i], character, accuracy);
+			snapshot.records[i] = out.getBytes();
+		}
+		const unsigned int chunks = (character.inventory.getSlotCount() + Inventory::chunkSlots - 1) / Inventory::chunkSlots;
+		for (unsigned int chunk = 0; chunk < chunks; chunk++)
+			snapshot.chunks.push_back(copyChunk(character.inventory, chunk));
+		snapshot.equipped = equippedSlot(character);
+		snapshot.generation = generation;
+		return snapshot;
+	}
+
+	/* Writes a snapshot to a save in memory. The slots are  *
+	* packed: each item ID as its (zigzag) difference from  *
+	* the one before, and each stack, as varints. Item IDs  *
+	* mostly come in runs, so that's 2 bytes a slot rather  *
+	* than 4. They're written unpacked too, after, for      *
+	* version 1 readers.                                    */
+	inline std::string encode(const Snapshot& snapshot) {
+		Writer out;
+		for (const std::string& record : snapshot.records)
+			out.putBytes(record);
+		// Count the slots (leaving out holes), and find the equipped one among them
+		std::uint32_t count = 0, equipped = noSlot, index = 0;
+		for (const std::shared_ptr<const SlotChunk>& chunk : snapshot.chunks)
+			for (const SlotEntry& slot : *chunk) {
+				if (slot.id != noItem) {
+					if (index == snapshot.equipped) equipped = count;
+					count++;
+				}
+				index++;
+			}
+		out.begin(Tag::SLOTS);
+		out.put32(equipped);
+		out.put32(count);
+		std::int32_t previous = 0;
+		for (const std::shared_ptr<const SlotChunk>& chunk : snapshot.chunks)
+			for (const SlotEntry& slot : *chunk) {
+				if (slot.id == noItem) continue;
+				const std::int32_t step = slot.id - previous;
+				out.putVarint((static_cast<std::uint32_t>(step) << 1) ^ static_cast<std::uint32_t>(step >> 31));
+				out.putVarint(slot.stack);
+				previous = slot.id;
+			}
+		out.end();
+		out.begin(Tag::INVENTORY);
+		out.put32(equipped);
+		out.put32(count);
+		for (const std::shared_ptr<const SlotChunk>& chunk : snapshot.chunks)
+			for (const SlotEntry& slot : *chunk) {
+				if (slot.id == noItem) continue;
+				out.put16(slot.id);
+				out.put16(slot.stack);
+			}
+		out.end();
+		out.begin(Tag::JOURNAL);
+		out.put64(snapshot.generation);
+		out.end();
+		return out.finish();
+	}
+	// Writes a character (and their accuracy) to a save in memory, continued by the journal of a generation.
+	inline std::string encode(Character& character, const Accuracy& accuracy, const std::uint64_t& generation = 0) {
+		return encode(freeze(character, accuracy, generation));
+	}
+
+	/* The Loaded struct is a character being read, from a   *
+	* save and then from its journals. finish() equips and  *
+	* aims it once every record is in.                      */
+	struct Loaded {
+		Character character;
+		Accuracy accuracy;
+		std::uint16_t equipped = noItem;
+		std::uint64_t generation = 0;
+		// Whether the inventory came from a SLOTS record (the INVENTORY after it is skipped)
+		bool packed = false;
+		// Reads a record, finding items by ID with find.
+		void read(const std::uint16_t& tag, Reader& in, const Item* (*find)(const unsigned short& id)) {
+			switch (static_cast<Tag>(tag)) {
+			case Tag::IDENTITY:
+				for (std::string* text : { &character.name, &character.race, &character.clas, &character.difficultyN, &character.profession, &character.dad })
+					in.get(*text);
+				in.get(character.seed);
+				break;
+			case Tag::STATS:
+				for (int* value : { &character.lvl, &character.exp, &character.maxHP, &character.maxMP, &character.hp, &character.mp,
+					&character.str, &character.def, &character.crt, &character.spd, &character.itl, &character.dust })
+					in.get(*value);
+				in.get(character.fights);
+				in.get(character.difficultyD);
+				in.get(character.expmultiplier);
+				break;
+			case Tag::PROFICIENCIES:
+				for (double* value : { &character.headhp, &character.chesthp, &character.rightarmhp, &character.leftarmhp, &character.rightleghp, &character.leftleghp,
+					&character.strprof, &character.defprof, &character.spdprof, &character.itlprof,
+					&character.bowprof, &character.swordprof, &character.staffprof, &character.unarmedprof })
+					in.get(*value);
+				break;
+			case Tag::WORKSHOP:
+				in.get(character.blackmarketfirst);
+				in.get(character.workshopfirst);
+				for (std::string& mod : character.modsot)
+					in.get(mod);
+				for (int& cost : character.modsmt)
+					in.get(cost);
+				break;
+			case Tag::LEVELING: {
+				std::uint8_t kind = static_cast<std::uint8_t>(character.leveling.kind), stat = 0;
+				std::uint32_t next = 0, count = 0;
+				in.get(kind);
+				in.get(stat);
+				in.get(next);
+				in.get(count);
+				if (kind > static_cast<std::uint8_t>(Leveling::Policy::Kind::AUTO) || stat >= Leveling::statCount || count > in.getLeft())
+					fail("bad level up policy");
+				std::vector<Leveling::Stat> script(count);
+				for (Leveling::Stat& step : script) {
+					std::uint8_t value = 0;
+					in.get(value);
+					if (value >= Leveling::statCount) fail("bad level up script");
+					step = static_cast<Leveling::Stat>(value);
+				}
+				if (kind == static_cast<std::uint8_t>(Leveling::Policy::Kind::SCRIPT) && (script.empty() || next >= script.size()))
+					fail("bad level up script");
+				character.leveling.kind = static_cast<Leveling::Policy::Kind>(kind);
+				character.leveling.stat = static_cast<Leveling::Stat>(stat);
+				character.leveling.next = next;
+				character.leveling.script = std::move(script);
+				break;
+			}
+			case Tag::ACCURACY:
+				for (int* value : { &accuracy.head, &accuracy.chest, &accuracy.rightarm, &accuracy.leftarm, &accuracy.rightleg, &accuracy.leftleg })
+					in.get(*value);
+				for (double* value : { &accuracy.headdamagex, &accuracy.chestdamagex, &accuracy.rightarmdamagex, &accuracy.leftarmdamagex, &accuracy.rightlegdamagex, &accuracy.leftlegdamagex })
+					in.get(*value);
+				break;
+			case Tag::INVENTORY: {
+				if (packed) break;
+				std::uint32_t slot = noSlot, count = 0;
+				in.get(slot);
+				in.get(count);
+				if (count > in.getLeft() / 4) fail("inventory out of bounds");
+				if (slot != noSlot && slot >= count) fail("equipped slot doesn't exist");
+				character.inventory = Inventory();
+				equipped = noItem;
+				for (std::uint32_t i = 0; i < count; i++) {
+					std::uint16_t id = 0, stack = 0;
+					in.get(id);
+					in.get(stack);
+					const Item* item = find(id);
+					if (item == nullptr) fail("item " + std::to_string(id) + " doesn't exist");
+					if (stack == 0 || character.inventory.getSlotIndex(id) != Inventory::npos) fail("bad stack");
+					character.inventory.addItem(*item, stack);
+					if (i == slot) equipped = id;
+				}
+				break;
+			}
+			case Tag::SLOTS: {
+				std::uint32_t slot = noSlot, count = 0;
+				in.get(slot);
+				in.get(count);
+				if (count > in.getLeft() / 2) fail("inventory out of bounds");
+				if (slot != noSlot && slot >= count) fail("equipped slot doesn't exist");
+				character.inventory = Inventory();
+				equipped = noItem;
+				std::int64_t id = 0;
+				for (std::uint32_t i = 0; i < count; i++) {
+					std::uint64_t step = 0, stack = 0;
+					if (!in.getVarint(step) || !in.getVarint(stack)) fail("inventory out of bounds");
+					if (step > 2u * noItem) fail("bad item ID");
+					id += static_cast<std::int64_t>(step >> 1) ^ -static_cast<std::int64_t>(step & 1);
+					const Item* item = id >= 0 && id < noItem ? find(static_cast<unsigned short>(id)) : nullptr;
+					if (item == nullptr) fail("item " + std::to_string(id) + " doesn't exist");
+					if (stack == 0 || stack > Inventory::maxStack || character.inventory.getSlotIndex(item->getID()) != Inventory::npos) fail("bad stack");
+					character.inventory.addItem(*item, static_cast<unsigned short>(stack));
+					if (i == slot) equipped = item->getID();
+				}
+				packed = true;
+				break;
+			}
+			case Tag::JOURNAL:
+				in.get(generation);
+				break;
+			case Tag::SLOT: {
+				// The new stack of an item (0 once it's gone)
+				std::uint16_t id = 0, stack = 0;
+				in.get(id);
+				in.get(stack);
+				const unsigned int slot = character.inventory.getSlotIndex(id);
+				const unsigned short had = slot != Inventory::npos ? character.inventory.inspectSlot(slot)->getStackAmount() : 0;
+				if (stack > had) {
+					const Item* item = find(id);
+					if (item == nullptr) fail("item " + std::to_string(id) + " doesn't exist");
+					character.inventory.addItem(*item, static_cast<unsigned short>(stack - had));
+				}
+				else if (stack < had) {
+					character.inventory.deleteItem(slot, static_cast<unsigned short>(had - stack));
+				}
+				break;
+			}
+			case Tag::EQUIPPED:
+				in.get(equipped);
+				break;
+			default:
+				// A record from a newer version
+				break;
+			}
+		}
+		// Reads the records in a range.
+		void readAll(const unsigned char* data, const std::size_t& size, const Item* (*find)(const unsigned short& id)) {
+			for (std::size_t at = 0; at < size;) {
+				if (size - at < recordHeaderSize) fail("record header out of bounds");
+				Reader head(data + at, recordHeaderSize);
+				std::uint16_t tag = 0, flags = 0;
+				std::uint32_t length = 0;
+				head.get(tag);
+				head.get(flags);
+				head.get(length);
+				at += recordHeaderSize;
+				if (length > size - at) fail("record out of bounds");
+				Reader in(data + at, length);
+				at += (static_cast<std::size_t>(length) + 3) & ~static_cast<std::size_t>(3);
+				read(tag, in, find);
+			}
+		}
+		// Equips and aims the character, and hands it (and the accuracy) over.
+		void finish(Character& _character, Accuracy& _accuracy) {
+			try {
+				character.equip(character.inventory.getHandle(character.inventory.getSlotIndex(equipped)));
+				character.aim(accuracy);
+			}
+			catch (const std::invalid_argument& e) {
+				// Hit weights the table won't take
+				fail(e.what());
+			}
+			_character = std::move(character);
+			_accuracy = accuracy;
+		}
+	};
+
+	// Reads a save's header and records.
+	inline void readSave(const unsigned char* data, const std::size_t& size, Loaded& loaded, const Item* (*find)(const unsigned short& id)) {
+		if (size < headerSize) fail("too small");
+		if (!std::equal(std::begin(fileMagic), std::end(fileMagic), data)) fail("wrong magic");
+		Reader header(data + sizeof(fileMagic), headerSize - sizeof(fileMagic));
+		std::uint32_t version = 0, compatible = 0, fileSize = 0;
+		header.get(version);
+		header.get(compatible);
+		header.get(fileSize);
+		if (compatible > fileVersion) fail("made by a newer version of the game");
+		if (fileSize != size) fail("truncated");
+		loaded.readAll(data + headerSize, size - headerSize, find);
+	}
+
+	/* Reads a save into a character and their accuracy,     *
+	* finding items by ID with find. Throws                 *
+	* std::runtime_error if the save is damaged or too new  *
+	* (and leaves the character and accuracy as they were). */
+	inline void decode(const unsigned char* data, const std::size_t& size, Character& character, Accuracy& accuracy,
+		const Item* (*find)(const unsigned short& id) = findItem) {
+		// Build the character aside, so a bad save changes nothing
+		Loaded loaded;
+		readSave(data, size, loaded, find);
+		loaded.finish(character, accuracy);
+	}
+
+	/* The AppendFile class is a file opened for appending,   *
+	* with the OS's flush-to-disk. Throws std::runtime_error *
+	* if the file can't be opened.                           */
+	class AppendFile {
+	private:
+#if defined(_WIN32)
+		HANDLE file = INVALID_HANDLE_VALUE;
+#else
+		int file = -1;
+#endif
+	public:
+		// ctor(s) (creates the file, or empties it)
+		AppendFile() = default;
+		explicit AppendFile(const std::string& path) {
+#if defined(_WIN32)
+			file = CreateFileA(path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+#else
+			file = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+			if (file < 0)
+#endif
+				throw std::runtime_error("Can't open " + path);
+		}
+		AppendFile(const AppendFile&) = delete;
+		AppendFile& operator=(const AppendFile&) = delete;
+		AppendFile(AppendFile&& other) noexcept {
+			std::swap(file, other.file);
+		}
+		AppendFile& operator=(AppendFile&& other) noexcept {
+			std::swap(file, other.file);
+			return *this;
+		}
+		// dtor(s)
+		~AppendFile() {
+			close();
+		}
+		// Appends bytes (in one write when the OS allows). Returns false if it can't.
+		bool append(const std::string& bytes) {
+#if defined(_WIN32)
+			DWORD written = 0;
+			return WriteFile(file, bytes.data(), static_cast<DWORD>(bytes.size()), &written, nullptr) && written == bytes.size();
+#else
+			std::size_t done = 0;
+			while (done < bytes.size()) {
+				const ssize_t written = ::write(file, bytes.data() + done, bytes.size() - done);
+				if (written < 0 && errno == EINTR) continue;
+				if (written < 0) return false;
+				done += static_cast<std::size_t>(written);
+			}
+			return true;
+#endif
+		}
+		// Waits until what was appended is on disk.
+		bool sync() {
+#if defined(_WIN32)
+			return FlushFileBuffers(file) != 0;
+#else
+			return ::fsync(file) == 0;
+#endif
+		}
+		void close() {
+#if defined(_WIN32)
+			if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+			file = INVALID_HANDLE_VALUE;
+#else
+			if (file >= 0) ::close(file);
+			file = -1;
+#endif
+		}
+		// Getter functions
+		bool isOpen() const {
+#if defined(_WIN32)
+			return file != INVALID_HANDLE_VALUE;
+#else
+			return file >= 0;
+#endif
+		}
+	};
+
+	/* Saves the character to a file in one go (with no     *
+	* journal). Throws std::runtime_error if it can't be    *
+	* written.                                              */
+	inline void save(Character& character, const Accuracy& accuracy, const std::string& path = defaultPath);
+
+	/* Writes a whole file: to a temporary file next to it   *
+	* first, flushed to disk, and then moved over it, so a  *
+	* crash leaves either the old file or the new one.      *
+	* Throws std::runtime_error if it can't be written.     */
+	inline void replaceFile(const std::string& path, const std::string& bytes) {
+		const std::string temporary = path + ".tmp";
+		{
+			AppendFile file(temporary);
+			if (!file.append(bytes) || !file.sync())
+				throw std::runtime_error("Can't write " + temporary);
+		}
+#if defined(_WIN32)
+		const bool moved = MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		const bool moved = std::rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+		if (!moved)
+			throw std::runtime_error("Can't write " + path);
+	}
+	inline void save(Character& character, const Accuracy& accuracy, const std::string& path) {
+		replaceFile(path, encode(character, accuracy));
+	}
+
+	// The journal files of a save (one per generation). The header
+	// says if a journal goes on from the one before it (a compaction
+	// started it) or only from its own save.
+	constexpr char journalMagic[4] = { 'B', 'N', 'J', 'L' };
+	constexpr std::uint32_t journalVersion = 1;
+	constexpr std::uint32_t journalHeaderSize = 24;
+	// An entry is its payload's length, a checksum and a sequence number, then the records.
+	constexpr std::uint32_t entryHeaderSize = 24;
+	inline std::string journalPath(const std::string& path, const std::uint64_t& generation) {
+		return path + "." + std::to_string(generation) + ".jnl";
+	}
+	inline bool exists(const std::string& path) {
+		return static_cast<bool>(std::ifstream(path));
+	}
+	// The checksum of an entry (FNV-1a over its sequence number and records).
+	inline std::uint64_t checksum(const std::uint64_t& sequence, const unsigned char* records, const std::size_t& size) {
+		std::uint64_t hash = Randomness::seedFromText(std::string_view(reinterpret_cast<const char*>(&sequence), sizeof(sequence)));
+		for (std::size_t i = 0; i < size; i++) {
+			hash ^= records[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+	/* Replays a journal onto a character being loaded (the  *
+	* first journal after a save, or one that goes on from  *
+	* the one before). Entries are replayed up to the first *
+	* one that didn't make it whole to disk (the game       *
+	* stopped mid-write). Returns false if the journal ends *
+	* on such an entry, or wasn't replayed.                 */
+	inline bool replay(const std::string& path, const std::uint64_t& generation, const bool& first, Loaded& loaded,
+		const Item* (*find)(const unsigned short& id)) {
+		ItemSystem::Database::MappedFile file;
+		try {
+			file = ItemSystem::Database::MappedFile(path);
+		}
+		catch (const std::runtime_error&) {
+			// Empty (the game stopped before the header was written)
+			return false;
+		}
+		const unsigned char* data = file.getData();
+		if (file.getSize() < journalHeaderSize || !std::equal(std::begin(journalMagic), std::end(journalMagic), data)) return false;
+		Reader header(data + sizeof(journalMagic), journalHeaderSize - sizeof(journalMagic));
+		std::uint32_t version = 0, continues = 0;
+		std::uint64_t written = ~generation;
+		header.get(version);
+		header.get(written);
+		header.get(continues);
+		if (written != generation || (!first && continues == 0)) return false;
+		for (std::size_t at = journalHeaderSize; at < file.getSize();) {
+			if (file.getSize() - at < entryHeaderSize) return false;
+			Reader head(data + at, entryHeaderSize);
+			std::uint32_t length = 0, flags = 0;
+			std::uint64_t sequence = 0, sum = 0;
+			head.get(length);
+			head.get(flags);
+			head.get(sequence);
+			head.get(sum);
+			at += entryHeaderSize;
+			if (length > file.getSize() - at || checksum(sequence, data + at, length) != sum) return false;
+			loaded.readAll(data + at, length, find);
+			at += length;
+		}
+		return true;
+	}
+
+	/* Loads a save (and replays its journals) into the     *
+	* character. Throws std::runtime_error if there is no   *
+	* save or it is damaged (and leaves the character as it *
+	* was).                                                 */
+	inline void load(Character& character, Accuracy& accuracy, const std::string& path = defaultPath,
+		const Item* (*find)(const unsigned short& id) = findItem) {
+		Loaded loaded;
+		{
+			const ItemSystem::Database::MappedFile file(path);
+			readSave(file.getData(), file.getSize(), loaded, find);
+		}
+		// The save names the journal it goes on in; a compaction that didn't finish left newer ones
+		for (std::uint64_t generation = loaded.generation; exists(journalPath(path, generation)); generation++)
+			if (!replay(journalPath(path, generation), generation, generation == loaded.generation, loaded, find)) break;
+		loaded.finish(character, accuracy);
+	}
+
+	/* The Journal class saves a character as it plays. It   *
+	* keeps a snapshot of the character as last written      *
+	* (and the stacks by item ID), and commit() appends only *
+	* the records and inventory slots that changed since, as *
+	* one entry in a single write. Only the inventory chunks *
+	* that changed are looked at. A background thread makes  *
+	* the entries durable: after a commit it waits a moment  *
+	* for more to join, then flushes them all to disk at     *
+	* once. open() folds the journal into a new save by      *
+	* handing the snapshot to the thread, which encodes and  *
+	* writes it while the game goes on, then starts the      *
+	* journal after it ahead of time; poll() reports the     *
+	* saves it finished. The journal is also folded when it  *
+	* grows past compactLimit. Loading a save replays the    *
+	* journals after it.                                     */
+	class Journal {
+	public:
+		// How long a flush waits for more entries, and the journal size that starts a compaction.
+		static constexpr std::chrono::milliseconds groupWindow{ 2 };
+		static constexpr std::size_t compactLimit = 64 * 1024;
+		// What the journal did (for tests and benchmarks).
+		struct Counters {
+			std::uint64_t commits = 0, bytes = 0, syncs = 0, compactions = 0;
+		};
+		// The saves the thread wrote since the last poll(), and why the last thing it couldn't do failed.
+		struct Report {
+			std::uint64_t saves = 0;
+			std::string failure;
+		};
+	private:
+		std::string path;
+		const Item* (*find)(const unsigned short& id) = findItem;
+		// The character as last written, the stacks by item ID, and the equipped item
+		Snapshot written;
+		std::vector<unsigned short> stacks;
+		std::uint16_t equipped = noItem;
+		// The entry being built, and the items of the chunks that changed (kept to reuse their memory)
+		Writer entry{ false };
+		std::vector<std::uint16_t> left;
+		// The journal being appended to (shared with the thread while it flushes), and its size
+		std::shared_ptr<AppendFile> file;
+		std::uint64_t generation = 0;
+		std::size_t size = 0;
+		// Shared with the thread
+		std::mutex mutex;
+		std::condition_variable wake, done;
+		std::thread worker;
+		bool stopping = false;
+		std::uint64_t appended = 0, durable = 0;
+		std::vector<std::shared_ptr<AppendFile>> retired;
+		Snapshot pending;
+		bool hasPending = false, writing = false;
+		// The next journal, started ahead by the thread (nullptr until it is), and whether it's being started
+		std::shared_ptr<AppendFile> spare;
+		std::uint64_t spareGeneration = 0;
+		bool starting = false;
+		Report report;
+		Counters counters;
+		// Appends the new stack of an item to the entry.
+		void putSlot(const std::uint16_t& id, const unsigned short& stack) {
+			entry.begin(Tag::SLOT);
+			entry.put16(id);
+			entry.put16(stack);
+			entry.end();
+			stacks[id] = stack;
+		}
+		// Brings the snapshot up to date with the character, putting what changed in the entry.
+		void refresh(Character& character, const Accuracy& accuracy) {
+			entry.clear();
+			// The field records that changed
+			for (std::size_t i = 0; i < std::size(fieldTags); i++) {
+				Writer out(false);
+				putRecord(out, fieldTags[i], character, accuracy);
+				if (out.getBytes() != written.records[i]) {
+					written.records[i] = out.getBytes();
+					entry.putBytes(written.records[i]);
+				}
+			}
+			// The chunks that changed: the stacks that changed (in inventory order), then the items that left them
+			Inventory& inventory = character.inventory;
+			const unsigned int chunks = (inventory.getSlotCount() + Inventory::chunkSlots - 1) / Inventory::chunkSlots;
+			left.clear();
+			for (unsigned int chunk = 0; chunk < written.chunks.size(); chunk++) {
+				if (chunk < chunks && !inventory.isChanged(chunk)) continue;
+				for (const SlotEntry& slot : *written.chunks[chunk])
+					if (slot.id != noItem) left.push_back(slot.id);
+			}
+			written.chunks.resize(chunks);
+			for (unsigned int chunk = 0; chunk < chunks; chunk++) {
+				if (written.chunks[chunk] != nullptr && !inventory.isChanged(chunk)) continue;
+				written.chunks[chunk] = copyChunk(inventory, chunk);
+				for (const SlotEntry& slot : *written.chunks[chunk]) {
+					if (slot.id == noItem) continue;
+					if (slot.id >= stacks.size()) stacks.resize(slot.id + 1u, 0);
+					if (stacks[slot.id] != slot.stack) putSlot(slot.id, slot.stack);
+				}
+			}
+			for (const std::uint16_t& id : left)
+				if (stacks[id] != 0 && inventory.getSlotIndex(id) == Inventory::npos) putSlot(id, 0);
+			inventory.clearChanged();
+			written.equipped = equippedSlot(character);
+			if (equippedID(character) != equipped) {
+				equipped = equippedID(character);
+				entry.begin(Tag::EQUIPPED);
+				entry.put16(equipped);
+				entry.end();
+			}
+		}
+		// Creates the journal of a generation and writes its header.
+		std::shared_ptr<AppendFile> startJournal(const std::uint64_t& next, const bool& continues) const {
+			auto journal = std::make_shared<AppendFile>(journalPath(path, next));
+			Writer header(false);
+			header.putBytes(std::string(journalMagic, sizeof(journalMagic)));
+			header.put32(journalVersion);
+			header.put64(next);
+			header.put32(continues);
+			header.put32(0);
+			if (!journal->append(header.getBytes()))
+				throw std::runtime_error("Can't write " + journalPath(path, next));
+			return journal;
+		}
+		// Throws what the thread couldn't do.
+		void check() {
+			if (!report.failure.empty()) {
+				const std::string reason = report.failure;
+				report.failure.clear();
+				throw std::runtime_error(reason);
+			}
+		}
+		// The thread: flushes groups of entries, writes saves, and starts journals ahead.
+		void work() {
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true) {
+				wake.wait(lock, [this] { return stopping || appended > durable || !retired.empty() || hasPending; });
+				if (appended > durable || !retired.empty()) {
+					// Let more entries join the group
+					if (!stopping) {
+						lock.unlock();
+						std::this_thread::sleep_for(groupWindow);
+						lock.lock();
+					}
+					const std::uint64_t upTo = appended;
+					std::vector<std::shared_ptr<AppendFile>> journals = std::move(retired);
+					retired.clear();
+					journals.push_back(file);
+					lock.unlock();
+					bool synced = true;
+					for (const std::shared_ptr<AppendFile>& journal : journals)
+						synced = journal->sync() && synced;
+					journals.clear();
+					lock.lock();
+					counters.syncs++;
+					if (!synced) report.failure = "Can't flush " + journalPath(path, generation);
+					durable = std::max(durable, upTo);
+				}
+				if (hasPending) {
+					const Snapshot snapshot = std::move(pending);
+					pending = Snapshot{};
+					hasPending = false;
+					writing = true;
+					lock.unlock();
+					std::string error;
+					try {
+						replaceFile(path, encode(snapshot));
+						// The save covers every older journal
+						for (std::uint64_t old = snapshot.generation; old-- > 0 && exists(journalPath(path, old));)
+							std::remove(journalPath(path, old).c_str());
+					}
+					catch (const std::runtime_error& e) {
+						error = e.what();
+					}
+					lock.lock();
+					counters.compactions++;
+					if (!error.empty()) report.failure = error;
+					else report.saves++;
+					// Start the next journal now, so the next fold doesn't wait on creating it
+					// (open() waits for it rather than skip its generation)
+					if (!stopping && spare == nullptr && generation == snapshot.generation) {
+						const std::uint64_t next = generation + 1;
+						starting = true;
+						lock.unlock();
+						std::shared_ptr<AppendFile> journal;
+						try {
+							journal = startJournal(next, true);
+						}
+						catch (const std::runtime_error&) {
+							// open() starts it then
+						}
+						lock.lock();
+						starting = false;
+						if (journal != nullptr) {
+							spare = std::move(journal);
+							spareGeneration = next;
+						}
+					}
+					writing = false;
+				}
+				done.notify_all();
+				if (stopping && appended == durable && retired.empty() && !hasPending) return;
+			}
+		}
+	public:
+		// ctor(s)
+		Journal() = default;
+		Journal(const Journal&) = delete;
+		Journal& operator=(const Journal&) = delete;
+		// dtor(s)
+		~Journal() {
+			close();
+		}
+		/* Starts saving a character to a save file (or starts  *
+		* over, folding the journal into a new save). Only a   *
+		* snapshot is taken here, sharing the chunks of the    *
+		* inventory that didn't change; the save is written in *
+		* the background (see poll() and flush()). Throws      *
+		* std::runtime_error if the journal can't be opened.   */
+		void open(const std::string& _path, Character& character, const Accuracy& accuracy,
+			const Item* (*_find)(const unsigned short& id) = findItem) {
+			if (_path != path) {
+				close();
+				path = _path;
+				generation = 0;
+				// Go past every journal that's already there
+				Loaded saved;
+				try {
+					const ItemSystem::Database::MappedFile existing(path);
+					readSave(existing.getData(), existing.getSize(), saved, _find);
+					generation = saved.generation;
+				}
+				catch (const std::runtime_error&) {
+				}
+				written = Snapshot{};
+				stacks.clear();
+				equipped = noItem;
+			}
+			find = _find;
+			// What changed since the last commit goes in the save, not the journal
+			refresh(character, accuracy);
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [this] { return !starting; });
+			// Folding an open journal goes on from it, in the very next generation (loading stops at
+			// the first one missing), in the journal the thread started if it did
+			const bool continues = file != nullptr;
+			std::shared_ptr<AppendFile> journal;
+			std::uint64_t next = generation + 1;
+			if (continues && spare != nullptr && spareGeneration == next) {
+				journal = std::move(spare);
+			}
+			else {
+				// A first journal goes past every one that's already there (its save drops them)
+				if (!continues)
+					while (exists(journalPath(path, next))) next++;
+				journal = startJournal(next, continues);
+			}
+			spare.reset();
+			if (file != nullptr) retired.push_back(std::move(file));
+			file = std::move(journal);
+			generation = next;
+			size = journalHeaderSize;
+			// Hand the save to the thread
+			pending = written;
+			pending.generation = generation;
+			hasPending = true;
+			if (!worker.joinable()) {
+				stopping = false;
+				worker = std::thread(&Journal::work, this);
+			}
+			wake.notify_one();
+		}
+		/* Appends what changed since the last commit (nothing   *
+		* if nothing did), and compacts when the journal is     *
+		* big. Returns the bytes written. Throws                *
+		* std::runtime_error if the journal can't be written.   */
+		std::size_t commit(Character& character, const Accuracy& accuracy) {
+			if (!isOpen()) throw std::logic_error("The journal isn't open");
+			refresh(character, accuracy);
+			if (entry.isEmpty()) return 0;
+			std::unique_lock<std::mutex> lock(mutex);
+			// One write: the entry's header, then its records
+			const std::string& records = entry.getBytes();
+			const std::uint64_t sequence = appended + 1;
+			Writer out(false);
+			out.put32(static_cast<std::uint32_t>(records.size()));
+			out.put32(0);
+			out.put64(sequence);
+			out.put64(checksum(sequence, reinterpret_cast<const unsigned char*>(records.data()), records.size()));
+			out.putBytes(records);
+			if (!file->append(out.getBytes()))
+				throw std::runtime_error("Can't write " + journalPath(path, generation));
+			appended = sequence;
+			size += out.getBytes().size();
+			counters.commits++;
+			counters.bytes += out.getBytes().size();
+			wake.notify_one();
+			if (size > compactLimit) {
+				lock.unlock();
+				open(path, character, accuracy, find);
+			}
+			return out.getBytes().size();
+		}
+		// Gets what the thread finished (and what failed) since the last poll().
+		Report poll() {
+			std::lock_guard<std::mutex> lock(mutex);
+			Report finished = std::move(report);
+			report = Report{};
+			return finished;
+		}
+		/* Waits until every commit (and save) is on disk.       *
+		* Throws std::runtime_error if one couldn't be written  *
+		* (and wasn't polled already).                          */
+		void flush() {
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [this] { return !worker.joinable() || (durable == appended && retired.empty() && !hasPending && !writing); });
+			check();
+		}
+		// Flushes and stops the thread (the journal can be opened again).
+		void close() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!worker.joinable()) return;
+				stopping = true;
+			}
+			wake.notify_one();
+			worker.join();
+			std::lock_guard<std::mutex> lock(mutex);
+			// The journal started ahead was never used
+			if (spare != nullptr) {
+				spare.reset();
+				std::remove(journalPath(path, spareGeneration).c_str());
+			}
+			file.reset();
+			path.clear();
+		}
+		// Getter functions
+		bool isOpen() const {
+			return file != nullptr;
+		}
+		Counters getCounters() {
+			std::lock_guard<std::mutex> lock(mutex);
+			return counters;
+		}
+	};
+}
+
+/* The Store namespace keeps many saves in one place, for  *
+* hosting many players: an embedded log-structured        *
+* key-value store whose keys are a player and a save slot *
+* and whose values are saves. Writes go to a log (so a    *
+* crash loses nothing) and to a memtable. A full memtable *
+* is written out as a sorted, immutable segment with a    *
+* sparse index and a bloom filter, and once there are a   *
+* few segments they're merged in the background. However  *
+* many saves it holds, a store is a handful of files next *
+* to its path: the manifest (the path itself), the logs   *
+* and the segments.                                       */
+namespace Store
+{
+	using Saves::Writer;
+	using Saves::Reader;
+	// The memtable size that's written out, the segments that start a merge, and how often a segment indexes a key.
+	constexpr std::size_t memtableLimit = 1 << 20;
+	constexpr std::size_t mergeAt = 4;
+	constexpr std::uint32_t indexEvery = 16;
+	// The bloom filters' bits per key and probes (about 1% false positives).
+	constexpr std::uint32_t bloomBits = 10, bloomProbes = 7;
+	// File identification
+	constexpr char manifestMagic[4] = { 'B', 'N', 'K', 'M' };
+	constexpr char logMagic[4] = { 'B', 'N', 'K', 'L' };
+	constexpr char segmentMagic[4] = { 'B', 'N', 'K', 'S' };
+	constexpr std::uint32_t storeVersion = 1;
+	constexpr std::uint32_t logHeaderSize = 16, segmentHeaderSize = 16, segmentFooterSize = 24;
+	// A log entry is its payload's length, a checksum and a sequence number, then the writes (as in journals).
+	constexpr std::uint32_t entryHeaderSize = 24;
+	// What a write does.
+	enum class Op : std::uint8_t {
+		PUT = 1, REMOVE
+	};
+	inline std::string logPath(const std::string& path, const std::uint64_t& number) {
+		return path + "." + std::to_string(number) + ".log";
+	}
+	inline std::string segmentPath(const std::string& path, const std::uint64_t& number) {
+		return path + "." + std::to_string(number) + ".seg";
+	}
+	// Gets the key of a player's save slot: the name, a 0 byte and the
+	// slot big-endian (so a player's slots sort together, in order).
+	inline std::string key(const std::string& player, const std::uint32_t& slot) {
+		std::string bytes = player;
+		bytes.push_back('\0');
+		for (int shift = 24; shift >= 0; shift -= 8)
+			bytes.push_back(static_cast<char>((slot >> shift) & 0xFF));
+		return bytes;
+	}
+	// Gets where the bloom filter probes of a key (by its hash) start and how far apart they are.
+	inline void probes(const std::uint64_t& hash, std::uint64_t& first, std::uint64_t& step) {
+		first = hash;
+		step = (first ^ (first >> 29)) * 0xBF58476D1CE4E5B9ull;
+		step = (step ^ (step >> 32)) | 1;
+	}
+
+	/* The Batch class is writes that go together: they're  *
+	* one entry in the log (written in one write), so a     *
+	* crash keeps all of them or none.                      */
+	class Batch {
+	public:
+		struct Write {
+			Op op;
+			std::string key;
+			std::string value;
+		};
+	private:
+		std::vector<Write> writes;
+	public:
+		// Sets a key's value, or removes the key.
+		void put(const std::string& key, const std::string& value) {
+			writes.push_back(Write{ Op::PUT, key, value });
+		}
+		void remove(const std::string& key) {
+			writes.push_back(Write{ Op::REMOVE, key, std::string() });
+		}
+		void clear() {
+			writes.clear();
+		}
+		// Getter functions
+		const std::vector<Write>& getWrites() const {
+			return writes;
+		}
+		bool isEmpty() const {
+			return writes.empty();
+		}
+	};
+	// The newest write of each key, in key order.
+	struct Value {
+		Op op;
+		std::string bytes;
+	};
+	using Memtable = std::map<std::string, Value, std::less<>>;
+
+	/* The SegmentWriter class builds a segment in memory,   *
+	* from entries added in key order: a header, the        *
+	* entries (op, key, value), the sparse index (every     *
+	* indexEvery-th key and where its entry is), the bloom  *
+	* filter, and a footer saying where those are.          */
+	class SegmentWriter {
+	private:
+		Writer out{ false };
+		Writer index{ false };
+		std::uint32_t count = 0, indexed = 0;
+		std::vector<std::uint64_t> hashes;
+	public:
+		// ctor(s)
+		SegmentWriter() {
+			out.putBytes(std::string_view(segmentMagic, sizeof(segmentMagic)));
+			out.put32(storeVersion);
+			out.put64(0);
+		}
+		// Adds an entry (after every key before it).
+		void add(const Op& op, const std::string_view& key, const std::string_view& value) {
+			if (count % indexEvery == 0) {
+				index.putString(key);
+				index.put64(out.getBytes().size());
+				indexed++;
+			}
+			hashes.push_back(Randomness::seedFromText(key));
+			out.put8(static_cast<std::uint8_t>(op));
+			out.putString(key);
+			out.putString(value);
+			count++;
+		}
+		// Adds the index, the bloom filter and the footer, and returns the segment.
+		const std::string& finish() {
+			const std::uint64_t indexAt = out.getBytes().size();
+			out.put32(indexed);
+			out.putBytes(index.getBytes());
+			const std::uint64_t bloomAt = out.getBytes().size();
+			std::string bloom(std::max<std::size_t>(8, (static_cast<std::size_t>(count) * bloomBits + 7) / 8), '\0');
+			for (const std::uint64_t& hash : hashes) {
+				std::uint64_t first = 0, step = 0;
+				probes(hash, first, step);
+				for (std::uint32_t probe = 0; probe < bloomProbes; probe++) {
+					const std::uint64_t bit = (first + probe * step) % (bloom.size() * 8);
+					bloom[bit / 8] = static_cast<char>(bloom[bit / 8] | (1 << (bit % 8)));
+				}
+			}
+			out.putString(bloom);
+			out.put64(indexAt);
+			out.put64(bloomAt);
+			out.put32(count);
+			out.putBytes(std::string_view(segmentMagic, sizeof(segmentMagic)));
+			return out.getBytes();
+		}
+		// Getter functions
+		std::uint32_t getCount() const {
+			return count;
+		}
+	};
+
+	/* The Segment class reads a segment file. Opening one   *
+	* maps it and reads its index into memory (the bloom    *
+	* filter is read from the mapping); a lookup then reads *
+	* at most indexEvery entries. Throws std::runtime_error *
+	* if the file is missing or damaged.                    */
+	class Segment {
+	public:
+		// What a lookup found.
+		enum class Found {
+			MISSING, PUT, REMOVED
+		};
+	private:
+		ItemSystem::Database::MappedFile file;
+		std::uint64_t number;
+		std::uint32_t count = 0;
+		// Where the entries end, the indexed keys (views into the file) and where their entries are
+		std::size_t entriesEnd = 0;
+		std::vector<std::pair<std::string_view, std::size_t>> index;
+		std::string_view bloom;
+		[[noreturn]] void damaged(const std::string& path) const {
+			throw std::runtime_error("Damaged store segment " + path);
+		}
+	public:
+		// ctor(s)
+		Segment(const std::string& path, const std::uint64_t& _number) : number(_number) {
+			file = ItemSystem::Database::MappedFile(segmentPath(path, number));
+			const unsigned char* data = file.getData();
+			const std::size_t size = file.getSize();
+			if (size < segmentHeaderSize + segmentFooterSize || !std::equal(std::begin(segmentMagic), std::end(segmentMagic), data)
+				|| !std::equal(std::begin(segmentMagic), std::end(segmentMagic), data + size - sizeof(segmentMagic)))
+				damaged(segmentPath(path, number));
+			Reader footer(data + size - segmentFooterSize, segmentFooterSize);
+			std::uint64_t indexAt = 0, bloomAt = 0;
+			footer.get(indexAt);
+			footer.get(bloomAt);
+			footer.get(count);
+			if (indexAt < segmentHeaderSize || indexAt > bloomAt || bloomAt > size - segmentFooterSize) damaged(segmentPath(path, number));
+			entriesEnd = static_cast<std::size_t>(indexAt);
+			Reader in(data + indexAt, static_cast<std::size_t>(bloomAt - indexAt));
+			std::uint32_t indexed = 0;
+			in.get(indexed);
+			if (indexed > in.getLeft() / 12) damaged(segmentPath(path, number));
+			index.resize(indexed);
+			for (auto& [key, at] : index) {
+				std::uint64_t offset = 0;
+				if (!in.getView(key) || in.getLeft() < 8) damaged(segmentPath(path, number));
+				in.get(offset);
+				if (offset < segmentHeaderSize || offset >= entriesEnd) damaged(segmentPath(path, number));
+				at = static_cast<std::size_t>(offset);
+			}
+			Reader filter(data + bloomAt, static_cast<std::size_t>(size - segmentFooterSize - bloomAt));
+			if (!filter.getView(bloom) || bloom.empty()) damaged(segmentPath(path, number));
+		}
+		// Whether the segment may have a key (false means it surely doesn't).
+		bool mayContain(const std::string_view& key) const {
+			std::uint64_t first = 0, step = 0;
+			probes(Randomness::seedFromText(key), first, step);
+			for (std::uint32_t probe = 0; probe < bloomProbes; probe++) {
+				const std::uint64_t bit = (first + probe * step) % (bloom.size() * 8);
+				if ((static_cast<unsigned char>(bloom[bit / 8]) & (1 << (bit % 8))) == 0) return false;
+			}
+			return true;
+		}
+		// Reads the entry at an offset (as views into the file) and moves
+		// past it. Returns false at the end. Throws if the entry is damaged.
+		bool next(std::size_t& at, Op& op, std::string_view& key, std::string_view& value) const {
+			if (at >= entriesEnd) return false;
+			Reader in(file.getData() + at, entriesEnd - at);
+			std::uint8_t raw = 0;
+			in.get(raw);
+			if ((raw != static_cast<std::uint8_t>(Op::PUT) && raw != static_cast<std::uint8_t>(Op::REMOVE)) || !in.getView(key) || !in.getView(value))
+				throw std::runtime_error("Damaged store segment " + std::to_string(number));
+			op = static_cast<Op>(raw);
+			at = entriesEnd - in.getLeft();
+			return true;
+		}
+		// Looks up a key, copying its value if it's there.
+		Found find(const std::string_view& key, std::string& value) const {
+			// The last indexed key at or before it
+			auto after = std::upper_bound(index.begin(), index.end(), key, [](const std::string_view& wanted, const std::pair<std::string_view, std::size_t>& entry) {
+				return wanted < entry.first;
+			});
+			if (after == index.begin()) return Found::MISSING;
+			std::size_t at = std::prev(after)->second;
+			Op op = Op::PUT;
+			std::string_view found, bytes;
+			for (std::uint32_t i = 0; i < indexEvery && next(at, op, found, bytes); i++) {
+				if (found < key) continue;
+				if (found > key) break;
+				if (op == Op::REMOVE) return Found::REMOVED;
+				value.assign(bytes);
+				return Found::PUT;
+			}
+			return Found::MISSING;
+		}
+		// Getter functions
+		const std::uint64_t& getNumber() const {
+			return number;
+		}
+		const std::uint32_t& getCount() const {
+			return count;
+		}
+		std::size_t getSize() const {
+			return file.getSize();
+		}
+	};
+
+	/* The Engine class is a store. Writes go to the log and  *
+	* the memtable; a full memtable is frozen (still read)   *
+	* and a new one (with a new log) takes the writes while  *
+	* the background thread writes the frozen one out as a   *
+	* segment. Lookups check the memtable, the frozen one,   *
+	* then the segments newest first, skipping those whose   *
+	* bloom filter says no. The thread also flushes the log  *
+	* in groups (like a Journal) and merges the segments     *
+	* into one once there are mergeAt, dropping overwritten  *
+	* and removed keys. The manifest names the live          *
+	* segments and the oldest log that isn't in one, and is  *
+	* replaced whole, so a crash leaves the old manifest or  *
+	* the new one. Throws std::runtime_error for files it    *
+	* can't read or write.                                   */
+	class Engine {
+	public:
+		// How long a log flush waits for more batches.
+		static constexpr std::chrono::milliseconds groupWindow{ 2 };
+		// What the store did (for tests and benchmarks).
+		struct Counters {
+			std::uint64_t batches = 0, writes = 0, syncs = 0, flushes = 0, merges = 0;
+			std::uint64_t lookups = 0, probes = 0, skips = 0;
+			std::size_t segments = 0;
+		};
+	private:
+		using Segments = std::vector<std::shared_ptr<const Segment>>;
+		std::string path;
+		// Shared with the thread
+		std::mutex mutex;
+		std::condition_variable wake, done;
+		std::thread worker;
+		bool stopping = false, busy = false;
+		Memtable memtable;
+		std::size_t memtableSize = 0;
+		std::shared_ptr<const Memtable> frozen;
+		// The segments, newest first (replaced whole, so a lookup can keep the list it started with)
+		std::shared_ptr<const Segments> segments = std::make_shared<const Segments>();
+		// The log being appended to, the logs waiting for a flush, and the oldest log not in a segment
+		std::shared_ptr<Saves::AppendFile> log;
+		std::vector<std::shared_ptr<Saves::AppendFile>> retired;
+		std::uint64_t logNumber = 0, frozenLog = 0, firstLog = 0;
+		std::uint64_t appended = 0, durable = 0;
+		// The number of the next segment, and segments merged away whose files are still there
+		std::uint64_t nextSegment = 0;
+		std::vector<std::uint64_t> obsolete;
+		std::string failure;
+		Counters counters;
+		std::atomic<std::uint64_t> lookups{ 0 }, probed{ 0 }, skipped{ 0 };
+		// Creates a log and writes its header.
+		std::shared_ptr<Saves::AppendFile> startLog(const std::uint64_t& number) const {
+			auto file = std::make_shared<Saves::AppendFile>(logPath(path, number));
+			Writer header(false);
+			header.putBytes(std::string_view(logMagic, sizeof(logMagic)));
+			header.put32(storeVersion);
+			header.put64(number);
+			if (!file->append(header.getBytes()))
+				throw std::runtime_error("Can't write " + logPath(path, number));
+			return file;
+		}
+		// Writes the manifest: the segments, the oldest log to replay, and the files to remove.
+		void writeManifest(const Segments& live, const std::uint64_t& oldestLog, const std::uint64_t& next, const std::vector<std::uint64_t>& gone) const {
+			Writer out(false);
+			out.putBytes(std::string_view(manifestMagic, sizeof(manifestMagic)));
+			out.put32(storeVersion);
+			out.put64(next);
+			out.put64(oldestLog);
+			out.put32(static_cast<std::uint32_t>(live.size()));
+			for (const std::shared_ptr<const Segment>& segment : live)
+				out.put64(segment->getNumber());
+			out.put32(static_cast<std::uint32_t>(gone.size()));
+			for (const std::uint64_t& number : gone)
+				out.put64(number);
+			Saves::replaceFile(path, out.getBytes());
+		}
+		// Removes the files of merged segments (on Windows a file still mapped stays until the next try).
+		void removeObsolete() {
+			obsolete.erase(std::remove_if(obsolete.begin(), obsolete.end(), [this](const std::uint64_t& number) {
+				return std::remove(segmentPath(path, number).c_str()) == 0 || !Saves::exists(segmentPath(path, number));
+			}), obsolete.end());
+		}
+		// Replays a log into the memtable, up to an entry that didn't make it whole to disk.
+		void replay(const std::uint64_t& number) {
+			ItemSystem::Database::MappedFile file;
+			try {
+				file = ItemSystem::Database::MappedFile(logPath(path, number));
+			}
+			catch (const std::runtime_error&) {
+				return;
+			}
+			const unsigned char* data = file.getData();
+			if (file.getSize() < logHeaderSize || !std::equal(std::begin(logMagic), std::end(logMagic), data)) return;
+			for (std::size_t at = logHeaderSize; file.getSize() - at >= entryHeaderSize;) {
+				Reader head(data + at, entryHeaderSize);
+				std::uint32_t length = 0, flags = 0;
+				std::uint64_t sequence = 0, sum = 0;
+				head.get(length);
+				head.get(flags);
+				head.get(sequence);
+				head.get(sum);
+				at += entryHeaderSize;
+				if (length > file.getSize() - at || Saves::checksum(sequence, data + at, length) != sum) return;
+				Reader in(data + at, length);
+				while (in.getLeft() > 0) {
+					std::uint8_t op = 0;
+					std::string_view key, value;
+					in.get(op);
+					if (!in.getView(key) || !in.getView(value)) break;
+					apply(static_cast<Op>(op), key, value);
+				}
+				at += length;
+			}
+		}
+		// Puts a write in the memtable.
+		void apply(const Op& op, const std::string_view& key, const std::string_view& value) {
+			auto found = memtable.find(key);
+			if (found == memtable.end()) found = memtable.emplace(std::string(key), Value{ op, std::string() }).first;
+			found->second.op = op;
+			found->second.bytes.assign(value);
+			memtableSize += key.size() + value.size();
+		}
+		// Merges segments (newest first) into one, keeping the newest write of each key and dropping removed keys.
+		std::string merge(const Segments& inputs) const {
+			struct Cursor {
+				std::size_t at;
+				bool live;
+				Op op;
+				std::string_view key, value;
+			};
+			std::vector<Cursor> cursors(inputs.size(), Cursor{ segmentHeaderSize, false, Op::PUT, {}, {} });
+			for (std::size_t i = 0; i < inputs.size(); i++)
+				cursors[i].live = inputs[i]->next(cursors[i].at, cursors[i].op, cursors[i].key, cursors[i].value);
+			SegmentWriter out;
+			while (true) {
+				// The smallest key (the first cursor that has it is the newest)
+				std::size_t newest = cursors.size();
+				for (std::size_t i = 0; i < cursors.size(); i++)
+					if (cursors[i].live && (newest == cursors.size() || cursors[i].key < cursors[newest].key)) newest = i;
+				if (newest == cursors.size()) break;
+				const std::string_view key = cursors[newest].key;
+				if (cursors[newest].op == Op::PUT) out.add(Op::PUT, key, cursors[newest].value);
+				for (std::size_t i = cursors.size(); i-- > 0;)
+					if (cursors[i].live && cursors[i].key == key)
+						cursors[i].live = inputs[i]->next(cursors[i].at, cursors[i].op, cursors[i].key, cursors[i].value);
+			}
+			return out.finish();
+		}
+		// The thread: flushes the log in groups, writes frozen memtables out, and merges.
+		void work() {
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true) {
+				wake.wait(lock, [this] {
+					return stopping || appended > durable || !retired.empty() || (failure.empty() && (frozen != nullptr || segments->size() >= mergeAt));
+				});
+				if (appended > durable || !retired.empty()) {
+					// Let more batches join the group
+					if (!stopping) {
+						lock.unlock();
+						std::this_thread::sleep_for(groupWindow);
+						lock.lock();
+					}
+					const std::uint64_t upTo = appended;
+					std::vector<std::shared_ptr<Saves::AppendFile>> logs = std::move(retired);
+					retired.clear();
+					logs.push_back(log);
+					lock.unlock();
+					bool synced = true;
+					for (const std::shared_ptr<Saves::AppendFile>& file : logs)
+						synced = file->sync() && synced;
+					logs.clear();
+					lock.lock();
+					counters.syncs++;
+					if (!synced) failure = "Can't flush " + logPath(path, logNumber);
+					durable = std::max(durable, upTo);
+				}
+				if (frozen != nullptr && failure.empty()) {
+					// Write the frozen memtable out, then drop its logs
+					const std::shared_ptr<const Memtable> table = frozen;
+					const std::uint64_t number = nextSegment++, covered = frozenLog, oldest = firstLog;
+					busy = true;
+					lock.unlock();
+					std::string error;
+					try {
+						SegmentWriter out;
+						for (const auto& [key, value] : *table)
+							out.add(value.op, key, value.bytes);
+						Saves::replaceFile(segmentPath(path, number), out.finish());
+						auto live = std::make_shared<Segments>();
+						live->push_back(std::make_shared<const Segment>(path, number));
+						live->insert(live->end(), segments->begin(), segments->end());
+						writeManifest(*live, covered + 1, number + 1, obsolete);
+						lock.lock();
+						segments = std::move(live);
+						frozen.reset();
+						firstLog = covered + 1;
+						counters.flushes++;
+						lock.unlock();
+						for (std::uint64_t old = oldest; old <= covered; old++)
+							std::remove(logPath(path, old).c_str());
+					}
+					catch (const std::runtime_error& e) {
+						error = e.what();
+					}
+					lock.lock();
+					busy = false;
+					if (!error.empty()) failure = error;
+				}
+				if (!stopping && failure.empty() && segments->size() >= mergeAt) {
+					const std::shared_ptr<const Segments> inputs = segments;
+					const std::uint64_t number = nextSegment++, oldest = firstLog;
+					busy = true;
+					lock.unlock();
+					std::string error;
+					try {
+						Saves::replaceFile(segmentPath(path, number), merge(*inputs));
+						auto live = std::make_shared<Segments>(1, std::make_shared<const Segment>(path, number));
+						for (const std::shared_ptr<const Segment>& segment : *inputs)
+							obsolete.push_back(segment->getNumber());
+						writeManifest(*live, oldest, number + 1, obsolete);
+						lock.lock();
+						segments = std::move(live);
+						counters.merges++;
+						lock.unlock();
+					}
+					catch (const std::runtime_error& e) {
+						error = e.what();
+					}
+					lock.lock();
+					busy = false;
+					if (!error.empty()) failure = error;
+				}
+				// (Lookups still reading a merged segment keep it mapped)
+				removeObsolete();
+				done.notify_all();
+				if (stopping && appended == durable && retired.empty() && (frozen == nullptr || !failure.empty())) return;
+			}
+		}
+		// Throws what the thread couldn't do.
+		void check() {
+			if (!failure.empty()) {
+				const std::string reason = failure;
+				failure.clear();
+				throw std::runtime_error(reason);
+			}
+		}
+	public:
+		// ctor(s)
+		Engine() = default;
+		Engine(const Engine&) = delete;
+		Engine& operator=(const Engine&) = delete;
+		// dtor(s)
+		~Engine() {
+			close();
+		}
+		/* Opens (or creates) the store whose manifest is at a   *
+		* path: reads the segments, and replays the logs that   *
+		* aren't in one into the memtable.                      */
+		void open(const std::string& _path) {
+			close();
+			path = _path;
+			memtable.clear();
+			memtableSize = 0;
+			frozen.reset();
+			obsolete.clear();
+			firstLog = 0;
+			nextSegment = 0;
+			auto live = std::make_shared<Segments>();
+			if (Saves::exists(path)) {
+				const ItemSystem::Database::MappedFile manifest(path);
+				const unsigned char* data = manifest.getData();
+				if (manifest.getSize() < 28 || !std::equal(std::begin(manifestMagic), std::end(manifestMagic), data))
+					throw std::runtime_error("Not a store: " + path);
+				Reader in(data + sizeof(manifestMagic), manifest.getSize() - sizeof(manifestMagic));
+				std::uint32_t version = 0, count = 0;
+				in.get(version);
+				in.get(nextSegment);
+				in.get(firstLog);
+				in.get(count);
+				if (version > storeVersion) throw std::runtime_error("Store made by a newer version of the game: " + path);
+				if (count > in.getLeft() / 8) throw std::runtime_error("Damaged store manifest " + path);
+				for (std::uint32_t i = 0; i < count; i++) {
+					std::uint64_t number = 0;
+					in.get(number);
+					live->push_back(std::make_shared<const Segment>(path, number));
+				}
+				in.get(count);
+				if (count > in.getLeft() / 8) throw std::runtime_error("Damaged store manifest " + path);
+				obsolete.resize(count);
+				for (std::uint64_t& number : obsolete)
+					in.get(number);
+				removeObsolete();
+			}
+			else {
+				writeManifest(*live, 0, 0, obsolete);
+			}
+			segments = std::move(live);
+			// Replay the logs (the game may have stopped before their memtable was written out)
+			logNumber = firstLog;
+			for (; Saves::exists(logPath(path, logNumber)); logNumber++)
+				replay(logNumber);
+			log = startLog(logNumber);
+			appended = durable = 0;
+			stopping = false;
+			worker = std::thread(&Engine::work, this);
+		}
+		/* Writes a batch: appends it to the log in one write,   *
+		* then to the memtable (freezing it if it's full). The  *
+		* log reaches the disk a moment later (see flush()).    */
+		void write(const Batch& batch) {
+			if (batch.isEmpty()) return;
+			Writer writes(false);
+			for (const Batch::Write& write : batch.getWrites()) {
+				writes.put8(static_cast<std::uint8_t>(write.op));
+				writes.putString(write.key);
+				writes.putString(write.value);
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			if (log == nullptr) throw std::logic_error("The store isn't open");
+			check();
+			const std::string& records = writes.getBytes();
+			const std::uint64_t sequence = appended + 1;
+			Writer out(false);
+			out.put32(static_cast<std::uint32_t>(records.size()));
+			out.put32(0);
+			out.put64(sequence);
+			out.put64(Saves::checksum(sequence, reinterpret_cast<const unsigned char*>(records.data()), records.size()));
+			out.putBytes(records);
+			if (!log->append(out.getBytes()))
+				throw std::runtime_error("Can't write " + logPath(path, logNumber));
+			appended = sequence;
+			for (const Batch::Write& write : batch.getWrites())
+				apply(write.op, write.key, write.value);
+			counters.batches++;
+			counters.writes += batch.getWrites().size();
+			// Freeze a full memtable (unless the last one is still being written out)
+			if (memtableSize >= memtableLimit && frozen == nullptr) {
+				frozen = std::make_shared<const Memtable>(std::move(memtable));
+				memtable.clear();
+				memtableSize = 0;
+				frozenLog = logNumber;
+				retired.push_back(std::move(log));
+				log = startLog(++logNumber);
+			}
+			wake.notify_one();
+		}
+		void put(const std::string& key, const std::string& value) {
+			Batch batch;
+			batch.put(key, value);
+			write(batch);
+		}
+		void remove(const std::string& key) {
+			Batch batch;
+			batch.remove(key);
+			write(batch);
+		}
+		// Looks up a key, copying its value. Returns false if it isn't there.
+		bool get(const std::string& key, std::string& value) {
+			lookups.fetch_add(1, std::memory_order_relaxed);
+			std::shared_ptr<const Segments> search;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for (const Memtable* table : { static_cast<const Memtable*>(&memtable), frozen.get() }) {
+					if (table == nullptr) continue;
+					const auto found = table->find(key);
+					if (found == table->end()) continue;
+					if (found->second.op == Op::REMOVE) return false;
+					value = found->second.bytes;
+					return true;
+				}
+				search = segments;
+			}
+			for (const std::shared_ptr<const Segment>& segment : *search) {
+				if (!segment->mayContain(key)) {
+					skipped.fetch_add(1, std::memory_order_relaxed);
+					continue;
+				}
+				probed.fetch_add(1, std::memory_order_relaxed);
+				switch (segment->find(key, value)) {
+				case Segment::Found::PUT:
+					return true;
+				case Segment::Found::REMOVED:
+					return false;
+				case Segment::Found::MISSING:
+					break;
+				}
+			}
+			return false;
+		}
+		/* Waits until every batch is on disk and the thread is  *
+		* done writing out and merging. Throws                  *
+		* std::runtime_error if something couldn't be written.  */
+		void flush() {
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [this] {
+				return !worker.joinable() || !failure.empty()
+					|| (durable == appended && retired.empty() && !busy && frozen == nullptr && segments->size() < mergeAt);
+			});
+			check();
+		}
+		// Flushes the log and stops the thread (the memtable stays in the log until the next open).
+		void close() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!worker.joinable()) return;
+				stopping = true;
+			}
+			wake.notify_one();
+			worker.join();
+			std::lock_guard<std::mutex> lock(mutex);
+			log.reset();
+			segments = std::make_shared<const Segments>();
+		}
+		// Getter functions
+		Counters getCounters() {
+			std::lock_guard<std::mutex> lock(mutex);
+			Counters now = counters;
+			now.lookups = lookups.load(std::memory_order_relaxed);
+			now.probes = probed.load(std::memory_order_relaxed);
+			now.skips = skipped.load(std::memory_order_relaxed);
+			now.segments = segments->size();
+			return now;
+		}
+	};
+
+	/* Saves a character to a player's save slot (one       *
+	* batch), and loads one back (false if the slot is      *
+	* empty). Throws std::runtime_error as Saves does.      */
+	inline void save(Engine& store, const std::string& player, const std::uint32_t& slot, Character& character, const Accuracy& accuracy) {
+		store.put(key(player, slot), Saves::encode(character, accuracy));
+	}
+	inline bool load(Engine& store, const std::string& player, const std::uint32_t& slot, Character& character, Accuracy& accuracy,
+		const Item* (*find)(const unsigned short& id) = findItem) {
+		std::string bytes;
+		if (!store.get(key(player, slot), bytes)) return false;
+		Saves::decode(reinterpret_cast<const unsigned char*>(bytes.data()), bytes.size(), character, accuracy, find);
+		return true;
+	}
+}
+
+/* The Scenes namespace is the game's screens. Every       *
+* screen is a scene: render() writes it and handle()      *
+* takes one line the player typed and returns a           *
+* Transition (plain data) saying where to go next. A      *
+* Session keeps the scenes on a small fixed stack and     *
+* applies the transitions, so however long a game runs    *
+* neither the call stack nor memory grow. Sessions only   *
+* need lines (see Input), so they run the same from a     *
+* terminal, a script or a bot.                            */
+namespace Scenes
+{
+	// Every screen of the game.
+	enum class SceneID : unsigned char {
+		START, QUICKSTART,
+		CHARGEN, NAME, CLASS, RACE,
+		ORIGIN, PROFESSION, NECROMANCER, WEAPON_SKILL, FATHER, CONFIRM,
+		HOME, EXPLORE, FIGHT, FIGHT_ITEMS, LEVEL_UP, LEVEL_AMOUNT,
+		WORKSHOP, BLACKMARKET, SHOP, BUY_AMOUNT, SELL, SELL_AMOUNT,
+		INVENTORY, WEAPONS, CONSUMABLES, USE_AMOUNT,
+		PAUSE
+	};
+	constexpr std::size_t sceneCount = static_cast<std::size_t>(SceneID::PAUSE) + 1;
+	/* The Transition struct is where a scene goes next:     *
+	* stay (drawn again), push a scene on top, replace      *
+	* itself, pop back to the scene below, or quit. Paused  *
+	* transitions put "Press ENTER" on top afterwards.      */
+	struct Transition {
+		enum class Kind : unsigned char {
+			STAY, PUSH, REPLACE, POP, QUIT
+		};
+		Kind kind = Kind::STAY;
+		SceneID scene = SceneID::PAUSE;
+		bool pause = false;
+		static Transition stay() {
+			return Transition{};
+		}
+		static Transition push(const SceneID& scene) {
+			return Transition{ Kind::PUSH, scene };
+		}
+		static Transition replace(const SceneID& scene) {
+			return Transition{ Kind::REPLACE, scene };
+		}
+		static Transition pop() {
+			return Transition{ Kind::POP };
+		}
+		static Transition quit() {
+			return Transition{ Kind::QUIT };
+		}
+		// The same transition, then a pause.
+		Transition paused() const {
+			Transition next = *this;
+			next.pause = true;
+			return next;
+		}
+	};
+	class Session;
+	/* The Input struct is where a session's lines come      *
+	* from: the TERMINAL (cin), a SCRIPT (the lines of a    *
+	* file or a string, read up front), or a POLICY that    *
+	* picks each line from the scene it is shown (a bot).   *
+	* Echoed input prints each line it gives, so a script's *
+	* transcript reads like a typed game.                   */
+	struct Input {
+		enum class Kind : unsigned char {
+			TERMINAL, SCRIPT, POLICY
+		};
+		Kind kind = Kind::TERMINAL;
+		bool echo = false;
+		std::string text;
+		std::size_t position = 0;
+		std::string(*policy)(Session& session, Randomness::Stream& random) = nullptr;
+		Randomness::Stream random;
+		static Input terminal() {
+			return Input{};
+		}
+		static Input script(const std::string& _text, const bool& _echo = false) {
+			Input input;
+			input.kind = Kind::SCRIPT;
+			input.text = _text;
+			input.echo = _echo;
+			return input;
+		}
+		static Input file(const std::string& path, const bool& _echo = true) {
+			std::ifstream in(path, std::ios::binary);
+			if (!in) throw std::runtime_error("Can't open " + path);
+			return script(std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()), _echo);
+		}
+		static Input automatic(std::string(*_policy)(Session& session, Randomness::Stream& random), const Randomness::Stream& _random) {
+			Input input;
+			input.kind = Kind::POLICY;
+			input.policy = _policy;
+			input.random = _random;
+			return input;
+		}
+		// Gets the next line for a session (false once there are none).
+		bool next(Session& session, std::string& line);
+	};
+	/* The Session class is one player's game: it runs the   *
+	* scenes, and holds the character and everything the    *
+	* scenes in progress are working on (the fight, the     *
+	* shop, the chosen slot, the points left to spend).     *
+	* Nothing about a game lives outside its session, so a  *
+	* process can host as many as it likes. The screens go  *
+	* to the session's stream (cout, or a connection).      */
+	class Session {
+	private:
+		// Deep enough for Home > Black Market > Shop > amount > pause
+		static constexpr std::size_t maxDepth = 8;
+		std::array<SceneID, maxDepth> stack{};
+		std::size_t depth = 0;
+		// Whether the screens are on the terminal (which clears between them)
+		bool terminal;
+		void push(const SceneID& scene) {
+			if (depth == maxDepth) throw std::logic_error("Scenes are nested too deep");
+			stack[depth++] = scene;
+		}
+		void render();
+	public:
+		std::ostream& out;
+		Character character;
+		Accuracy accuracy;
+		Combat::State fight{};
+		std::size_t description = 0, monster = 0;
+		const Shop* shop = nullptr;
+		const Consumable* item = nullptr;
+		unsigned int slot = 0;
+		std::vector<unsigned int> slots;
+		int levelsLeft = 0;
+		int stat = 0;
+		Leveling::Allocation points{};
+		// Where the game is saved as it plays (nullptr for no autosaves), and the save's file
+		Saves::Journal* journal = nullptr;
+		std::string savePath = Saves::defaultPath;
+		// A store of many players' saves to save in instead (nullptr for none), and the player's name in it
+		Store::Engine* store = nullptr;
+		std::string player;
+		// Whether the player is waiting on a save, and what the next Home screen should say about it
+		bool saving = false;
+		std::string notice;
+		// ctor(s)
+		explicit Session(std::ostream& _out = cout, const bool& _terminal = true)
+			: terminal(_terminal), out(_out) { }
+		// Starts at a scene (and draws it).
+		void start(const SceneID& first) {
+			depth = 0;
+			push(first);
+			render();
+		}
+		// Gives the top scene a line, then draws where it leads.
+		void handle(const std::string& line);
+		// Plays until the session ends or the input runs out (or maxLines lines). Returns the lines played.
+		std::uint64_t play(Input& input, const std::uint64_t& maxLines = std::numeric_limits<std::uint64_t>::max());
+		// Clears the screen (when it's the terminal).
+		void clear() {
+			if (terminal) ClearScreen();
+		}
+		// Getter functions
+		bool isRunning() const {
+			return depth > 0;
+		}
+		SceneID getScene() const {
+			return stack[depth - 1];
+		}
+	};
+	inline bool Input::next(Session& session, std::string& line) {
+		switch (kind) {
+		case Kind::TERMINAL:
+			return static_cast<bool>(std::getline(cin, line));
+		case Kind::SCRIPT: {
+			if (position >= text.size()) return false;
+			std::size_t end = text.find('\n', position);
+			if (end == std::string::npos) end = text.size();
+			line.assign(text, position, end - position);
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			position = end + 1;
+			break;
+		}
+		case Kind::POLICY:
+			line = policy(session, random);
+			break;
+		}
+		if (echo) session.out << line << endl;
+		return true;
+	}
+
+	// Reads a whole number from a line (-1 if there isn't one).
+	inline int number(const std::string& line) {
+		std::size_t i = 0;
+		while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i]))) i++;
+		const std::size_t start = i;
+		if (i < line.size() && (line[i] == '-' || line[i] == '+')) i++;
+		long long value = 0;
+		bool digits = false;
+		while (i < line.size() && std::isdigit(static_cast<unsigned char>(line[i]))) {
+			value = std::min(value * 10 + (line[i] - '0'), static_cast<long long>(std::numeric_limits<int>::max()));
+			digits = true;
+			i++;
+		}
+		if (!digits) return -1;
+		return line[start] == '-' ? -static_cast<int>(value) : static_cast<int>(value);
+	}
+	// Reads the first word of a line.
+	inline std::string word(const std::string& line) {
+		std::size_t begin = 0;
+		while (begin < line.size() && std::isspace(static_cast<unsigned char>(line[begin]))) begin++;
+		std::size_t end = begin;
+		while (end < line.size() && !std::isspace(static_cast<unsigned char>(line[end]))) end++;
+		return line.substr(begin, end - begin);
+	}
+
+	// Journals what changed (if the game is being saved).
+	inline void autosave(Session& session) {
+		if (session.journal == nullptr || !session.journal->isOpen()) return;
+		try {
+			session.journal->commit(session.character, session.accuracy);
+		}
+		catch (const std::runtime_error& e) {
+			session.out << "Autosave failed: " << e.what() << endl;
+		}
 	}
-	cin >> input;
-	if (input == 0) {
 
+	// Start
+	inline void renderStart(Session& session) {
+		session.out << "-*- Bones -*-\n1) Start\n2) Load" << endl;
+	}
+	inline Transition handleStart(Session& session, const std::string& line) {
+		switch (number(line)) {
+		case 1:
+			return Transition::replace(SceneID::CHARGEN);
+		case 2:
+			try {
+				// From the player's slot in the store (if there is one)
+				if (session.store != nullptr) {
+					if (!Store::load(*session.store, session.player, 0, session.character, session.accuracy)) {
+						session.out << "There's no saved game." << endl;
+						return Transition::stay().paused();
+					}
+					return Transition::replace(SceneID::HOME);
+				}
+				Saves::load(session.character, session.accuracy, session.savePath);
+				// Keep saving from here (folding the journals into a new save)
+				if (session.journal != nullptr) session.journal->open(session.savePath, session.character, session.accuracy);
+			}
+			catch (const std::runtime_error& e) {
+				session.out << e.what() << endl;
+				return Transition::stay().paused();
+			}
+			return Transition::replace(SceneID::HOME);
+		case 3267:
+			session.out << "Quickstart activated. Giving DEV Weapon." << endl;
+			session.character.inventory.addItem(WeaponTable.generate("Modal Soul"));
+			session.character.equip(session.character.inventory.getHandle(0));
+			session.character.dust = 99999;
+			return Transition::replace(SceneID::QUICKSTART);
+		}
+		return Transition::quit();
 	}
-	else if (input != 0) {
-		Charac.equipped = const_cast<Weapon*>(dynamic_cast<const Weapon*>(Charac.inventory.inspectItem(input - 1)));
-		weaponinv();
+	inline void renderQuickstart(Session&) {}
+	inline Transition handleQuickstart(Session& session, const std::string& line) {
+		session.character.dad = word(line);
+		session.character.seed = Randomness::seedFromText(session.character.dad);
+		session.character.inventory.addItem(ConsumableTable.generate("Normal Health Potion"));
+		session.character.inventory.addItem(ConsumableTable.generate("Normal Health Potion"));
+		session.character.inventory.addItem(ConsumableTable.generate("Greater Health Potion"));
+		session.character.inventory.addItem(ConsumableTable.generate("Super Health Potion"));
+		return Transition::replace(SceneID::HOME).paused();
 	}
-}
 
-void statcheck() {
-	if (Charac.maxHP > Charac.hp) {
-		Charac.hp = Charac.maxHP;
+	// Character generation
+	inline void renderChargen(Session& session) {
+		session.clear();
+		session.out << "-*- Character Generation -*-" << endl;
+		session.out << "1) Name" << endl;
+		session.out << "2) Class" << endl;
+		session.out << "3) Race" << endl;
+		session.out << "4) Continue to Past Selection" << endl;
+		session.out << "\n-*- Current Skeleton -*-" << endl;
+		session.out << "Name: " << session.character.name << "\nRace: " << session.character.race << "\nClass: " << session.character.clas << endl;
+		session.out << "\n-*- Stats -*- \nStrength: " << session.character.str << "\nDefense: " << session.character.def << "\nIntelligence: " << session.character.itl << "\nSpeed: " << session.character.spd << "\nCritical Chance: " << session.character.crt << endl;
+	}
+	inline Transition handleChargen(Session& session, const std::string& line) {
+		switch (number(line)) {
+		case 1:
+			return Transition::push(SceneID::NAME);
+		case 2:
+			return Transition::push(SceneID::CLASS);
+		case 3:
+			session.character.str = 1;
+			session.character.itl = 1;
+			session.character.def = 1;
+			session.character.crt = 1;
+			session.character.spd = 1;
+			return Transition::push(SceneID::RACE);
+		case 4:
+			if (session.character.race == "None" || session.character.clas == "None") {
+				session.out << "You cannot do that." << endl;
+				return Transition::stay().paused();
+			}
+			return Transition::replace(SceneID::ORIGIN);
+		}
+		return Transition::stay();
 	}
-	if (Charac.maxMP > Charac.mp) {
-		Charac.mp = Charac.maxMP;
+	inline void renderName(Session& session) {
+		session.out << "Input your name. No Spaces." << endl;
 	}
-}
-
-void consuminv() {
-	unsigned int index = 0;
-	cout << "0) Exit" << endl;
-	// Filter inventory into vector.
-	std::vector<std::pair<Consumable*, unsigned int>> filtered;
-	for (const auto& item : Charac.inventory.getAll()) {
-		if (item.getItem()->getCategory() == Category::CONSUMABLE) {
-			auto consumable = const_cast<Consumable*>(dynamic_cast<const Consumable*>(item.getItem().get()));
-			filtered.push_back(std::make_pair(consumable, index));
-			std::cout << filtered.size() << ") " << consumable->getName() << " x" << item.getStackAmount() << std::endl;
-		}
-		index++;
-	}
-	// Get input;
-	unsigned int userInput;
-	std::cin >> userInput;
-	if (userInput == 0) return;
-	userInput--;
-	// Take item and use it.
-	unsigned int takenInput = filtered.at(userInput).second;
-	auto takenItem = filtered.at(userInput).first;
-	Charac.hp += takenItem->getHealth();
-	Charac.mp += takenItem->getMana();
-	// Print info.
-	std::cout << "You restore " << takenItem->getHealth() << " HP and " << takenItem->getMana() << " MP!" << endl;
-	Charac.inventory.deleteItem(takenInput);
-	statcheck();
-	wait_enter();
-}
-
-void inventory() {
-	ClearScreen();
-	cout << "-*- Stats -*-\n\nName: " << Charac.name << "\nRace: " << Charac.race << "\nClass: " << Charac.clas << "\nProfession: " << Charac.profession << "\n\nMax Health: " << Charac.maxHP << "\nMax Mana: " << Charac.maxMP << "\n\nCurrent HP: " << Charac.hp << "\nCurrent MP: " << Charac.mp << "\n\nStrength: " << Charac.str << "\nDefense: " << Charac.def << "\nIntelligence: " << Charac.itl << "\nSpeed: " << Charac.spd << "\nCritical Chance: " << Charac.crt << "\n\nDifficulty: " << Charac.difficultyN << "\nDifficulty Multiplier: " << Charac.difficultyD << "x" << endl;
-	cout << "\nEXP To Next Level: " << ((Charac.lvl * 50 * Charac.difficultyD) * Charac.expmultiplier) - Charac.exp << endl;
-	cout << "\n0) Exit\n1) Weapons\n2) Consumables" << endl;
-	cin >> input;
-	switch (input) {
-	case 0:
-		break;
-	case 1:
-		weaponinv();
-		break;
-	case 2:
-		consuminv();
-		break;
-
+	inline Transition handleName(Session& session, const std::string& line) {
+		if (word(line).empty()) return Transition::stay();
+		session.character.name = word(line);
+		return Transition::pop();
+	}
+	inline void renderClass(Session& session) {
+		session.clear();
+		session.out << "-*- Classes -*-" << endl;
+		session.out << "1) Skeleton Warrior - \nA warrior with more attack spells\n\n2) Skeleton Mage - \nA mage with destructive and healing powers\n\n3) Skeleton Warlock - \nA dangerous class with more spells focusing on damage\n\n4) Bone Baron -\nA skeleton with no spells, only melee" << endl;
+	}
+	inline Transition handleClass(Session& session, const std::string& line) {
+		const int choice = number(line);
+		if (choice < 1 || choice > 4) {
+			session.out << "You cannot do that." << endl;
+			return Transition::pop().paused();
+		}
+		session.character.clas = classNames[choice - 1];
+		return Transition::pop();
+	}
+	inline void renderRace(Session& session) {
+		session.clear();
+		session.out << "-*- Race -*-" << endl;
+		session.out << "1) Human Skeleton - \n+3 Str || +2 Def\n\n2) Kobold Skeleton -\n+3 Crt || +2 Spd\n\n3) Bone Dragonborn - \n+5 Str \n\n4) Skeleton Scholar - \n+4 Itl || +1 Spd \n\n5) Coag Skeleton - \n+5 Def\n\n6) Dust Skeleton - \n+1 All" << endl;
+	}
+	inline Transition handleRace(Session& session, const std::string& line) {
+		const int choice = number(line);
+		if (choice >= 1 && choice <= 6)
+			applyRace(session.character, choice);
+		return Transition::pop();
 	}
-}
-
 
-/*
-void Enemygen() {
-	Enemy.elvl = rand() % Charac.lvl * Charac.difficultyD;
-	Enemy.estr = rand() % Charac.str + Charac.lvl * Charac.difficultyD;
-	Enemy.eitl = rand() % Charac.itl + Charac.lvl * Charac.difficultyD;
-	Enemy.edef = rand() % Charac.def + Charac.lvl * Charac.difficultyD;
-	Enemy.espd = rand() % Charac.spd + Charac.lvl * Charac.difficultyD;
-	Enemy.ecrt = rand() % Charac.crt + Charac.lvl;
-	if (Enemy.estr < 1) {
-		Enemy.estr = 1;
-	}
-	if (Enemy.eitl < 1) {
-		Enemy.eitl = 1;
-	}
-	if (Enemy.edef < 1) {
-		Enemy.edef = 1;
-	}
-	if (Enemy.espd < 1) {
-		Enemy.espd = 1;
-	}
-	Enemy.maxeHP = (Enemy.estr * 2) + (Enemy.edef * 3) + Enemy.elvl * 2 * Charac.difficultyD;
-	Enemy.maxeMP = (Enemy.estr) - (Enemy.edef) + (Enemy.eitl + 2) + Enemy.elvl;
-	if (Enemy.maxeMP < 1) {
-		Enemy.maxeMP = 1;
-	}
-	if (Enemy.ecrt > 100) {
-		Enemy.ecrt = 100;
-	}
-	if (Enemy.maxeHP < 9) {
-		Enemy.maxeHP = 10;
-	}
-	if (Enemy.elvl < 1) {
-		Enemy.elvl = 1;
-	}
-	Enemy.emp = Enemy.maxeMP;
-	Enemy.ehp = Enemy.maxeHP;
-	Enemy.eheadhp = 1.00;
-	Enemy.echesthp = 1.00;
-	Enemy.erightarmhp = 1.00;
-	Enemy.eleftarmhp = 1.00;
-	Enemy.erightleghp = 1.00;
-	Enemy.eleftleghp = 1.00;
-}
+	// Past selection
+	inline void renderOrigin(Session& session) {
+		session.clear();
+		session.out << "-*- Past Selection -*-" << endl;
+		session.out << "Q1) Where did you come from?\n1) Fields of Forgiveness (Easiest)\n2) Dusty Farms (Easy)\n3) Scorched Forest (Normal)\n4) Corrupted Pastures (Hard)\n5) Doomed Lands (Doom)\n6) The Gates of Hell (Brutal)" << endl;
+	}
+	inline Transition handleOrigin(Session& session, const std::string& line) {
+		int choice = number(line);
+		if (choice < 1 || choice > 6) {
+			session.out << "That choice does not exist... Defaulting to 3. (Normal Difficulty)" << endl;
+			choice = 3;
+		}
+		applyOrigin(session.character, choice);
+		return Transition::replace(SceneID::PROFESSION);
+	}
+	inline void renderProfession(Session& session) {
+		session.clear();
+		session.out << "Q2) What was your past profession?\n1) Fighter\n2) Summoner\n3) Hunter\n4) Scout\n5) Soldier" << endl;
+	}
+	inline Transition handleProfession(Session& session, const std::string& line) {
+		int choice = number(line);
+		if (choice < 1 || choice > 5) {
+			session.out << "That choice does not exist... Defaulting to 1." << endl;
+			choice = 1;
+		}
+		applyProfession(session.character, session.accuracy, choice);
+		return Transition::replace(SceneID::NECROMANCER);
+	}
+	inline void renderNecromancer(Session& session) {
+		session.clear();
+		session.out << "Q3) By whom were you necromanced?\n1) A Necromancer\n2) A Friend\n3) No-one." << endl;
+	}
+	inline Transition handleNecromancer(Session& session, const std::string& line) {
+		int choice = number(line);
+		if (choice < 1 || choice > 3) {
+			session.out << "That choice does not exist... Defaulting to 1." << endl;
+			choice = 1;
+		}
+		applyNecromancer(session.character, choice);
+		return Transition::replace(SceneID::WEAPON_SKILL);
+	}
+	inline void renderWeaponSkill(Session& session) {
+		session.clear();
+		session.out << "Q4) What weapon were you skilled with?\n1) Bow\n2) Sword\n3) Staff\n4) Fists." << endl;
+	}
+	inline Transition handleWeaponSkill(Session& session, const std::string& line) {
+		int choice = number(line);
+		if (choice < 1 || choice > 4) {
+			session.out << "That choice does not exist... Defaulting to 1." << endl;
+			choice = 1;
+		}
+		applyWeaponSkill(session.character, choice);
+		return Transition::replace(SceneID::FATHER);
+	}
+	inline void renderFather(Session& session) {
+		session.clear();
+		session.out << "Q10) Finally, what is your father's name? (No Spaces)" << endl;
+	}
+	inline Transition handleFather(Session& session, const std::string& line) {
+		if (word(line).empty()) return Transition::stay();
+		session.character.dad = word(line);
+		session.character.seed = Randomness::seedFromText(session.character.dad);
+		rollStartingStats(session.character);
+		return Transition::replace(SceneID::CONFIRM);
+	}
+	inline void renderConfirm(Session& session) {
+		session.clear();
+		session.out << "Do these stats look ok?\n\nName: " << session.character.name << "\nRace: " << session.character.race << "\nClass: " << session.character.clas << "\nProfession: " << session.character.profession << "\n\nMax Health: " << session.character.maxHP << "\nMax Mana: " << session.character.maxMP << "\n\nStrength: " << session.character.str << "\nDefense: " << session.character.def << "\nIntelligence: " << session.character.itl << "\nSpeed: " << session.character.spd << "\nCritical Chance: " << session.character.crt << "\n\nDifficulty: " << session.character.difficultyN << endl;
+		session.out << "\n1) Yes \n2) No" << endl;
+	}
+	inline Transition handleConfirm(Session& session, const std::string& line) {
+		switch (number(line)) {
+		case 1:
+			session.character.maxHP = session.character.hp;
+			session.character.maxMP = session.character.mp;
+			session.character.inventory.addItem(WeaponTable.generate("Stick"));
+			session.character.equip(session.character.inventory.getHandle(0));
+			return Transition::replace(SceneID::HOME);
+		case 2:
+			session.character.str = 1;
+			session.character.def = 1;
+			session.character.itl = 1;
+			session.character.spd = 1;
+			session.character.crt = 1;
+			session.character.strprof = 1.00;
+			session.character.defprof = 1.00;
+			session.character.spdprof = 1.00;
+			session.character.itlprof = 1.00;
+			session.character.bowprof = 1.00;
+			session.character.swordprof = 1.00;
+			session.character.staffprof = 1.00;
+			session.character.unarmedprof = 1.00;
+			session.accuracy.headdamagex = 2;
+			session.accuracy.chestdamagex = 1;
+			session.accuracy.rightarmdamagex = 1;
+			session.accuracy.leftarmdamagex = 1;
+			session.accuracy.rightlegdamagex = 1;
+			session.accuracy.leftlegdamagex = 1;
+			session.character.race = "None";
+			session.character.clas = "None";
+			return Transition::replace(SceneID::CHARGEN);
+		}
+		return Transition::stay();
+	}
 
-void victory() {
-	int randint;
-	randint = rand() % 15 + Enemy.elvl;
-	cout << "You find " << randint << " dust." << endl;
-	Charac.dust += randint;
-	randint = ((Enemy.maxeHP + Enemy.estr + Enemy.edef + Enemy.eitl + Enemy.espd) * Enemy.elvl) / Charac.difficultyD;
-	cout << "You earned " << randint << " experience!" << endl;
-	Charac.exp += randint;
-	while (Charac.exp > (int)((Charac.lvl * 50 * Charac.difficultyD)) * Charac.expmultiplier) {
-		Charac.lvl++;
-		Charac.expmultiplier += .25;
-		cout << "You leveled! Current Level: " << Charac.lvl << endl;
-		cout << "What would to like increase?" << endl;
-		cout << "1) Strength: " << Charac.str << "\n2) Intelligence: " << Charac.itl << "\n3) Speed: " << Charac.spd << "\n4) Defense: " << Charac.def << endl;
-		cin >> input;
-		if (input < 1 || input > 4) {
-			cout << "Not a valid option, putting point into strength." << endl;
-			randint = rand() % 2 + 1;
-			Charac.str += randint;
-		}
-		else if (input >= 1 || input <= 4) {
-			switch (input) {
-			case 1:
-				randint = rand() % 2 + 1;
-				Charac.str += randint;
-				break;
-			case 2:
-				randint = rand() % 2 + 1;
-				Charac.itl += randint;
-				break;
-			case 3:
-				randint = rand() % 2 + 1;
-				Charac.spd += randint;
-				break;
-			case 4:
-				randint = rand() % 2 + 1;
-				Charac.def += randint;
-				break;
+	// Home
+	inline void renderHome(Session& session) {
+		session.clear();
+		session.out << "-*- Home -*-" << endl;
+		session.out << "1) Explore\n2) Workshop\n3) Black Market\n4) Inventory\n5) Save" << endl;
+		session.out << "\n-*- Quick Stats -*-\nHP: " << session.character.hp << "        MP: " << session.character.mp << "\nDust: " << session.character.dust << endl;
+		if (!session.notice.empty()) {
+			session.out << "\n" << session.notice << endl;
+			session.notice.clear();
+		}
+	}
+	inline Transition handleHome(Session& session, const std::string& line) {
+		switch (number(line)) {
+		case 1: {
+			// Every fight gets its own random stream
+			Combat::Random random(session.character.seed, Randomness::streamID(Randomness::Subsystem::COMBAT, session.character.fights++));
+			const Combat::Fighter player = toFighter(session.character);
+			const Combat::Fighter enemy = Combat::generateEnemy(player, session.character.difficultyD, random);
+			session.description = random.below(10);
+			session.monster = random.below(10);
+			session.fight = Combat::State{ player, enemy, random };
+			return Transition::push(SceneID::EXPLORE);
+		}
+		case 2:
+			if (!session.character.workshopfirst) {
+				session.clear();
+				session.out << "You start to dig into a grave. It gives off a soft glow as you dig into the \ndirt.The dirt is thrown to the side and a door is revealed.\nYou open it to see tables, blueprints, and workstations littered around the \ndimly lit room. You pick up a blueprint and read it, it seems to focus on Dust.\nThe blueprint is for a body modification, allowing the user to withstand more \ndamage. You take it and look around for more blueprints." << endl;
+				session.character.workshopfirst = true;
+				return Transition::push(SceneID::WORKSHOP).paused();
+			}
+			return Transition::push(SceneID::WORKSHOP);
+		case 3:
+			if (!session.character.blackmarketfirst) {
+				session.clear();
+				session.out << "You lift up the lid to the underground... You can only see a single door\nA swarm of security drones flock to you and take your picture.\nThe door opens and reveals an underground society, the lights are blinding.\nYou look around and see a few shops, offering items for dust." << endl;
+				session.character.blackmarketfirst = true;
+				return Transition::push(SceneID::BLACKMARKET).paused();
+			}
+			return Transition::push(SceneID::BLACKMARKET);
+		case 4:
+			return Transition::push(SceneID::INVENTORY);
+		case 5:
+			try {
+				// A full save (written in the background), and autosaves from then on
+				if (session.store != nullptr) {
+					Store::save(*session.store, session.player, 0, session.character, session.accuracy);
+					session.out << "Game saved." << endl;
+				}
+				else if (session.journal != nullptr) {
+					session.journal->open(session.savePath, session.character, session.accuracy);
+					session.saving = true;
+					session.out << "Saving..." << endl;
+				}
+				else {
+					Saves::save(session.character, session.accuracy, session.savePath);
+					session.out << "Game saved." << endl;
+				}
 			}
+			catch (const std::runtime_error& e) {
+				session.out << e.what() << endl;
+			}
+			return Transition::stay().paused();
 		}
+		return Transition::stay();
 	}
-	wait_enter();
-	home();
-}
-
-void deathcheck() {
-	if (Charac.hp <= 0) {
-		cout << "You fall over, defeated." << endl;
-		exit(0);
 
+	// Exploring and fighting
+	inline void renderExplore(Session& session) {
+		const string exploredesc[10] = { "While walking around the graveyard, you see ", "As you walk around the graveyard, you see ", "While you were walking around the graveyard, you see ", "When you were walking around the graveyard, you saw ", "As you explored the surrounding forest, you saw ", "While exploring the surrounding forest, you saw ", "During your patrol of the surrounding area, you saw ", "You see something guarding the gate, it is ", "Taking a look around the graveyard, you see ", "While wandering, you see " };
+		const string exploremonn[10] = { "a Skeleton", "a Man Wearing a Dinosaur Costume", "a Demon", "a Tiefling", "an Orc", "a Goblin", "a Troll", "a Cyborg-Guardian", "a Cultist", "a Bandit" };
+		session.out << exploredesc[session.description] << exploremonn[session.monster] << "\nSizing up the creature, you can see it has approximately..." << endl;
+		session.out << session.fight.enemy.hp << " Max Health...\n" << session.fight.enemy.mp << " Max Mana...\n" << endl;
+		session.out << "1) Attack\n2) Return Back Home" << endl;
 	}
-	if (Enemy.ehp <= 0) {
-		cout << "The enemy dies, you win!" << endl;
-		victory();
+	inline Transition handleExplore(Session&, const std::string& line) {
+		if (number(line) == 1) return Transition::replace(SceneID::FIGHT);
+		return Transition::pop();
 	}
-}
-
-
-void playerTurn() {
-	int acchit;
-	int randamage;
-	int randint;
-	double bodydamage = .1;
-	bool battlemenu = true;
-	Acc.head = rand() % 100;
-	while (battlemenu == true) {
-		deathcheck();
-		cout << "HP: " << Charac.hp << "      Enemy HP: " << Enemy.ehp << "\nMP: " << Charac.mp << "      Enemy MP: " << Enemy.emp << endl;
-		cout << "\n1) Attack\n2) Cast\n3) Inventory\n4) Run" << endl;
-		cin >> input;
+	// Rolls the character's level up points once they're placed, and shows the gains.
+	inline Transition levelUp(Session& session, const Leveling::Allocation& points) {
+		// Each level up rolls from its own stream
+		Randomness::Stream random(session.character.seed, Randomness::streamID(Randomness::Subsystem::LEVELING, session.character.lvl));
+		const Leveling::Allocation gains = Leveling::roll(points, random);
+		session.character.str += gains[0];
+		session.character.itl += gains[1];
+		session.character.spd += gains[2];
+		session.character.def += gains[3];
+		const string statNames[Leveling::statCount] = { "Strength", "Intelligence", "Speed", "Defense" };
+		for (std::size_t i = 0; i < Leveling::statCount; i++)
+			if (gains[i] > 0) session.out << statNames[i] << " +" << gains[i] << endl;
+		autosave(session);
+		return Transition::pop().paused();
 	}
-}
-
-void enemyTurn() {
-	int acchit;
-	int randamage;
-	int randint;
-	randint = rand() % 50;
-
-}
-
-void decideTurn() {
-	unsigned int turnSpeed = Charac.spd + (rand() % 5 + 1);
-	// Get enemy turn speed.
-	unsigned int enemyTurnSpeed = Enemy.espd + (rand() % 5 + 1);
-	if (turnSpeed > enemyTurnSpeed) {
-		playerTurn();
+	// Gives the rewards of a won fight, and levels the character up (asking where the points go, if the policy does).
+	inline Transition victory(Session& session, const Combat::Rewards& rewards) {
+		session.out << "You find " << rewards.dust << " dust." << endl;
+		session.character.dust += rewards.dust;
+		session.out << "You earned " << rewards.exp << " experience!" << endl;
+		session.character.exp += rewards.exp;
+		const int levels = Leveling::levelsFor(session.character.exp, session.character.lvl, session.character.difficultyD, session.character.expmultiplier);
+		if (levels == 0) return Transition::pop().paused();
+		session.character.lvl += levels;
+		session.character.expmultiplier = Leveling::multiplierAfter(session.character.expmultiplier, levels);
+		session.out << "You leveled! Current Level: " << session.character.lvl << endl;
+		if (session.character.leveling.kind == Leveling::Policy::Kind::ASK) {
+			session.levelsLeft = levels;
+			session.points = Leveling::Allocation{};
+			return Transition::replace(SceneID::LEVEL_UP);
+		}
+		return levelUp(session, session.character.leveling.allocate(levels));
+	}
+	// Plays a round, then goes on fighting or ends the fight.
+	inline Transition takeTurn(Session& session, const Combat::Action& action) {
+		const Combat::Turn turn = Combat::step(session.fight, action);
+		// Used items come out of the inventory
+		if (action.type == Combat::Action::Type::USE)
+			session.character.inventory.deleteItem(session.character.inventory.getSlotIndex(action.item->getID()));
+		showEvents(session.out, turn.events);
+		session.fight = turn.state;
+		if (session.fight.outcome == Combat::Outcome::ONGOING)
+			return Transition::replace(SceneID::FIGHT);
+		keepFighter(session.character, session.fight.player);
+		switch (session.fight.outcome) {
+		case Combat::Outcome::LOST:
+			session.out << "You fall over, defeated." << endl;
+			return Transition::quit();
+		case Combat::Outcome::WON: {
+			session.out << "The enemy dies, you win!" << endl;
+			const Transition next = victory(session, Combat::reward(session.fight.enemy, session.character.difficultyD, session.fight.random));
+			autosave(session);
+			return next;
+		}
+		default:
+			autosave(session);
+			return Transition::pop().paused();
+		}
 	}
-	else {
-		enemyTurn();
+	inline void renderFight(Session& session) {
+		session.out << "\nHP: " << session.fight.player.hp << "      Enemy HP: " << session.fight.enemy.hp << "\nMP: " << session.fight.player.mp << "      Enemy MP: " << session.fight.enemy.mp << endl;
+		session.out << "\n1) Attack\n2) Cast\n3) Inventory\n4) Run" << endl;
+	}
+	inline Transition handleFight(Session& session, const std::string& line) {
+		switch (number(line)) {
+		case 1:
+			return takeTurn(session, Combat::Action{ Combat::Action::Type::ATTACK });
+		case 2:
+			return takeTurn(session, Combat::Action{ Combat::Action::Type::CAST });
+		case 3:
+			return Transition::replace(SceneID::FIGHT_ITEMS);
+		case 4:
+			return takeTurn(session, Combat::Action{ Combat::Action::Type::RUN });
+		}
+		return Transition::stay();
+	}
+	inline void renderFightItems(Session& session) {
+		session.out << "0) Exit" << endl;
+		const std::vector<unsigned int>& consumables = session.character.inventory.getCategory<Consumable>();
+		for (std::size_t i = 0; i < consumables.size(); i++)
+			session.out << i + 1 << ") " << session.character.inventory.inspectItem(consumables[i])->getName() << " x" << session.character.inventory.inspectSlot(consumables[i])->getStackAmount() << endl;
+	}
+	inline Transition handleFightItems(Session& session, const std::string& line) {
+		const int choice = number(line);
+		const std::vector<unsigned int>& consumables = session.character.inventory.getCategory<Consumable>();
+		if (choice < 1 || choice > static_cast<int>(consumables.size())) return Transition::replace(SceneID::FIGHT);
+		return takeTurn(session, Combat::Action{ Combat::Action::Type::USE, session.character.inventory.inspectItem<Consumable>(consumables[choice - 1]) });
+	}
+	inline void renderLevelUp(Session& session) {
+		session.out << "What would to like increase?";
+		if (session.levelsLeft > 1) session.out << " (" << session.levelsLeft << " points left)";
+		session.out << "\n1) Strength: " << session.character.str << "\n2) Intelligence: " << session.character.itl << "\n3) Speed: " << session.character.spd << "\n4) Defense: " << session.character.def << endl;
+	}
+	// Puts some points into the chosen stat (rolling them once none are left).
+	inline Transition spendPoints(Session& session, const int& amount) {
+		session.points[session.stat] += amount;
+		session.levelsLeft -= amount;
+		if (session.levelsLeft > 0) return Transition::replace(SceneID::LEVEL_UP);
+		return levelUp(session, session.points);
+	}
+	inline Transition handleLevelUp(Session& session, const std::string& line) {
+		int choice = number(line);
+		if (choice < 1 || choice > 4) {
+			session.out << "Not a valid option, putting point into strength." << endl;
+			choice = 1;
+		}
+		session.stat = choice - 1;
+		if (session.levelsLeft > 1) return Transition::replace(SceneID::LEVEL_AMOUNT);
+		return spendPoints(session, 1);
+	}
+	inline void renderLevelAmount(Session& session) {
+		session.out << "How many points? (1-" << session.levelsLeft << ")" << endl;
+	}
+	inline Transition handleLevelAmount(Session& session, const std::string& line) {
+		return spendPoints(session, std::clamp(number(line), 1, session.levelsLeft));
 	}
-}
-
 
-void explore() {
-	Enemygen();
-	string exploredesc[10] = { "While walking around the graveyard, you see ", "As you walk around the graveyard, you see ", "While you were walking around the graveyard, you see ", "When you were walking around the graveyard, you saw ", "As you explored the surrounding forest, you saw ", "While exploring the surrounding forest, you saw ", "During your patrol of the surrounding area, you saw ", "You see something guarding the gate, it is ", "Taking a look around the graveyard, you see ", "While wandering, you see " };
-	string exploremonn[10] = { "a Skeleton", "a Man Wearing a Dinosaur Costume", "a Demon", "a Tiefling", "an Orc", "a Goblin", "a Troll", "a Cyborg-Guardian", "a Cultist", "a Bandit" };
-	cout << exploredesc[rand() % 10] << exploremonn[rand() % 10] << "\nSizing up the creature, you can see it has approximately..." << endl;
-	cout << Enemy.ehp << " Max Health...\n" << Enemy.emp << " Max Mana...\n" << endl;
-	cout << "1) Attack\n2) Return Back Home" << endl;
-	cin >> input;
-	switch (input) {
-	case 1:
-		decideTurn();
-		break;
-	case 2:
-		break;
+	// Workshop
+	inline void renderWorkshop(Session& session) {
+		session.clear();
+		session.out << "You look at your current blueprints." << endl;
+		session.out << "\n-*- One Time Creations -*-\n1) " << session.character.modsot[0] << "\n2) " << session.character.modsot[1] << "\n3) " << session.character.modsot[2] << "\n4) " << session.character.modsot[3] << "\n\n-*- Multiple Creations -*-\n5) Rotating Motor - (Str +5) - " << session.character.modsmt[0] << " Dust\n6) Traction Ropes - (Spd +5) - " << session.character.modsmt[1] << " Dust\n7) Dust Brain Augment - (Itl +5) - " << session.character.modsmt[2] << " Dust\n8) Dust Armor - (Def +5) - " << session.character.modsmt[3] << " Dust" << endl;
 	}
-}
-*/
-void workshop() {
-	ClearScreen();
-	if (Charac.workshopfirst == false) {
-		cout << "You start to dig into a grave. It gives off a soft glow as you dig into the \ndirt.The dirt is thrown to the side and a door is revealed.\nYou open it to see tables, blueprints, and workstations littered around the \ndimly lit room. You pick up a blueprint and read it, it seems to focus on Dust.\nThe blueprint is for a body modification, allowing the user to withstand more \ndamage. You take it and look around for more blueprints." << endl;
-		wait_enter();
-		Charac.workshopfirst = true;
-		workshop();
-	}
-	else if (Charac.workshopfirst == true) {
-		ClearScreen();
-		cout << "You look at your current blueprints." << endl;
-		cout << "\n-*- One Time Creations -*-\n1) " << Charac.modsot[0] << "\n2) " << Charac.modsot[1] << "\n3) " << Charac.modsot[2] << "\n4) " << Charac.modsot[3] << "\n\n-*- Multiple Creations -*-\n5) Rotating Motor - (Str +5) - " << Charac.modsmt[0] << " Dust\n6) Traction Ropes - (Spd +5) - " << Charac.modsmt[1] << " Dust\n7) Dust Brain Augment - (Itl +5) - " << Charac.modsmt[2] << " Dust\n8) Dust Armor - (Def +5) - " << Charac.modsmt[3] << " Dust" << endl;
-		cin >> input;
-		switch (input) {
+	inline Transition handleWorkshop(Session& session, const std::string& line) {
+		switch (number(line)) {
 		case 1:
-			if (Charac.modsot[0] == "Dust Grip - CREATED") {
-				cout << "You already created that." << endl;
-				wait_enter();
+			if (session.character.modsot[0] == "Dust Grip - CREATED") {
+				session.out << "You already created that." << endl;
 				break;
 			}
-			if (Charac.dust < 50) {
-				cout << "You do not have enough dust." << endl;
-				wait_enter();
+			if (session.character.dust < 50) {
+				session.out << "You do not have enough dust." << endl;
 			}
-			else if (Charac.dust >= 50) {
-				cout << "You create the dust grip. Gaining +.25 Sword Profficiency" << endl;
-				Charac.modsot[0] = "Dust Grip - CREATED";
-				Charac.swordprof = Charac.swordprof + .25;
-				Charac.dust = Charac.dust - 50;
-				wait_enter();
+			else if (session.character.dust >= 50) {
+				session.out << "You create the dust grip. Gaining +.25 Sword Profficiency" << endl;
+				session.character.modsot[0] = "Dust Grip - CREATED";
+				session.character.swordprof = session.character.swordprof + .25;
+				session.character.dust = session.character.dust - 50;
 			}
 			break;
 		case 2:
-			if (Charac.modsot[1] == "Dust String - CREATED") {
-				cout << "You already created that." << endl;
-				wait_enter();
+			if (session.character.modsot[1] == "Dust String - CREATED") {
+				session.out << "You already created that." << endl;
 				break;
 			}
-			if (Charac.dust < 50) {
-				cout << "You do not have enough dust." << endl;
-				wait_enter();
+			if (session.character.dust < 50) {
+				session.out << "You do not have enough dust." << endl;
 			}
-			else if (Charac.dust >= 50) {
-				cout << "You create the dust string. Gaining +.25 Bow Profficiency" << endl;
-				Charac.modsot[1] = "Dust String - CREATED";
-				Charac.bowprof = Charac.bowprof + .25;
-				Charac.dust = Charac.dust - 50;
-				wait_enter();
+			else if (session.character.dust >= 50) {
+				session.out << "You create the dust string. Gaining +.25 Bow Profficiency" << endl;
+				session.character.modsot[1] = "Dust String - CREATED";
+				session.character.bowprof = session.character.bowprof + .25;
+				session.character.dust = session.character.dust - 50;
 			}
 			break;
 		case 3:
-			if (Charac.modsot[2] == "Casting Serum - CREATED") {
-				cout << "You already created that." << endl;
-				Charac.dust = Charac.dust - 50;
-				wait_enter();
+			if (session.character.modsot[2] == "Casting Serum - CREATED") {
+				session.out << "You already created that." << endl;
+				session.character.dust = session.character.dust - 50;
 				break;
 			}
-			if (Charac.dust < 50) {
-				cout << "You do not have enough dust." << endl;
-				wait_enter();
+			if (session.character.dust < 50) {
+				session.out << "You do not have enough dust." << endl;
 			}
-			else if (Charac.dust >= 50) {
-				cout << "You create the casting serum. Gaining +.25 Staff Profficiency" << endl;
-				Charac.modsot[2] = "Casting Serum - CREATED";
-				Charac.staffprof = Charac.staffprof + .25;
-				Charac.dust = Charac.dust - 50;
-				wait_enter();
+			else if (session.character.dust >= 50) {
+				session.out << "You create the casting serum. Gaining +.25 Staff Profficiency" << endl;
+				session.character.modsot[2] = "Casting Serum - CREATED";
+				session.character.staffprof = session.character.staffprof + .25;
+				session.character.dust = session.character.dust - 50;
 			}
 			break;
 		case 4:
-			if (Charac.modsot[3] == "Knuckle Dust - CREATED") {
-				cout << "You already created that." << endl;
-				wait_enter();
+			if (session.character.modsot[3] == "Knuckle Dust - CREATED") {
+				session.out << "You already created that." << endl;
 				break;
 			}
-			if (Charac.dust < 50) {
-				cout << "You do not have enough dust." << endl;
-				wait_enter();
+			if (session.character.dust < 50) {
+				session.out << "You do not have enough dust." << endl;
 			}
-			else if (Charac.dust >= 50) {
-				cout << "You create the knuckle dust. Gaining +.25 Unarmed Profficiency" << endl;
-				Charac.modsot[3] = "Knuckle Dust - CREATED";
-				Charac.unarmedprof = Charac.unarmedprof + .25;
-				Charac.dust = Charac.dust - 50;
-				wait_enter();
+			else if (session.character.dust >= 50) {
+				session.out << "You create the knuckle dust. Gaining +.25 Unarmed Profficiency" << endl;
+				session.character.modsot[3] = "Knuckle Dust - CREATED";
+				session.character.unarmedprof = session.character.unarmedprof + .25;
+				session.character.dust = session.character.dust - 50;
 			}
 			break;
 		case 5:
-			if (Charac.dust < Charac.modsmt[0]) {
-				cout << "You do not have enough dust." << endl;
-				wait_enter();
+			if (session.character.dust < session.character.modsmt[0]) {
+				session.out << "You do not have enough dust." << endl;
 			}
-			else if (Charac.dust >= Charac.modsmt[0]) {
-				cout << "You create the Rotating Motor, gaining 5 Strength." << endl;
-				Charac.dust = Charac.dust - Charac.modsmt[0];
-				Charac.str = Charac.str + 5;
-				Charac.modsmt[0] = Charac.modsmt[0] + Charac.modsmt[0];
-				wait_enter();
+			else if (session.character.dust >= session.character.modsmt[0]) {
+				session.out << "You create the Rotating Motor, gaining 5 Strength." << endl;
+				session.character.dust = session.character.dust - session.character.modsmt[0];
+				session.character.str = session.character.str + 5;
+				session.character.modsmt[0] = session.character.modsmt[0] + session.character.modsmt[0];
 			}
 			break;
 		case 6:
-			if (Charac.dust < Charac.modsmt[1]) {
-				cout << "You do not have enough dust." << endl;
-				wait_enter();
+			if (session.character.dust < session.character.modsmt[1]) {
+				session.out << "You do not have enough dust." << endl;
 			}
-			else if (Charac.dust >= Charac.modsmt[1]) {
-				cout << "You create the Traction Ropes, gaining 5 Speed." << endl;
-				Charac.dust = Charac.dust - Charac.modsmt[1];
-				Charac.spd = Charac.spd + 5;
-				Charac.modsmt[1] = Charac.modsmt[1] + Charac.modsmt[1];
-				wait_enter();
+			else if (session.character.dust >= session.character.modsmt[1]) {
+				session.out << "You create the Traction Ropes, gaining 5 Speed." << endl;
+				session.character.dust = session.character.dust - session.character.modsmt[1];
+				session.character.spd = session.character.spd + 5;
+				session.character.modsmt[1] = session.character.modsmt[1] + session.character.modsmt[1];
 			}
 			break;
 		case 7:
-			if (Charac.dust < Charac.modsmt[2]) {
-				cout << "You do not have enough dust." << endl;
-				wait_enter();
+			if (session.character.dust < session.character.modsmt[2]) {
+				session.out << "You do not have enough dust." << endl;
 			}
-			else if (Charac.dust >= Charac.modsmt[1]) {
-				cout << "You create the Dust Brain Augment, gaining 5 Intelligence." << endl;
-				Charac.dust = Charac.dust - Charac.modsmt[2];
-				Charac.itl = Charac.itl + 5;
-				Charac.modsmt[2] = Charac.modsmt[2] + Charac.modsmt[2];
-				wait_enter();
+			else if (session.character.dust >= session.character.modsmt[1]) {
+				session.out << "You create the Dust Brain Augment, gaining 5 Intelligence." << endl;
+				session.character.dust = session.character.dust - session.character.modsmt[2];
+				session.character.itl = session.character.itl + 5;
+				session.character.modsmt[2] = session.character.modsmt[2] + session.character.modsmt[2];
 			}
 			break;
 		case 8:
-			if (Charac.dust < Charac.modsmt[3]) {
-				cout << "You do not have enough dust." << endl;
-				wait_enter();
+			if (session.character.dust < session.character.modsmt[3]) {
+				session.out << "You do not have enough dust." << endl;
 			}
-			else if (Charac.dust >= Charac.modsmt[3]) {
-				cout << "You create the Dust Armor, gaining 5 Defense." << endl;
-				Charac.dust = Charac.dust - Charac.modsmt[3];
-				Charac.def = Charac.def + 5;
-				Charac.modsmt[3] = Charac.modsmt[3] + Charac.modsmt[3];
-				wait_enter();
+			else if (session.character.dust >= session.character.modsmt[3]) {
+				session.out << "You create the Dust Armor, gaining 5 Defense." << endl;
+				session.character.dust = session.character.dust - session.character.modsmt[3];
+				session.character.def = session.character.def + 5;
+				session.character.modsmt[3] = session.character.modsmt[3] + session.character.modsmt[3];
 			}
 			break;
+		default:
+			return Transition::pop();
 		}
+		autosave(session);
+		return Transition::pop().paused();
 	}
 
-}
+	// Black market
+	inline void renderBlackmarket(Session& session) {
+		session.clear();
+		session.out << "You look at the shops available.\n" << endl;
+		for (std::size_t i = 0; i < ShopTable.size(); i++)
+			session.out << i + 1 << ") " << ShopTable[i].name << endl;
+		session.out << ShopTable.size() + 1 << ") Sell Items" << endl;
+		session.out << "\nDust Available: " << session.character.dust << endl;
+	}
+	inline Transition handleBlackmarket(Session& session, const std::string& line) {
+		const int choice = number(line);
+		if (choice >= 1 && choice <= static_cast<int>(ShopTable.size())) {
+			session.shop = &ShopTable[choice - 1];
+			return Transition::replace(SceneID::SHOP);
+		}
+		if (choice == static_cast<int>(ShopTable.size()) + 1)
+			return Transition::replace(SceneID::SELL);
+		return Transition::pop();
+	}
+	inline void renderShop(Session& session) {
+		const Shop& store = *session.shop;
+		session.clear();
+		session.out << "-*- " << store.name << " -*-" << endl;
+		session.out << "\n" << store.greeting << "\n" << endl;
+		for (std::size_t i = 0; i < store.stockCount; i++) {
+			const Item* item = findItem(store.stock[i]);
+			session.out << i + 1 << ") " << item->getName() << " - " << item->getBuyPrice() << " Dust" << endl;
+		}
+		session.out << "\n0) Exit" << endl;
+	}
+	inline Transition handleShop(Session& session, const std::string& line) {
+		const Shop& store = *session.shop;
+		const int choice = number(line);
+		if (choice < 1 || choice > static_cast<int>(store.stockCount))
+			return Transition::pop();
+		const Item* item = findItem(store.stock[choice - 1]);
+		// Consumables are bought by the stack
+		if (const Consumable* consumable = itemCast<Consumable>(item)) {
+			session.item = consumable;
+			return Transition::replace(SceneID::BUY_AMOUNT);
+		}
+		if (session.character.dust < item->getBuyPrice()) {
+			session.out << "You do not have enough dust." << endl;
+			return Transition::pop().paused();
+		}
+		session.out << "You buy the " << item->getName() << " for " << item->getBuyPrice() << " dust." << endl;
+		session.character.dust = session.character.dust - item->getBuyPrice();
+		session.character.inventory.addItem(*item);
+		autosave(session);
+		return Transition::pop().paused();
+	}
+	inline void renderBuyAmount(Session& session) {
+		session.out << "How many would you like to buy? (" << session.item->getBuyPrice() << " Each)" << endl;
+	}
+	inline Transition handleBuyAmount(Session& session, const std::string& line) {
+		const Consumable& potion = *session.item;
+		const int amount = number(line);
+		if (amount < 1)
+			return Transition::pop();
+		if (amount > session.character.inventory.getSpace(potion.getID())) {
+			session.out << "You can't carry that many!" << endl;
+			return Transition::pop().paused();
+		}
+		const long long cost = static_cast<long long>(amount) * potion.getBuyPrice();
+		if (cost > session.character.dust) {
+			session.out << "You do not have enough dust!" << endl;
+			return Transition::pop().paused();
+		}
+		session.out << "You bought " << amount << " " << potion.getName() << "s for " << cost << " dust" << endl;
+		session.character.dust -= static_cast<int>(cost);
+		session.character.inventory.addItem(potion, static_cast<unsigned short>(amount));
+		autosave(session);
+		return Transition::pop().paused();
+	}
+	inline void renderSell(Session& session) {
+		session.clear();
+		session.out << "-*- Sell Items -*-" << endl;
+		session.out << "A hooded figure looks over your things and names a price for each.\n" << endl;
+		// List the most valuable things first
+		SortedView byPrice(session.character.inventory, SortKey::SELL, true);
+		byPrice.select(everything(), session.slots);
+		for (std::size_t i = 0; i < session.slots.size(); i++) {
+			const ItemSlot* slot = session.character.inventory.inspectSlot(session.slots[i]);
+			session.out << i + 1 << ") " << slot->getItem()->getName() << " x" << slot->getStackAmount() << " - " << slot->getItem()->getSellPrice() << " Dust Each" << endl;
+		}
+		session.out << "\n0) Exit" << endl;
+	}
+	// Sells some of the chosen slot (never the equipped weapon).
+	inline Transition sell(Session& session, int amount) {
+		const ItemSlot& chosen = *session.character.inventory.inspectSlot(session.slot);
+		const Item* item = chosen.getItem();
+		amount = std::min<int>(amount, chosen.getStackAmount());
+		// Keep the equipped weapon
+		if (session.slot == session.character.inventory.getSlotIndex(session.character.equipped) && amount == chosen.getStackAmount()) {
+			session.out << "You can't sell the weapon you have equipped." << endl;
+			return Transition::pop().paused();
+		}
+		const int sold = session.character.inventory.deleteItem(session.slot, static_cast<unsigned short>(amount));
+		session.out << "You sell " << sold << " " << item->getName() << " for " << sold * item->getSellPrice() << " dust." << endl;
+		session.character.dust += sold * item->getSellPrice();
+		autosave(session);
+		return Transition::pop().paused();
+	}
+	inline Transition handleSell(Session& session, const std::string& line) {
+		const int choice = number(line);
+		if (choice < 1 || choice > static_cast<int>(session.slots.size()))
+			return Transition::pop();
+		session.slot = session.slots[choice - 1];
+		if (session.character.inventory.inspectSlot(session.slot)->getStackAmount() > 1)
+			return Transition::replace(SceneID::SELL_AMOUNT);
+		return sell(session, 1);
+	}
+	inline void renderSellAmount(Session& session) {
+		session.out << "How many would you like to sell? (You have " << session.character.inventory.inspectSlot(session.slot)->getStackAmount() << ")" << endl;
+	}
+	inline Transition handleSellAmount(Session& session, const std::string& line) {
+		const int amount = number(line);
+		if (amount < 1)
+			return Transition::pop();
+		return sell(session, amount);
+	}
 
-void blackmarket() {
-	int input2;
-	ClearScreen();
-	if (Charac.blackmarketfirst == false) {
-		cout << "You lift up the lid to the underground... You can only see a single door\nA swarm of security drones flock to you and take your picture.\nThe door opens and reveals an underground society, the lights are blinding.\nYou look around and see a few shops, offering items for dust." << endl;
-		wait_enter();
-		Charac.blackmarketfirst = true;
-		blackmarket();
-	}
-	else if (Charac.blackmarketfirst == true) {
-		ClearScreen();
-		cout << "You look at the shops available." << endl;
-		cout << "\n1) Warrior's Supply \n2) Hunter's Edge\n3) The Magic's Gathering\n4) Rocket Wrestling\n5) Mike's Friendly Store" << endl;
-		cout << "\nDust Available: " << Charac.dust << endl;
-		cin >> input;
-		switch (input) {
+	// Inventory
+	inline void renderInventory(Session& session) {
+		session.clear();
+		session.out << "-*- Stats -*-\n\nName: " << session.character.name << "\nRace: " << session.character.race << "\nClass: " << session.character.clas << "\nProfession: " << session.character.profession << "\n\nMax Health: " << session.character.maxHP << "\nMax Mana: " << session.character.maxMP << "\n\nCurrent HP: " << session.character.hp << "\nCurrent MP: " << session.character.mp << "\n\nStrength: " << session.character.str << "\nDefense: " << session.character.def << "\nIntelligence: " << session.character.itl << "\nSpeed: " << session.character.spd << "\nCritical Chance: " << session.character.crt << "\n\nDifficulty: " << session.character.difficultyN << "\nDifficulty Multiplier: " << session.character.difficultyD << "x" << endl;
+		session.out << "\nEXP To Next Level: " << ((session.character.lvl * 50 * session.character.difficultyD) * session.character.expmultiplier) - session.character.exp << endl;
+		session.out << "\n0) Exit\n1) Weapons\n2) Consumables" << endl;
+	}
+	inline Transition handleInventory(Session&, const std::string& line) {
+		switch (number(line)) {
 		case 1:
-			ClearScreen();
-			cout << "-*- Warrior's Supply -*-" << endl;
-			cout << "\nYou walk in and are greeted by two Bren'kibs. \nThey are polishing their spears and weapons for selling.\nThey show you around the store." << endl;
-			cout << "\n1) Copper Shortsword - " << WeaponTable.generate("Copper Shortsword").getBuyPrice() << " Dust\n2) Iron Blade - " << WeaponTable.generate("Iron Blade").getBuyPrice() << " Dust" << endl;
-			cout << "3) Steel Blade - " << WeaponTable.generate("Steel Blade").getBuyPrice() << " Dust\n4) Obsidian Longsword - " << WeaponTable.generate("Obsidian Longsword").getBuyPrice() << " Dust" << endl;
-			cout << "5) Core Lightblade - " << WeaponTable.generate("Core Lightblade").getBuyPrice() << " Dust\n6) The Singularity Blade - " << WeaponTable.generate("The Singularity Blade").getBuyPrice() << " Dust" << endl;
-			cout << "\n0) Exit" << endl;
-			cin >> input2;
-			switch (input2) {
-			case 1:
-				if (Charac.dust < WeaponTable.generate("Copper Shortsword").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("Copper Shortsword").getBuyPrice()) {
-					cout << "You buy the Copper Shortsword for " << WeaponTable.generate("Copper Shortsword").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Copper Shortsword").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Copper Shortsword"));
-					wait_enter();
-					break;
-				}
-				break;
-			case 2:
-				if (Charac.dust < WeaponTable.generate("Iron Blade").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("Iron Blade").getBuyPrice()) {
-					cout << "You buy the Iron Blade for " << WeaponTable.generate("Iron Blade").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Iron Blade").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Iron Blade"));
-					wait_enter();
-					break;
-				}
-				break;
-			case 3:
-				if (Charac.dust < WeaponTable.generate("Steel Blade").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("Steel Blade").getBuyPrice()) {
-					cout << "You buy the Steel Blade for " << WeaponTable.generate("Steel Blade").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Steel Blade").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Steel Blade"));
-					wait_enter();
-					break;
-				}
-				break;
-			case 4:
-				if (Charac.dust < WeaponTable.generate("Obsidian Longsword").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("Obsidian Longsword").getBuyPrice()) {
-					cout << "You buy the Obsidian Longsword for " << WeaponTable.generate("Obsidian Longsword").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Obsidian Longsword").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Obsidian Longsword"));
-					wait_enter();
-					break;
-				}
-				break;
-			case 5:
-				if (Charac.dust < WeaponTable.generate("Core Lightblade").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("Core Lightblade").getBuyPrice()) {
-					cout << "You buy the Core Lightblade for " << WeaponTable.generate("Core Lightblade").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Core Lightblade").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Core Lightblade"));
-					wait_enter();
-					break;
-				}
-				break;
-			case 6:
-				if (Charac.dust < WeaponTable.generate("The Singularity Blade").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("The Singularity Blade").getBuyPrice()) {
-					cout << "You buy the The Singularity Blade for " << WeaponTable.generate("The Singularity Blade").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("The Singularity Blade").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("The Singularity Blade"));
-					wait_enter();
-					break;
-				}
+			return Transition::replace(SceneID::WEAPONS);
+		case 2:
+			return Transition::replace(SceneID::CONSUMABLES);
+		}
+		return Transition::pop();
+	}
+	inline void renderWeapons(Session& session) {
+		session.clear();
+		const Weapon* weapon = session.character.getWeapon();
+		if (weapon != nullptr) {
+			session.out << "-*- Inventory -*-\nCurrent Weapon: " << weapon->getName() << "\nDescription: " << weapon->getDesc() << endl;
+			session.out << "\n-*- Weapon Stats -*-\nDamage: " << weapon->getDamage() << "\nCrit Bonus: " << weapon->getCrit() << "\nSpell Damage: " << weapon->getSpellDamage() << "\nAccuracy: " << weapon->getAccuracy() << "\nWeapon Cost: " << weapon->getBuyPrice() << "\n" << endl;
+		}
+		else {
+			session.out << "-*- Inventory -*-\nCurrent Weapon: None\n" << endl;
+		}
+		int index = 1;
+		session.out << "0) Exit" << endl;
+		for (const unsigned int& slot : session.character.inventory.getCategory<Weapon>())
+		{
+			session.out << index << ") " << session.character.inventory.inspectItem<Weapon>(slot)->getName() << std::endl;
+			index++;
+		}
+	}
+	inline Transition handleWeapons(Session& session, const std::string& line) {
+		const int choice = number(line);
+		const std::vector<unsigned int>& weapons = session.character.inventory.getCategory<Weapon>();
+		if (choice < 1 || choice > static_cast<int>(weapons.size()))
+			return Transition::pop();
+		session.character.equip(session.character.inventory.getHandle(weapons[choice - 1]));
+		autosave(session);
+		return Transition::stay();
+	}
+	inline void renderConsumables(Session& session) {
+		unsigned int index = 1;
+		session.out << "0) Exit" << endl;
+		for (const unsigned int& slot : session.character.inventory.getCategory<Consumable>()) {
+			session.out << index << ") " << session.character.inventory.inspectItem<Consumable>(slot)->getName() << " x" << session.character.inventory.inspectSlot(slot)->getStackAmount() << std::endl;
+			index++;
+		}
+	}
+	// Uses some of the chosen slot, running the effect once for each.
+	inline Transition useItems(Session& session, const int& amount) {
+		const Consumable* takenItem = session.character.inventory.inspectItem<Consumable>(session.slot);
+		const int used = session.character.inventory.deleteItem(session.slot, static_cast<unsigned short>(std::min(amount, static_cast<int>(Inventory::maxStack))));
+		const Stats before = session.character.getStats();
+		Stats after = before;
+		for (int i = 0; i < used; i++)
+			use(*takenItem, after);
+		session.character.setStats(after);
+		session.out << "You restore " << after[0] - before[0] << " HP and " << after[1] - before[1] << " MP!" << endl;
+		statcheck(session.character);
+		autosave(session);
+		return Transition::pop().paused();
+	}
+	inline Transition handleConsumables(Session& session, const std::string& line) {
+		const int choice = number(line);
+		const std::vector<unsigned int>& consumables = session.character.inventory.getCategory<Consumable>();
+		if (choice < 1 || choice > static_cast<int>(consumables.size()))
+			return Transition::pop();
+		session.slot = consumables[choice - 1];
+		// Ask how many to use if there's a stack.
+		if (session.character.inventory.inspectSlot(session.slot)->getStackAmount() > 1)
+			return Transition::replace(SceneID::USE_AMOUNT);
+		return useItems(session, 1);
+	}
+	inline void renderUseAmount(Session& session) {
+		session.out << "How many would you like to use? (You have " << session.character.inventory.inspectSlot(session.slot)->getStackAmount() << ")" << endl;
+	}
+	inline Transition handleUseAmount(Session& session, const std::string& line) {
+		const int amount = number(line);
+		if (amount < 1)
+			return Transition::pop();
+		return useItems(session, amount);
+	}
 
-				break;
-			}
+	// Press ENTER to continue
+	inline void renderPause(Session& session) {
+		session.out << "Press ENTER to continue...";
+	}
+	inline Transition handlePause(Session&, const std::string&) {
+		return Transition::pop();
+	}
+
+	// Every scene, in SceneID order.
+	struct Scene {
+		void(*render)(Session& session);
+		Transition(*handle)(Session& session, const std::string& line);
+	};
+	const Scene scenes[] = {
+		{ renderStart, handleStart }, { renderQuickstart, handleQuickstart },
+		{ renderChargen, handleChargen }, { renderName, handleName }, { renderClass, handleClass }, { renderRace, handleRace },
+		{ renderOrigin, handleOrigin }, { renderProfession, handleProfession }, { renderNecromancer, handleNecromancer },
+		{ renderWeaponSkill, handleWeaponSkill }, { renderFather, handleFather }, { renderConfirm, handleConfirm },
+		{ renderHome, handleHome }, { renderExplore, handleExplore }, { renderFight, handleFight }, { renderFightItems, handleFightItems },
+		{ renderLevelUp, handleLevelUp }, { renderLevelAmount, handleLevelAmount },
+		{ renderWorkshop, handleWorkshop }, { renderBlackmarket, handleBlackmarket }, { renderShop, handleShop },
+		{ renderBuyAmount, handleBuyAmount }, { renderSell, handleSell }, { renderSellAmount, handleSellAmount },
+		{ renderInventory, handleInventory }, { renderWeapons, handleWeapons }, { renderConsumables, handleConsumables },
+		{ renderUseAmount, handleUseAmount },
+		{ renderPause, handlePause }
+	};
+	static_assert(std::size(scenes) == sceneCount, "Every SceneID needs a scene");
+
+	inline void Session::render() {
+		if (depth > 0) scenes[static_cast<std::size_t>(getScene())].render(*this);
+	}
+	inline std::uint64_t Session::play(Input& input, const std::uint64_t& maxLines) {
+		std::string line;
+		std::uint64_t lines = 0;
+		while (isRunning() && lines < maxLines && input.next(*this, line)) {
+			handle(line);
+			lines++;
+		}
+		return lines;
+	}
+	inline void Session::handle(const std::string& line) {
+		if (depth == 0) return;
+		const Transition next = scenes[static_cast<std::size_t>(getScene())].handle(*this, line);
+		switch (next.kind) {
+		case Transition::Kind::STAY:
 			break;
-		case 2:
-			ClearScreen();
-			cout << "-*- Hunter's Edge -*-" << endl;
-			cout << "\nAs you enter the shop you see a Kenku sitting behind the counter.\nHe throws a dagger at you, barely missing you.\nHe laughs and lets you look at his wares.\n\n1) Wooden Bow - " << WeaponTable.generate("Wooden Bow").getBuyPrice() << " Dust\n2) Reinforced Bow - " << WeaponTable.generate("Reinforced Bow").getBuyPrice() << " Dust\n3) Iron Bow - " << WeaponTable.generate("Iron Bow").getBuyPrice() << " Dust\n4) Tactical Compound Bow - " << WeaponTable.generate("Tactical Compound Bow").getBuyPrice() << " Dust" << endl;
-			cout << "5) Meteor Bow - " << WeaponTable.generate("Meteor Bow").getBuyPrice() << " Dust\n6) Star Bow - " << WeaponTable.generate("Star Bow").getBuyPrice() << " Dust" << endl;
-			cout << "\n0) Exit" << endl;
-			cin >> input2;
-			switch (input2) {
-			case 1:
-				if (Charac.dust < WeaponTable.generate("Wooden Bow").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("Wooden Bow").getBuyPrice()) {
-					cout << "You buy the wooden bow for " << WeaponTable.generate("Wooden Bow").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Wooden Bow").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Wooden Bow"));
-					wait_enter();
-					break;
-				}
-				break;
-			case 2:
-				if (Charac.dust < WeaponTable.generate("Reinforced Bow").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("Reinforced Bow").getBuyPrice()) {
-					cout << "You buy the Reinforced Bow for " << WeaponTable.generate("Reinforced Bow").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Reinforced Bow").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Reinforced Bow"));
-					wait_enter();
-					break;
-				}
-				break;
-			case 3:
-				if (Charac.dust < WeaponTable.generate("Iron Bow").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("Iron Bow").getBuyPrice()) {
-					cout << "You buy the Iron Bow for " << WeaponTable.generate("Iron Bow").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Iron Bow").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Iron Bow"));
-					wait_enter();
-					break;
-				}
-				break;
-			case 4:
-				if (Charac.dust < WeaponTable.generate("Tactical Compound Bow").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("Tactical Compound Bow").getBuyPrice()) {
-					cout << "You buy the Tactical Compound Bow for " << WeaponTable.generate("Tactical Compound Bow").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Tactical Compound Bow").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Tactical Compound Bow"));
-					wait_enter();
-					break;
-				}
-				break;
-			case 5:
-				if (Charac.dust < WeaponTable.generate("Meteor Bow").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("Meteor Bow").getBuyPrice()) {
-					cout << "You buy the Meteor Bow for " << WeaponTable.generate("Meteor Bow").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Meteor Bow").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Meteor Bow"));
-					wait_enter();
-					break;
-				}
-				break;
-			case 6:
-				if (Charac.dust < WeaponTable.generate("Star Bow").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("Star Bow").getBuyPrice()) {
-					cout << "You buy the Star Bow for " << WeaponTable.generate("Star Bow").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Star Bow").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Star Bow"));
-					wait_enter();
-					break;
-				}
-				break;
-			}
+		case Transition::Kind::PUSH:
+			push(next.scene);
 			break;
-		case 3:
-			ClearScreen();
-			cout << "-*- The Magic's Gathering -*-" << endl;
-			cout << "\nYou walk into the Magic's Gathering. A very happy human greets you\n'W-we-we have D&D Sessions on thursdays...' He says\nHe hands you a flyer\n'OH, and I-I also sell things...' He says." << endl;
-			cout << "\n1) Wooden Staff - " << WeaponTable.generate("Wooden Staff").getBuyPrice() << " Dust\n2) Infused Staff - " << WeaponTable.generate("Infused Staff").getBuyPrice() << " Dust\n3) Cut Wand - " << WeaponTable.generate("Cut Wand").getBuyPrice() << " Dust\n4) Nuja Wand - " << WeaponTable.generate("Nuja Wand").getBuyPrice() << " Dust" << endl;
-			cout << "5) F.I.L.O. - " << WeaponTable.generate("F.I.L.O.").getBuyPrice() << " Dust\n6) Staff of Mythos - " << WeaponTable.generate("Staff of Mythos").getBuyPrice() << " Dust" << endl;
-			cout << "\n0) Exit" << endl;
-			cin >> input2;
-			switch (input2) {
-			case 1:
-				if (Charac.dust < WeaponTable.generate("Wooden Staff").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("Wooden Staff").getBuyPrice()) {
-					cout << "You buy the Wooden Staff for " << WeaponTable.generate("Wooden Staff").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Wooden Staff").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Wooden Staff"));
-					wait_enter();
-					break;
-				}
-				break;
-			case 2:
-				if (Charac.dust < WeaponTable.generate("Infused Staff").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("Infused Staff").getBuyPrice()) {
-					cout << "You buy the Infused Staff for " << WeaponTable.generate("Infused Staff").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Infused Staff").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Infused Staff"));
-					wait_enter();
-					break;
-				}
-				break;
-			case 3:
-				if (Charac.dust < WeaponTable.generate("Cut Wand").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("Cut Wand").getBuyPrice()) {
-					cout << "You buy the Cut Wand for " << WeaponTable.generate("Cut Wand").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Cut Wand").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Cut Wand"));
-					wait_enter();
-					break;
-				}
-				break;
-			case 4:
-				if (Charac.dust < WeaponTable.generate("Nuja Wand").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("Nuja Wand").getBuyPrice()) {
-					cout << "You buy the Nuja Wand for " << WeaponTable.generate("Nuja Wand").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Nuja Wand").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Nuja Wand"));
-					wait_enter();
-					break;
-				}
-				break;
-			case 5:
-				if (Charac.dust < WeaponTable.generate("F.I.L.O.").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("F.I.L.O.").getBuyPrice()) {
-					cout << "You buy F.I.L.O. for " << WeaponTable.generate("F.I.L.O.").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("F.I.L.O.").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("F.I.L.O."));
-					wait_enter();
-					break;
-				}
-				break;
-			case 6:
-				if (Charac.dust < WeaponTable.generate("Staff of Mythos").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("Staff of Mythos").getBuyPrice()) {
-					cout << "You buy the Staff of Mythos for " << WeaponTable.generate("Staff of Mythos").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Staff of Mythos").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Staff of Mythos"));
-					wait_enter();
-					break;
-				}
-				break;
+		case Transition::Kind::REPLACE:
+			stack[depth - 1] = next.scene;
+			break;
+		case Transition::Kind::POP:
+			depth--;
+			break;
+		case Transition::Kind::QUIT:
+			depth = 0;
+			return;
+		}
+		if (next.pause) push(SceneID::PAUSE);
+		// Hear back from the saves written in the background
+		if (journal != nullptr) {
+			const Saves::Journal::Report report = journal->poll();
+			if (!report.failure.empty()) {
+				notice = "Save failed: " + report.failure;
+				saving = false;
+			}
+			else if (report.saves > 0 && saving) {
+				notice = "Game saved.";
+				saving = false;
+			}
+		}
+		render();
+	}
+}
+
+/* The Bot namespace plays whole games with no one at the  *
+* keyboard, from character generation until the skeleton *
+* falls over, by picking random but sensible lines for   *
+* each scene. Games run at CPU speed with the output     *
+* thrown away, for soak tests and to generate load.      *
+* Start the game with "--bot [games] [seed]" to run it.  */
+namespace Bot
+{
+	// A game that goes on this long is stopped.
+	constexpr std::uint64_t maxLines = 1000000;
+	// Picks a number from 1 to count.
+	inline std::string pick(Randomness::Stream& random, const std::size_t& count) {
+		return std::to_string(1 + random.below(static_cast<std::uint32_t>(count)));
+	}
+	// Picks a line for the scene on top of a session.
+	inline std::string play(Scenes::Session& session, Randomness::Stream& random) {
+		using Scenes::SceneID;
+		switch (session.getScene()) {
+		case SceneID::START:
+			return "1";
+		case SceneID::CHARGEN:
+			if (session.character.name == "None") return "1";
+			if (session.character.clas == "None") return "2";
+			if (session.character.race == "None") return "3";
+			return "4";
+		case SceneID::NAME:
+			return "Bot";
+		case SceneID::QUICKSTART:
+		case SceneID::FATHER:
+			return "Bot" + std::to_string(random.next32());
+		case SceneID::CLASS:
+		case SceneID::WEAPON_SKILL:
+			return pick(random, 4);
+		case SceneID::RACE:
+		case SceneID::ORIGIN:
+			return pick(random, 6);
+		case SceneID::PROFESSION:
+			return pick(random, 5);
+		case SceneID::NECROMANCER:
+			return pick(random, 3);
+		case SceneID::CONFIRM:
+			return "1";
+		case SceneID::HOME: {
+			// Mostly explore, sometimes shop or look around
+			const std::uint32_t roll = random.below(10);
+			return roll < 7 ? "1" : std::to_string(roll - 5);
+		}
+		case SceneID::EXPLORE:
+			return "1";
+		case SceneID::FIGHT: {
+			// Drink something when low, else mostly attack
+			if (session.fight.player.hp * 3 < session.fight.player.maxHP && !session.character.inventory.getCategory<Consumable>().empty()) return "3";
+			const std::uint32_t roll = random.below(20);
+			return roll < 16 ? "1" : roll < 19 ? "2" : "4";
+		}
+		case SceneID::FIGHT_ITEMS:
+			return "1";
+		case SceneID::LEVEL_UP:
+			return pick(random, Leveling::statCount);
+		case SceneID::LEVEL_AMOUNT:
+			return pick(random, static_cast<std::size_t>(session.levelsLeft));
+		case SceneID::WORKSHOP:
+			return std::to_string(random.below(9));
+		case SceneID::BLACKMARKET:
+			return pick(random, ShopTable.size() + 1);
+		case SceneID::SHOP:
+			return std::to_string(random.below(static_cast<std::uint32_t>(session.shop->stockCount + 1)));
+		case SceneID::BUY_AMOUNT:
+			return pick(random, 5);
+		case SceneID::SELL:
+			return std::to_string(random.below(static_cast<std::uint32_t>(session.slots.size() + 1)));
+		case SceneID::INVENTORY:
+			return std::to_string(random.below(3));
+		case SceneID::WEAPONS:
+			return std::to_string(random.below(static_cast<std::uint32_t>(session.character.inventory.getCategory<Weapon>().size() + 1)));
+		case SceneID::CONSUMABLES:
+			return std::to_string(random.below(static_cast<std::uint32_t>(session.character.inventory.getCategory<Consumable>().size() + 1)));
+		case SceneID::SELL_AMOUNT:
+		case SceneID::USE_AMOUNT:
+			return "1";
+		case SceneID::PAUSE:
+			return "";
+		}
+		return "0";
+	}
+	// Plays some games (each from a fresh character) and reports how fast they went.
+	inline int run(const std::uint64_t& games, const std::uint64_t& seed) {
+		std::uint64_t lines = 0, deaths = 0, levels = 0;
+		int bestLevel = 0;
+		// Nobody is watching, so the output goes nowhere
+		std::ostream nowhere(nullptr);
+		const auto begin = std::chrono::steady_clock::now();
+		for (std::uint64_t game = 0; game < games; game++) {
+			Scenes::Input input = Scenes::Input::automatic(play, Randomness::Stream(seed, Randomness::streamID(Randomness::Subsystem::BOT, game)));
+			Scenes::Session session(nowhere, false);
+			session.start(Scenes::SceneID::START);
+			lines += session.play(input, maxLines);
+			if (!session.isRunning()) deaths++;
+			levels += session.character.lvl;
+			bestLevel = std::max(bestLevel, session.character.lvl);
+		}
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		cout << "-*- Bot -*-" << endl;
+		printf("%llu games, seed %llu\n%.2f s, %.0f lines per second\n",
+			static_cast<unsigned long long>(games), static_cast<unsigned long long>(seed), seconds, lines / seconds);
+		printf("%llu lines, %llu deaths (the rest stopped after %llu lines)\nAverage level %.2f, best %d\n",
+			static_cast<unsigned long long>(lines), static_cast<unsigned long long>(deaths), static_cast<unsigned long long>(maxLines),
+			games > 0 ? static_cast<double>(levels) / games : 0.0, bestLevel);
+		return 0;
+	}
+}
+
+/* The Server namespace serves the game over TCP on      *
+* localhost: a Session per connection, played with the  *
+* same menu numbers as the terminal (a line in, then a  *
+* screen and a "> " prompt back). One thread waits on   *
+* every socket with epoll, and each connection holds at *
+* most a line of input and a few screens of output, so  *
+* a process keeps 10k+ games going. Saves go to one     *
+* shared Store. Start it with "--serve [port] [store]", *
+* and load it with "--load [sessions] [port] [script]", *
+* which replays a script from many connections at once. */
+namespace Server
+{
+	constexpr std::uint16_t defaultPort = 4000;
+	const std::string defaultStore = "bones.kv";
+	// The longest line a player can send, the most output held for a slow reader, and what's read at once.
+	constexpr std::size_t maxLine = 256, maxOutput = 64 << 10, readSize = 4096;
+	// What ends every reply (so a client knows the screen is all there).
+	constexpr std::string_view prompt = "> ";
+	// What the load generator plays without a script: a new character, then the inventory and a save, over and over.
+	inline std::string defaultScript(const std::size_t& rounds = 20) {
+		std::string script = "1\n1\nLoad\n2\n1\n3\n1\n4\n3\n1\n1\n1\nBones\n1\n";
+		for (std::size_t round = 0; round < rounds; round++)
+			script += "4\n0\n5\n\n";
+		return script;
+	}
+	// Splits a script into its lines (dropping the \r of \r\n).
+	inline std::vector<std::string> scriptLines(const std::string& text) {
+		std::vector<std::string> lines;
+		std::size_t position = 0;
+		while (position < text.size()) {
+			std::size_t end = text.find('\n', position);
+			if (end == std::string::npos) end = text.size();
+			lines.emplace_back(text, position, end - position);
+			if (!lines.back().empty() && lines.back().back() == '\r') lines.back().pop_back();
+			position = end + 1;
+		}
+		return lines;
+	}
+	// Whether a name can be a player's (it's part of their saves' keys).
+	inline bool validPlayer(const std::string& name) {
+		if (name.empty() || name.size() > 32) return false;
+		for (const char c : name)
+			if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-') return false;
+		return true;
+	}
+
+#if defined(__linux__)
+	// Set when SIGINT or SIGTERM asks the server to stop.
+	inline volatile std::sig_atomic_t stopping = 0;
+	inline void stop(int) {
+		stopping = 1;
+	}
+	// Lets the process hold as many sockets as it's allowed to.
+	inline void raiseFileLimit() {
+		rlimit limit{};
+		if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+			limit.rlim_cur = limit.rlim_max;
+			setrlimit(RLIMIT_NOFILE, &limit);
+		}
+	}
+	inline sockaddr_in localhost(const std::uint16_t& port) {
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		return address;
+	}
+
+	// One player's connection: their game, the line they're typing, and the screens not sent yet.
+	struct Connection {
+		int fd;
+		std::string input;
+		std::ostringstream screens;
+		std::string output;
+		std::size_t sent = 0;
+		// What epoll is watching for, and whether to hang up once the output is sent
+		std::uint32_t events = 0;
+		bool closing = false;
+		Scenes::Session session;
+		// ctor(s)
+		Connection(const int& _fd, Store::Engine& store, const std::string& player)
+			: fd(_fd), session(screens, false) {
+			session.store = &store;
+			session.player = player;
+		}
+	};
+
+	/* Hosts the games: accepts connections, feeds each one  *
+	* its lines as they arrive and sends back what the      *
+	* session drew, in one write per batch. A reader that   *
+	* falls behind by maxOutput isn't read from until it    *
+	* catches up. Throws std::runtime_error if the port     *
+	* can't be listened on.                                 */
+	class Host {
+	private:
+		Store::Engine& store;
+		int epoll = -1, listener = -1;
+		// Connections by socket
+		std::vector<std::unique_ptr<Connection>> connections;
+		// Whether the listener is set aside (out of sockets until one closes)
+		bool full = false;
+		std::size_t open = 0, peak = 0;
+		std::uint64_t accepted = 0, lines = 0;
+		void watch(Connection& connection) {
+			const std::size_t pending = connection.output.size() - connection.sent;
+			std::uint32_t events = pending > 0 ? static_cast<std::uint32_t>(EPOLLOUT) : 0;
+			if (!connection.closing && pending < maxOutput) events |= EPOLLIN;
+			if (events == connection.events) return;
+			epoll_event event{};
+			event.events = events;
+			event.data.fd = connection.fd;
+			epoll_ctl(epoll, EPOLL_CTL_MOD, connection.fd, &event);
+			connection.events = events;
+		}
+		void close(Connection& connection) {
+			const int fd = connection.fd;
+			::close(fd);
+			connections[static_cast<std::size_t>(fd)].reset();
+			open--;
+			if (full) {
+				epoll_event event{};
+				event.events = EPOLLIN;
+				event.data.fd = listener;
+				epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event);
+				full = false;
 			}
-			break;
-		case 4:
-			ClearScreen();
-			cout << "-*- Rocket Wrestling -*-" << endl;
-			cout << "\nAs you walk in, a massive explosion rings out and two skeleton samurais\njump down from nowhere. They greet you with power gloves primed.\nThey lift up their weapons and smile. They show you around." << endl;
-			cout << "\n1) Leather Gloves - " << WeaponTable.generate("Leather Gloves").getBuyPrice() << " Dust\n2) Red Rubber Gloves - " << WeaponTable.generate("Red Rubber Gloves").getBuyPrice() << " Dust\n3) Brass Knuckles - " << WeaponTable.generate("Brass Knuckles").getBuyPrice() << " Dust\n4) Power Glove - " << WeaponTable.generate("Power Glove").getBuyPrice() << " Dust" << endl;
-			cout << "5) Torched Wristband - " << WeaponTable.generate("Torched Wristband").getBuyPrice() << " Dust\n6) Hell-Forged Wristband - " << WeaponTable.generate("Hell-Forged Wristband").getBuyPrice() << " Dust" << endl;
-			cout << "\n0) Exit" << endl;
-			cin >> input2;
-			switch (input2) {
-			case 1:
-				if (Charac.dust < WeaponTable.generate("Leather Gloves").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
+		}
+		void accept() {
+			for (;;) {
+				const int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+				if (fd < 0) {
+					if (errno == EMFILE || errno == ENFILE) {
+						// Stop hearing about connections nobody can take
+						epoll_ctl(epoll, EPOLL_CTL_DEL, listener, nullptr);
+						full = true;
+					}
+					return;
 				}
-				else if (Charac.dust >= WeaponTable.generate("Leather Gloves").getBuyPrice()) {
-					cout << "You buy the Leather Gloves for " << WeaponTable.generate("Leather Gloves").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Leather Gloves").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Leather Gloves"));
-					wait_enter();
-					break;
+				const int on = 1;
+				setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+				if (connections.size() <= static_cast<std::size_t>(fd)) connections.resize(static_cast<std::size_t>(fd) + 1);
+				connections[static_cast<std::size_t>(fd)] = std::make_unique<Connection>(fd, store, "guest" + std::to_string(++accepted));
+				Connection& connection = *connections[static_cast<std::size_t>(fd)];
+				epoll_event event{};
+				event.events = connection.events = EPOLLIN;
+				event.data.fd = fd;
+				epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+				peak = std::max(peak, ++open);
+				connection.screens << "Playing as " << connection.session.player << " (/player <name> to change, /quit to leave)" << endl;
+				connection.session.start(Scenes::SceneID::START);
+				connection.output = connection.screens.str();
+				connection.output += prompt;
+				connection.screens.str(std::string());
+				flush(connection);
+			}
+		}
+		// Handles a whole line: a command, or the session's next line.
+		void line(Connection& connection, const std::string& text) {
+			if (text.empty() || text[0] != '/') {
+				connection.session.handle(text);
+				lines++;
+				if (!connection.session.isRunning()) connection.closing = true;
+				return;
+			}
+			const std::string command = Scenes::word(text);
+			if (command == "/quit") {
+				connection.closing = true;
+				return;
+			}
+			if (command == "/player") {
+				const std::string name = Scenes::word(text.substr(command.size()));
+				if (validPlayer(name)) {
+					connection.session.player = name;
+					connection.screens << "Playing as " << name << "." << endl;
 				}
-				break;
-			case 2:
-				if (Charac.dust < WeaponTable.generate("Red Rubber Gloves").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
+				else connection.screens << "Names are 1 to 32 letters, digits, _ or -." << endl;
+				return;
+			}
+			connection.screens << "Commands: /player <name>, /quit" << endl;
+		}
+		// Sends what it can of the output. Returns false if the connection closed.
+		bool flush(Connection& connection) {
+			while (connection.sent < connection.output.size()) {
+				const ssize_t put = send(connection.fd, connection.output.data() + connection.sent, connection.output.size() - connection.sent, MSG_NOSIGNAL);
+				if (put < 0) {
+					if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+					if (errno == EINTR) continue;
+					close(connection);
+					return false;
 				}
-				else if (Charac.dust >= WeaponTable.generate("Red Rubber Gloves").getBuyPrice()) {
-					cout << "You buy the Red Rubber Gloves for " << WeaponTable.generate("Red Rubber Gloves").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Red Rubber Gloves").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Red Rubber Gloves"));
-					wait_enter();
-					break;
+				connection.sent += static_cast<std::size_t>(put);
+			}
+			if (connection.sent == connection.output.size()) {
+				// Don't keep a big buffer around for every idle player
+				if (connection.output.capacity() > readSize) std::string().swap(connection.output);
+				else connection.output.clear();
+				connection.sent = 0;
+				if (connection.closing) {
+					close(connection);
+					return false;
 				}
-				break;
-			case 3:
-				if (Charac.dust < WeaponTable.generate("Brass Knuckles").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
+			}
+			watch(connection);
+			return true;
+		}
+		/* Plays the whole lines that came in (while the output  *
+		* has room), then sends the screens they drew with a    *
+		* prompt after the last. Lines left over wait for the   *
+		* output to drain.                                      */
+		void pump(Connection& connection) {
+			for (;;) {
+				std::size_t start = 0;
+				bool played = false;
+				while (!connection.closing && connection.output.size() - connection.sent + static_cast<std::size_t>(connection.screens.tellp()) < maxOutput) {
+					const std::size_t end = connection.input.find('\n', start);
+					if (end == std::string::npos) break;
+					std::string text(connection.input, start, end - start);
+					if (!text.empty() && text.back() == '\r') text.pop_back();
+					line(connection, text);
+					start = end + 1;
+					played = true;
 				}
-				else if (Charac.dust >= WeaponTable.generate("Brass Knuckles").getBuyPrice()) {
-					cout << "You buy the Brass Knuckles for " << WeaponTable.generate("Brass Knuckles").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Brass Knuckles").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Brass Knuckles"));
-					wait_enter();
-					break;
+				connection.input.erase(0, start);
+				const bool waiting = connection.input.find('\n') != std::string::npos;
+				if (!waiting && connection.input.size() > maxLine) {
+					connection.screens << "That line is too long." << endl;
+					connection.closing = true;
 				}
-				break;
-			case 4:
-				if (Charac.dust < WeaponTable.generate("Power Glove").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
+				connection.output += connection.screens.str();
+				connection.screens.str(std::string());
+				if (played && !waiting && !connection.closing) connection.output += prompt;
+				if (!flush(connection)) return;
+				// Carry on if the output went straight out
+				if (!waiting || connection.closing || connection.sent < connection.output.size()) return;
+			}
+		}
+		void read(Connection& connection) {
+			char bytes[readSize];
+			const ssize_t got = recv(connection.fd, bytes, sizeof(bytes), 0);
+			if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+			if (got <= 0) {
+				close(connection);
+				return;
+			}
+			connection.input.append(bytes, static_cast<std::size_t>(got));
+			pump(connection);
+		}
+		// Closes the sockets (once the connections are gone).
+		void shut() {
+			if (listener >= 0) ::close(listener);
+			if (epoll >= 0) ::close(epoll);
+			listener = epoll = -1;
+		}
+	public:
+		// ctor(s)
+		Host(Store::Engine& _store, const std::uint16_t& port) : store(_store) {
+			epoll = epoll_create1(EPOLL_CLOEXEC);
+			listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+			if (epoll < 0 || listener < 0) {
+				shut();
+				throw std::runtime_error(std::string("Can't start the server: ") + std::strerror(errno));
+			}
+			const int on = 1;
+			setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+			const sockaddr_in address = localhost(port);
+			if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+				const std::string reason = std::strerror(errno);
+				shut();
+				throw std::runtime_error("Can't listen on port " + std::to_string(port) + ": " + reason);
+			}
+			epoll_event event{};
+			event.events = EPOLLIN;
+			event.data.fd = listener;
+			epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event);
+		}
+		Host(const Host&) = delete;
+		Host& operator=(const Host&) = delete;
+		// dtor(s)
+		~Host() {
+			for (std::unique_ptr<Connection>& connection : connections)
+				if (connection != nullptr) ::close(connection->fd);
+			connections.clear();
+			shut();
+		}
+		// Serves until stopping is set.
+		void run() {
+			std::array<epoll_event, 256> events;
+			while (!stopping) {
+				const int count = epoll_wait(epoll, events.data(), static_cast<int>(events.size()), -1);
+				if (count < 0) {
+					if (errno == EINTR) continue;
+					throw std::runtime_error(std::string("The server stopped: ") + std::strerror(errno));
 				}
-				else if (Charac.dust >= WeaponTable.generate("Power Glove").getBuyPrice()) {
-					cout << "You buy the Power Glove for " << WeaponTable.generate("Power Glove").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Power Glove").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Power Glove"));
-					wait_enter();
-					break;
+				for (int i = 0; i < count; i++) {
+					const int fd = events[static_cast<std::size_t>(i)].data.fd;
+					const std::uint32_t ready = events[static_cast<std::size_t>(i)].events;
+					if (fd == listener) {
+						accept();
+						continue;
+					}
+					// (It may have closed earlier in this batch)
+					if (static_cast<std::size_t>(fd) >= connections.size() || connections[static_cast<std::size_t>(fd)] == nullptr) continue;
+					Connection& connection = *connections[static_cast<std::size_t>(fd)];
+					if (ready & (EPOLLIN | EPOLLERR | EPOLLHUP)) read(connection);
+					else if (ready & EPOLLOUT) pump(connection);
 				}
+			}
+		}
+		// Getter functions
+		std::size_t getPeak() const {
+			return peak;
+		}
+		std::uint64_t getAccepted() const {
+			return accepted;
+		}
+		std::uint64_t getLines() const {
+			return lines;
+		}
+	};
+
+	// Serves games from a store until SIGINT or SIGTERM.
+	inline int run(const std::uint16_t& port, const std::string& storePath) {
+		raiseFileLimit();
+		std::signal(SIGINT, stop);
+		std::signal(SIGTERM, stop);
+		try {
+			Store::Engine store;
+			store.open(storePath);
+			{
+				Host host(store, port);
+				cout << "Serving on 127.0.0.1:" << port << ", saving to " << storePath << endl;
+				host.run();
+				cout << host.getAccepted() << " connections (at most " << host.getPeak() << " at once), " << host.getLines() << " lines" << endl;
+			}
+			store.close();
+		}
+		catch (const std::exception& e) {
+			cout << e.what() << endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	// One scripted player for the load generator.
+	struct Client {
+		int fd = -1;
+		// The next line to send, and the end of what came back (to spot the prompt)
+		std::size_t next = 0;
+		std::string tail;
+		std::chrono::steady_clock::time_point asked;
+	};
+
+	/* Replays a script from sessions connections at once,   *
+	* each sending a line when the last one's screen is in, *
+	* and reports the lines per second and how long screens *
+	* took to come back.                                    */
+	inline int replay(const std::size_t& sessions, const std::uint16_t& port, const std::string& script) {
+		raiseFileLimit();
+		const std::vector<std::string> lines = scriptLines(script);
+		const int epoll = epoll_create1(EPOLL_CLOEXEC);
+		if (epoll < 0) {
+			cout << "Can't start: " << std::strerror(errno) << endl;
+			return 1;
+		}
+		std::vector<Client> clients(sessions);
+		std::vector<float> latencies;
+		latencies.reserve(sessions * lines.size());
+		std::size_t active = 0, finished = 0, ended = 0, failed = 0;
+		const sockaddr_in address = localhost(port);
+		const auto begin = std::chrono::steady_clock::now();
+		for (std::size_t i = 0; i < sessions; i++) {
+			Client& client = clients[i];
+			client.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+			if (client.fd < 0) {
+				failed++;
+				continue;
+			}
+			const int on = 1;
+			setsockopt(client.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+			if (connect(client.fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 && errno != EINPROGRESS) {
+				::close(client.fd);
+				client.fd = -1;
+				failed++;
+				continue;
+			}
+			epoll_event event{};
+			event.events = EPOLLIN;
+			event.data.u64 = i;
+			epoll_ctl(epoll, EPOLL_CTL_ADD, client.fd, &event);
+			active++;
+		}
+		const auto hangUp = [&](Client& client) {
+			::close(client.fd);
+			client.fd = -1;
+			active--;
+		};
+		std::array<epoll_event, 256> events;
+		char bytes[readSize];
+		while (active > 0) {
+			const int count = epoll_wait(epoll, events.data(), static_cast<int>(events.size()), 10000);
+			if (count < 0 && errno == EINTR) continue;
+			if (count <= 0) {
+				cout << "The server stopped answering (" << active << " sessions waiting)" << endl;
 				break;
-			case 5:
-				if (Charac.dust < WeaponTable.generate("Torched Wristband").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
-				}
-				else if (Charac.dust >= WeaponTable.generate("Torched Wristband").getBuyPrice()) {
-					cout << "You buy the Torched Wristband for " << WeaponTable.generate("Torched Wristband").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Torched Wristband").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Torched Wristband"));
-					wait_enter();
+			}
+			for (int e = 0; e < count; e++) {
+				Client& client = clients[events[static_cast<std::size_t>(e)].data.u64];
+				if (client.fd < 0) continue;
+				// Read all there is, keeping the last few bytes
+				bool closed = false;
+				for (;;) {
+					const ssize_t got = recv(client.fd, bytes, sizeof(bytes), 0);
+					if (got > 0) {
+						const std::size_t keep = std::min(static_cast<std::size_t>(got), prompt.size());
+						client.tail.append(bytes + got - keep, keep);
+						if (client.tail.size() > prompt.size()) client.tail.erase(0, client.tail.size() - prompt.size());
+						continue;
+					}
+					if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) closed = true;
+					if (got < 0 && errno == EINTR) continue;
 					break;
 				}
-				break;
-			case 6:
-				if (Charac.dust < WeaponTable.generate("Hell-Forged Wristband").getBuyPrice()) {
-					cout << "You do not have enough dust." << endl;
-					wait_enter();
-					break;
+				if (client.tail == prompt) {
+					client.tail.clear();
+					const auto now = std::chrono::steady_clock::now();
+					if (client.next > 0) latencies.push_back(std::chrono::duration<float, std::micro>(now - client.asked).count());
+					if (client.next == lines.size()) {
+						finished++;
+						hangUp(client);
+						continue;
+					}
+					const std::string line = lines[client.next++] + "\n";
+					client.asked = now;
+					if (send(client.fd, line.data(), line.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(line.size())) {
+						failed++;
+						hangUp(client);
+						continue;
+					}
 				}
-				else if (Charac.dust >= WeaponTable.generate("Hell-Forged Wristband").getBuyPrice()) {
-					cout << "You buy the Hell-Forged Wristband for " << WeaponTable.generate("Hell-Forged Wristband").getBuyPrice() << " dust." << endl;
-					Charac.dust = Charac.dust - WeaponTable.generate("Hell-Forged Wristband").getBuyPrice();
-					Charac.inventory.addItem(WeaponTable.generate("Hell-Forged Wristband"));
-					wait_enter();
-					break;
+				if (closed) {
+					// The game ended before the script did (or the connection failed)
+					if (client.next > 0) ended++;
+					else failed++;
+					hangUp(client);
 				}
-				break;
 			}
-			break;
-		case 5:
-			ClearScreen();
-			cout << "-*- Mike's Friendly Store -*-" << endl;
-			cout << "A very disgusting looking teen at the counter greets you as you walk in\n'Welcome to the store. SIR.' He says, with a very punchable face." << endl;
-			cout << "\n1) Normal Health Potion - " << ConsumableTable.generate("Normal Health Potion").getBuyPrice() << " Dust\n2) Greater Health Potion - " << ConsumableTable.generate("Greater Health Potion").getBuyPrice() << " Dust\n3) Super Health Potion - " << ConsumableTable.generate("Super Health Potion").getBuyPrice() << " Dust" << endl;
-			cout << "4) Full Health Potion - " << ConsumableTable.generate("Full Health Potion").getBuyPrice() << " Dust\n\n5) Normal Mana Potion - " << ConsumableTable.generate("Normal Mana Potion").getBuyPrice() << " Dust\n6) Greater Mana Potion - " << ConsumableTable.generate("Greater Mana Potion").getBuyPrice() << " Dust" << endl;
-			cout << "7) Super Mana Potion - " << ConsumableTable.generate("Super Mana Potion").getBuyPrice() << " Dust\n8) Full Mana Potion - " << ConsumableTable.generate("Full Mana Potion").getBuyPrice() << " Dust" << endl;
-			cin >> input2;
-			switch (input2) {
-			case 1:
-				cout << "How many would you like to buy? (" << ConsumableTable.generate("Normal Health Potion").getBuyPrice() << " Each)" << endl;
-				cin >> input2;
-				if (input2 * ConsumableTable.generate("Normal Health Potion").getBuyPrice() > Charac.dust) {
-					cout << "You do not have enough dust!" << endl;
-					wait_enter();
-					home();
-				}
-				else if (input2 * ConsumableTable.generate("Normal Health Potion").getBuyPrice() <= Charac.dust) {
-					cout << "You bought " << input2 << " Normal Health Potions for " << input2 * ConsumableTable.generate("Normal Health Potion").getBuyPrice() << " dust" << endl;
-					Charac.dust -= input2 * ConsumableTable.generate("Normal Health Potion").getBuyPrice();
-					for (std::size_t i = 0; i < input2; ++i)
-						Charac.inventory.addItem(ConsumableTable.generate("Normal Health Potion"));
-					wait_enter();
-				}
-				break;
-			case 2:
-				cout << "How many would you like to buy? (" << ConsumableTable.generate("Greater Health Potion").getBuyPrice() << " Each)" << endl;
-				cin >> input2;
-				if (input2 * ConsumableTable.generate("Greater Health Potion").getBuyPrice() > Charac.dust) {
-					cout << "You do not have enough dust!" << endl;
-					wait_enter();
-					home();
-				}
-				else if (input2 * ConsumableTable.generate("Greater Health Potion").getBuyPrice() <= Charac.dust) {
-					cout << "You bought " << input2 << " Greater Health Potions for " << input2 * ConsumableTable.generate("Greater Health Potion").getBuyPrice() << " dust" << endl;
-					Charac.dust -= input2 * ConsumableTable.generate("Greater Health Potion").getBuyPrice();
-					for (std::size_t i = 0; i < input2; ++i)
-						Charac.inventory.addItem(ConsumableTable.generate("Greater Health Potion"));
-					wait_enter();
-				}
-				break;
-			case 3:
-				cout << "How many would you like to buy? (" << ConsumableTable.generate("Super Health Potion").getBuyPrice() << " Each)" << endl;
-				cin >> input2;
-				if (input2 * ConsumableTable.generate("Super Health Potion").getBuyPrice() > Charac.dust) {
-					cout << "You do not have enough dust!" << endl;
-					wait_enter();
-					home();
-				}
-				else if (input2 * ConsumableTable.generate("Super Health Potion").getBuyPrice() <= Charac.dust) {
-					cout << "You bought " << input2 << " Super Health Potions for " << input2 * ConsumableTable.generate("Super Health Potion").getBuyPrice() << " dust" << endl;
-					Charac.dust -= input2 * ConsumableTable.generate("Super Health Potion").getBuyPrice();
-					for (std::size_t i = 0; i < input2; ++i)
-						Charac.inventory.addItem(ConsumableTable.generate("Super Health Potion"));
-					wait_enter();
-				}
-				break;
-			case 4:
-				cout << "How many would you like to buy? (" << ConsumableTable.generate("Full Health Potion").getBuyPrice() << " Each)" << endl;
-				cin >> input2;
-				if (input2 * ConsumableTable.generate("Full Health Potion").getBuyPrice() > Charac.dust) {
-					cout << "You do not have enough dust!" << endl;
-					wait_enter();
-					home();
-				}
-				else if (input2 * ConsumableTable.generate("Full Health Potion").getBuyPrice() <= Charac.dust) {
-					cout << "You bought " << input2 << " Full Health Potions for " << input2 * ConsumableTable.generate("Full Health Potion").getBuyPrice() << " dust" << endl;
-					Charac.dust -= input2 * ConsumableTable.generate("Full Health Potion").getBuyPrice();
-					for (std::size_t i = 0; i < input2; ++i)
-						Charac.inventory.addItem(ConsumableTable.generate("Full Health Potion"));
-					wait_enter();
-				}
-				break;
-			case 5:
-				cout << "How many would you like to buy? (" << ConsumableTable.generate("Normal Mana Potion").getBuyPrice() << " Each)" << endl;
-				cin >> input2;
-				if (input2 * ConsumableTable.generate("Normal Mana Potion").getBuyPrice() > Charac.dust) {
-					cout << "You do not have enough dust!" << endl;
-					wait_enter();
-					home();
-				}
-				else if (input2 * ConsumableTable.generate("Normal Mana Potion").getBuyPrice() <= Charac.dust) {
-					cout << "You bought " << input2 << " Normal Mana Potions for " << input2 * ConsumableTable.generate("Normal Mana Potion").getBuyPrice() << " dust" << endl;
-					Charac.dust -= input2 * ConsumableTable.generate("Normal Mana Potion").getBuyPrice();
-					for (std::size_t i = 0; i < input2; ++i)
-						Charac.inventory.addItem(ConsumableTable.generate("Normal Mana Potion"));
-					wait_enter();
-				}
-				break;
-			case 6:
-				cout << "How many would you like to buy? (" << ConsumableTable.generate("Greater Mana Potion").getBuyPrice() << " Each)" << endl;
-				cin >> input2;
-				if (input2 * ConsumableTable.generate("Greater Mana Potion").getBuyPrice() > Charac.dust) {
-					cout << "You do not have enough dust!" << endl;
-					wait_enter();
-					home();
-				}
-				else if (input2 * ConsumableTable.generate("Greater Mana Potion").getBuyPrice() <= Charac.dust) {
-					cout << "You bought " << input2 << " Greater Mana Potions for " << input2 * ConsumableTable.generate("Greater Mana Potion").getBuyPrice() << " dust" << endl;
-					Charac.dust -= input2 * ConsumableTable.generate("Greater Mana Potion").getBuyPrice();
-					for (std::size_t i = 0; i < input2; ++i)
-						Charac.inventory.addItem(ConsumableTable.generate("Greater Mana Potion"));
-					wait_enter();
-				}
-				break;
-			case 7:
-				cout << "How many would you like to buy? (" << ConsumableTable.generate("Super Mana Potion").getBuyPrice() << " Each)" << endl;
-				cin >> input2;
-				if (input2 * ConsumableTable.generate("Super Mana Potion").getBuyPrice() > Charac.dust) {
-					cout << "You do not have enough dust!" << endl;
-					wait_enter();
-					home();
-				}
-				else if (input2 * ConsumableTable.generate("Super Mana Potion").getBuyPrice() <= Charac.dust) {
-					cout << "You bought " << input2 << " Super Mana Potions for " << input2 * ConsumableTable.generate("Super Mana Potion").getBuyPrice() << " dust" << endl;
-					Charac.dust -= input2 * ConsumableTable.generate("Super Mana Potion").getBuyPrice();
-					for (std::size_t i = 0; i < input2; ++i)
-						Charac.inventory.addItem(ConsumableTable.generate("Super Mana Potion"));
-					wait_enter();
-				}
+		}
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		for (Client& client : clients)
+			if (client.fd >= 0) ::close(client.fd);
+		::close(epoll);
+		cout << "-*- Load -*-" << endl;
+		printf("%zu sessions of %zu lines on port %u\n%zu finished, %zu ended early, %zu failed\n", sessions, lines.size(), static_cast<unsigned int>(port), finished, ended, failed);
+		printf("%zu lines in %.2f s, %.0f lines per second\n", latencies.size(), seconds, latencies.size() / seconds);
+		if (!latencies.empty()) {
+			const auto percentile = [&](const double& p) {
+				const std::size_t rank = std::min(latencies.size() - 1, static_cast<std::size_t>(p * latencies.size()));
+				std::nth_element(latencies.begin(), latencies.begin() + static_cast<std::ptrdiff_t>(rank), latencies.end());
+				return latencies[rank];
+			};
+			printf("Microseconds from a line to its screen: median %.0f, 99%% %.0f, worst %.0f\n", percentile(0.5), percentile(0.99), percentile(1.0));
+		}
+		return failed > 0 ? 1 : 0;
+	}
+#else
+	inline int run(const std::uint16_t&, const std::string&) {
+		cout << "The server needs Linux (it waits on sockets with epoll)." << endl;
+		return 1;
+	}
+	inline int replay(const std::size_t&, const std::uint16_t&, const std::string&) {
+		cout << "The load generator needs Linux (it waits on sockets with epoll)." << endl;
+		return 1;
+	}
+#endif
+}
+
+/* The Balance namespace simulates whole runs of the     *
+* game to check the tuning: every combination of race,  *
+* class, past and difficulty, many runs each, spread    *
+* over all cores. Runs are seeded by their number, so   *
+* the same seed gives the same report on any machine    *
+* and with any number of threads. Start the game with   *
+* "--balance [runs] [seed] [threads]" to run it.        */
+namespace Balance
+{
+	// A run ends at this level, at death, or after this many fights.
+	constexpr int targetLevel = 5;
+	constexpr unsigned int maxFights = 100;
+	// Runs per task (the unit of work the threads share out).
+	constexpr std::size_t runsPerTask = 64;
+	// The starting choices of a run (all counted from 0).
+	struct Build {
+		int race, clas, origin, profession, necromancer, weapon;
+	};
+	// The number of choices for each question, and of builds.
+	constexpr int choiceCounts[6] = { 6, 4, 6, 5, 3, 4 };
+	constexpr std::size_t buildCount = 6 * 4 * 6 * 5 * 3 * 4;
+	// Gets a build by number.
+	inline Build buildAt(std::size_t index) {
+		int choices[6];
+		for (int i = 5; i >= 0; i--) {
+			choices[i] = static_cast<int>(index % choiceCounts[i]);
+			index /= choiceCounts[i];
+		}
+		return Build{ choices[0], choices[1], choices[2], choices[3], choices[4], choices[5] };
+	}
+	/* The Histogram struct counts small whole numbers      *
+	* (the last bin takes everything bigger). Counts are   *
+	* integers, so merging in any order gives the same     *
+	* result.                                              */
+	struct Histogram {
+		std::array<std::uint64_t, 128> bins{};
+		void add(const unsigned int& value) {
+			bins[std::min<std::size_t>(value, bins.size() - 1)]++;
+		}
+		void merge(const Histogram& other) {
+			for (std::size_t i = 0; i < bins.size(); i++)
+				bins[i] += other.bins[i];
+		}
+		// Gets the value at a percentile (0 to 100) of the counts.
+		unsigned int percentile(const double& p) const {
+			std::uint64_t total = 0;
+			for (const std::uint64_t& count : bins) total += count;
+			if (total == 0) return 0;
+			const std::uint64_t rank = static_cast<std::uint64_t>(p / 100 * (total - 1));
+			std::uint64_t seen = 0;
+			for (std::size_t i = 0; i < bins.size(); i++) {
+				seen += bins[i];
+				if (seen > rank) return static_cast<unsigned int>(i);
+			}
+			return static_cast<unsigned int>(bins.size() - 1);
+		}
+	};
+	// How one run went.
+	struct RunResult {
+		unsigned int fights = 0;
+		unsigned int wins = 0;
+		bool died = false;
+		bool reached = false;
+		int dust = 0;
+	};
+	// The totals of a group of runs.
+	struct Group {
+		std::uint64_t runs = 0, fights = 0, wins = 0, deaths = 0, reached = 0;
+		// Fights it took the runs that got there to reach the target level
+		Histogram fightsToLevel;
+		// Dust earned per fight, for each run
+		Histogram dustPerFight;
+		void add(const RunResult& run) {
+			runs++;
+			fights += run.fights;
+			wins += run.wins;
+			deaths += run.died;
+			reached += run.reached;
+			if (run.reached) fightsToLevel.add(run.fights);
+			if (run.fights > 0) dustPerFight.add(static_cast<unsigned int>(run.dust) / run.fights);
+		}
+		void merge(const Group& other) {
+			runs += other.runs;
+			fights += other.fights;
+			wins += other.wins;
+			deaths += other.deaths;
+			reached += other.reached;
+			fightsToLevel.merge(other.fightsToLevel);
+			dustPerFight.merge(other.dustPerFight);
+		}
+	};
+	// The totals by difficulty, race, class and profession (one per thread,
+	// kept on separate cache lines).
+	struct alignas(64) Report {
+		std::array<Group, 6> byOrigin;
+		std::array<Group, 6> byRace;
+		std::array<Group, 4> byClass;
+		std::array<Group, 5> byProfession;
+		void add(const Build& build, const RunResult& run) {
+			byOrigin[build.origin].add(run);
+			byRace[build.race].add(run);
+			byClass[build.clas].add(run);
+			byProfession[build.profession].add(run);
+		}
+		void merge(const Report& other) {
+			for (std::size_t i = 0; i < byOrigin.size(); i++) byOrigin[i].merge(other.byOrigin[i]);
+			for (std::size_t i = 0; i < byRace.size(); i++) byRace[i].merge(other.byRace[i]);
+			for (std::size_t i = 0; i < byClass.size(); i++) byClass[i].merge(other.byClass[i]);
+			for (std::size_t i = 0; i < byProfession.size(); i++) byProfession[i].merge(other.byProfession[i]);
+		}
+	};
+	/* A Start is a build made into a fighter (the same way *
+	* character creation does it, holding the Stick), plus *
+	* how the simulated player plays it: Bone Barons never *
+	* cast, and mages and warlocks level intelligence      *
+	* where the rest level strength.                       */
+	struct Start {
+		Combat::Fighter fighter;
+		double difficulty;
+		bool casts;
+		Leveling::Policy leveling;
+	};
+	inline Start makeStart(const Build& build) {
+		Character character;
+		Accuracy accuracy{};
+		applyRace(character, build.race + 1);
+		character.clas = classNames[build.clas];
+		applyOrigin(character, build.origin + 1);
+		applyProfession(character, accuracy, build.profession + 1);
+		applyNecromancer(character, build.necromancer + 1);
+		applyWeaponSkill(character, build.weapon + 1);
+		rollStartingStats(character);
+		character.inventory.addItem(WeaponTable.generate("Stick"));
+		character.equip(character.inventory.getHandle(0));
+		const Leveling::Stat levels = build.clas == 1 || build.clas == 2 ? Leveling::Stat::ITL : Leveling::Stat::STR;
+		return Start{ toFighter(character), character.difficultyD, build.clas != 3, Leveling::Policy::automatic(levels) };
+	}
+	/* Plays one run: explore and fight until the target    *
+	* level or death, levelling up like victory() does and *
+	* buying Normal Health Potions (and Normal Mana        *
+	* Potions, for casters) between fights.                */
+	inline RunResult simulate(const Start& start, Combat::Random random) {
+		const Consumable& healthPotion = ConsumableTable.generate("Normal Health Potion");
+		const Consumable& manaPotion = ConsumableTable.generate("Normal Mana Potion");
+		Combat::Fighter player = start.fighter;
+		Leveling::Policy leveling = start.leveling;
+		int exp = 0;
+		int dust = Character().dust;
+		double expmultiplier = 1;
+		RunResult result;
+		while (result.fights < maxFights && player.lvl < targetLevel) {
+			Combat::State state{ player, Combat::generateEnemy(player, start.difficulty, random), random };
+			while (state.outcome == Combat::Outcome::ONGOING) {
+				const bool cast = start.casts && state.player.mp >= Combat::castCost
+					&& state.player.spellDamage + state.player.itl * 2 > state.player.damage + state.player.str;
+				state = Combat::step(state, Combat::Action{ cast ? Combat::Action::Type::CAST : Combat::Action::Type::ATTACK }).state;
+			}
+			random = state.random;
+			player = state.player;
+			result.fights++;
+			if (state.outcome == Combat::Outcome::LOST) {
+				result.died = true;
 				break;
-			case 8:
-				cout << "How many would you like to buy? (" << ConsumableTable.generate("Full Mana Potion").getBuyPrice() << " Each)" << endl;
-				cin >> input2;
-				if (input2 * ConsumableTable.generate("Full Mana Potion").getBuyPrice() > Charac.dust) {
-					cout << "You do not have enough dust!" << endl;
-					wait_enter();
-					home();
-				}
-				else if (input2 * ConsumableTable.generate("Full Mana Potion").getBuyPrice() <= Charac.dust) {
-					cout << "You bought " << input2 << " Full Mana Potions for " << input2 * ConsumableTable.generate("Full Mana Potion").getBuyPrice() << " dust" << endl;
-					Charac.dust -= input2 * ConsumableTable.generate("Full Mana Potion").getBuyPrice();
-					for (std::size_t i = 0; i < input2; ++i)
-						Charac.inventory.addItem(ConsumableTable.generate("Full Mana Potion"));
-					wait_enter();
+			}
+			result.wins++;
+			const Combat::Rewards rewards = Combat::reward(state.enemy, start.difficulty, random);
+			dust += rewards.dust;
+			result.dust += rewards.dust;
+			exp += rewards.exp;
+			const int levels = Leveling::levelsFor(exp, player.lvl, start.difficulty, expmultiplier);
+			if (levels > 0) {
+				player.lvl += levels;
+				expmultiplier = Leveling::multiplierAfter(expmultiplier, levels);
+				const Leveling::Allocation gains = Leveling::roll(leveling.allocate(levels), random);
+				player.str += gains[0];
+				player.itl += gains[1];
+				player.spd += gains[2];
+				player.def += gains[3];
+			}
+			// Heal up for the next fight
+			Combat::Events events;
+			while (player.hp < player.maxHP && dust >= healthPotion.getBuyPrice()) {
+				dust -= healthPotion.getBuyPrice();
+				events.count = 0;
+				Combat::use(player, healthPotion, Combat::Side::PLAYER, events);
+			}
+			while (start.casts && player.mp < Combat::castCost && dust >= manaPotion.getBuyPrice()) {
+				dust -= manaPotion.getBuyPrice();
+				events.count = 0;
+				Combat::use(player, manaPotion, Combat::Side::PLAYER, events);
+			}
+		}
+		result.reached = player.lvl >= targetLevel;
+		return result;
+	}
+	/* The WorkStealingPool class runs numbered tasks on    *
+	* worker threads. Each worker starts with an even,     *
+	* contiguous share of the tasks in its own queue and   *
+	* works from the back of it; a worker that runs out    *
+	* steals from the front of the others' queues.         */
+	class WorkStealingPool {
+	private:
+		struct alignas(64) Queue {
+			std::mutex lock;
+			std::deque<std::size_t> tasks;
+		};
+	public:
+		// Runs task(worker, index) for every index below taskCount.
+		template<class Task>
+		static void run(const std::size_t& taskCount, const unsigned int& threadCount, Task task) {
+			std::vector<Queue> queues(threadCount);
+			for (std::size_t i = 0; i < taskCount; i++)
+				queues[i * threadCount / taskCount].tasks.push_back(i);
+			// Takes a task from a worker's own queue, or steals one
+			const auto take = [&queues, threadCount](const unsigned int& worker, std::size_t& index) {
+				for (unsigned int k = 0; k < threadCount; k++) {
+					Queue& queue = queues[(worker + k) % threadCount];
+					std::lock_guard<std::mutex> guard(queue.lock);
+					if (queue.tasks.empty()) continue;
+					if (k == 0) {
+						index = queue.tasks.back();
+						queue.tasks.pop_back();
+					}
+					else {
+						index = queue.tasks.front();
+						queue.tasks.pop_front();
+					}
+					return true;
 				}
-				break;
+				return false;
+			};
+			std::vector<std::thread> threads;
+			for (unsigned int worker = 0; worker < threadCount; worker++) {
+				threads.emplace_back([&take, &task, worker] {
+					std::size_t index;
+					while (take(worker, index))
+						task(worker, index);
+				});
 			}
-			break;
+			for (std::thread& thread : threads)
+				thread.join();
+		}
+	};
+	// Prints a table of groups.
+	template<std::size_t Count>
+	void printGroups(const char* title, const std::array<Group, Count>& groups, const char* const names[]) {
+		printf("\n%-22s %9s %6s %6s %6s %8s %8s %6s %6s %6s\n", title, "runs", "win%", "died%", "lvl5%", "lvl p50", "lvl p90", "dust", "p50", "p90");
+		printf("%-22s %9s %6s %6s %6s %8s %8s %6s %6s %6s\n", "", "", "", "", "", "(fights)", "", "p10", "", "");
+		for (std::size_t i = 0; i < Count; i++) {
+			const Group& g = groups[i];
+			const double runs = static_cast<double>(std::max<std::uint64_t>(g.runs, 1));
+			printf("%-22s %9llu %6.1f %6.1f %6.1f %8u %8u %6u %6u %6u\n", names[i], static_cast<unsigned long long>(g.runs),
+				100.0 * g.wins / std::max<std::uint64_t>(g.fights, 1), 100.0 * g.deaths / runs, 100.0 * g.reached / runs,
+				g.fightsToLevel.percentile(50), g.fightsToLevel.percentile(90),
+				g.dustPerFight.percentile(10), g.dustPerFight.percentile(50), g.dustPerFight.percentile(90));
 		}
 	}
-}
-
-void home() {
-	bool homemenu = true;
-	while (homemenu == true) {
-		ClearScreen();
-		cout << "-*- Home -*-" << endl;
-		cout << "1) Explore\n2) Workshop\n3) Black Market\n4) Inventory\n5) Save" << endl;
-		cout << "\n-*- Quick Stats -*-\nHP: " << Charac.hp << "        MP: " << Charac.mp << "\nDust: " << Charac.dust << endl;
-		cin >> input;
-		switch (input) {
-		case 1:
-			//explore();
-			break;
-		case 2:
-			workshop();
-			break;
-		case 3:
-			blackmarket();
-			break;
-		case 4:
-			inventory();
-			break;
+	// Simulates at least a number of runs (spread evenly over the builds) and prints the report.
+	inline int run(const std::uint64_t& runs, const std::uint64_t& seed, unsigned int threadCount) {
+		if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+		const std::size_t runsPerBuild = static_cast<std::size_t>((runs + buildCount - 1) / buildCount);
+		const std::size_t tasksPerBuild = (runsPerBuild + runsPerTask - 1) / runsPerTask;
+		// The starts are worked out once, up front
+		std::vector<Start> starts;
+		starts.reserve(buildCount);
+		for (std::size_t i = 0; i < buildCount; i++)
+			starts.push_back(makeStart(buildAt(i)));
+		std::vector<Report> reports(threadCount);
+		const auto begin = std::chrono::steady_clock::now();
+		WorkStealingPool::run(buildCount * tasksPerBuild, threadCount, [&](const unsigned int& worker, const std::size_t& task) {
+			const std::size_t build = task / tasksPerBuild;
+			const std::size_t first = (task % tasksPerBuild) * runsPerTask;
+			const std::size_t last = std::min(first + runsPerTask, runsPerBuild);
+			for (std::size_t i = first; i < last; i++) {
+				// Each run has its own stream, numbered by the run
+				reports[worker].add(buildAt(build), simulate(starts[build], Combat::Random(seed, Randomness::streamID(Randomness::Subsystem::BALANCE, build * runsPerBuild + i))));
+			}
+		});
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		Report total;
+		for (const Report& report : reports)
+			total.merge(report);
+		cout << "-*- Balance -*-" << endl;
+		printf("%zu runs (%zu per build, %zu builds), seed %llu, %u threads\n%.2f s, %.0f runs per second\n",
+			runsPerBuild * buildCount, runsPerBuild, buildCount, static_cast<unsigned long long>(seed), threadCount, seconds, runsPerBuild * buildCount / seconds);
+		printf("Runs end at level %d, at death, or after %u fights.\n", targetLevel, maxFights);
+		const char* originNames[6];
+		const char* raceNames[6];
+		for (std::size_t i = 0; i < 6; i++) {
+			originNames[i] = origins[i].difficultyName;
+			raceNames[i] = races[i].name;
 		}
+		printGroups("Difficulty", total.byOrigin, originNames);
+		printGroups("Race", total.byRace, raceNames);
+		printGroups("Class", total.byClass, classNames);
+		printGroups("Profession", total.byProfession, professionNames);
+		return 0;
 	}
 }
 
-void pastselec() {
-
-	int pastchoice[10] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-	ClearScreen();
-	cout << "-*- Past Selection -*-" << endl;
-	cout << "Q1) Where did you come from?\n1) Fields of Forgiveness (Easiest)\n2) Dusty Farms (Easy)\n3) Scorched Forest (Normal)\n4) Corrupted Pastures (Hard)\n5) Doomed Lands (Doom)\n6) The Gates of Hell (Brutal)" << endl;
-	cin >> pastchoice[0];
-	if (pastchoice[0] < 1 || pastchoice[0] > 6) {
-		cout << "That choice does not exist... Defaulting to 3. (Normal Difficulty)" << endl;
-		pastchoice[0] = 3;
+/* The Benchmarks namespace has timing runs for the      *
+* engine parts that have to stay fast. Start the game   *
+* with "--bench <name>" to run one, or "--bench all".   */
+namespace Benchmarks
+{
+	// Returns the nanoseconds per call of a function run count times.
+	template<class Function>
+	double timePerCall(const std::size_t& count, Function function) {
+		const auto start = std::chrono::steady_clock::now();
+		for (std::size_t i = 0; i < count; i++)
+			function(i);
+		const auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::nano>(end - start).count() / count;
 	}
-	switch (pastchoice[0]) {
-	case 1:
-		Charac.difficultyN = "Easiest";
-		Charac.difficultyD = .5;
-		break;
-	case 2:
-		Charac.difficultyN = "Easy";
-		Charac.difficultyD = .75;
-		break;
-	case 3:
-		Charac.difficultyN = "Normal";
-		Charac.difficultyD = 1;
-		break; case 3267:
-			cout << "Quickstart activated. Giving DEV Weapon." << endl;
-			Charac.inventory.addItem(WeaponTable.generate("Modal Soul"));
-			wait_enter();
-			home();
-			break;
-		case 4:
-			Charac.difficultyN = "Hard";
-			Charac.difficultyD = 1.5;
-			break;
-		case 5:
-			Charac.difficultyN = "Doom";
-			Charac.difficultyD = 2.25;
-			break;
-		case 6:
-			Charac.difficultyN = "Brutal";
-			Charac.difficultyD = 3;
-			break;
+	// Times adds, stack merges, lookups, takes and deletes for inventories of growing size.
+	void inventory() {
+		cout << "-*- Inventory -*-\n(ns per operation)\n     slots      add    merge   lookup     take   delete" << endl;
+		for (const unsigned int slots : { 20u, 200u, 2000u, 20000u, 65535u }) {
+			// One prototype per slot (item IDs are unsigned shorts, so 65535 is the most)
+			std::vector<Consumable> prototypes;
+			prototypes.reserve(slots);
+			for (unsigned int i = 0; i < slots; i++)
+				prototypes.push_back(Consumable("Bench Item", "", static_cast<unsigned short>(i), 1, 1, 1, 1));
+			Inventory inv;
+			volatile unsigned int sink = 0;
+			const double add = timePerCall(slots, [&](std::size_t i) { inv.addItem(prototypes[i]); });
+			const double merge = timePerCall(slots, [&](std::size_t i) { inv.addItem(prototypes[i]); });
+			const double lookup = timePerCall(slots, [&](std::size_t i) { sink = sink + inv.getSlotIndex(static_cast<unsigned short>(i)); });
+			const double take = timePerCall(slots, [&](std::size_t i) { inv.takeItem(inv.getSlotIndex(static_cast<unsigned short>(i))); });
+			const double remove = timePerCall(slots, [&](std::size_t i) { inv.deleteItem(inv.getSlotIndex(static_cast<unsigned short>(i))); });
+			printf("%10u %8.1f %8.1f %8.1f %8.1f %8.1f\n", slots, add, merge, lookup, take, remove);
+		}
 	}
-	ClearScreen();
-	cout << "Q2) What was your past profession?\n1) Fighter\n2) Summoner\n3) Hunter\n4) Scout\n5) Soldier" << endl;
-	cin >> pastchoice[1];
-	if (pastchoice[1] < 1 || pastchoice[1] > 5) {
-		cout << "That choice does not exist... Defaulting to 1." << endl;
-		pastchoice[1] = 1;
+	// Times full sorts, incremental inserts and filtering on a large stash.
+	void sorting() {
+		cout << "-*- Sorting -*-\n(microseconds)\n     slots     sort   insert   filter" << endl;
+		for (const unsigned int slots : { 1000u, 10000u, 65000u }) {
+			// Weapons with made up names and stats
+			std::vector<std::string> names;
+			std::vector<Weapon> prototypes;
+			names.reserve(slots + 1);
+			prototypes.reserve(slots + 1);
+			for (unsigned int i = 0; i <= slots; i++) {
+				const unsigned int mixed = (i * 2654435761u) >> 8;
+				names.push_back(std::to_string(mixed % 100000) + " Bench Weapon");
+				prototypes.push_back(Weapon(names.back(), "", static_cast<unsigned short>(i), mixed % 300, mixed % 50, 0, mixed % 100, mixed % 2000, mixed % 1500));
+			}
+			Inventory inv;
+			for (unsigned int i = 0; i < slots; i++)
+				inv.addItem(prototypes[i]);
+			SortedView view(inv);
+			std::vector<unsigned int> selected;
+			selected.reserve(slots);
+			// Average a full re-sort over every key
+			const SortKey keys[] = { SortKey::NAME, SortKey::BUY, SortKey::SELL, SortKey::DAMAGE, SortKey::CRIT, SortKey::ACCURACY, SortKey::HEAL, SortKey::CATEGORY };
+			const double sort = timePerCall(std::size(keys), [&](std::size_t i) { view.sortBy(keys[i]); }) / 1000;
+			view.sortBy(SortKey::DAMAGE, true);
+			inv.addItem(prototypes[slots]);
+			const double insert = timePerCall(1, [&](std::size_t) { view.refresh(); }) / 1000;
+			const double filter = timePerCall(1, [&](std::size_t) { view.select(inCategory(Category::WEAPON) & atLeast(SortKey::DAMAGE, 250) & !nameContains("7"), selected); }) / 1000;
+			printf("%10u %8.1f %8.1f %8.1f\n", slots, sort, insert, filter);
+		}
 	}
-	switch (pastchoice[1]) {
-	case 1:
-		Charac.strprof = Charac.strprof + .1;
-		Charac.profession = "Fighter";
-		break;
-	case 2:
-		Charac.itlprof = Charac.itlprof + .1;
-		Charac.profession = "Summoner";
-		break;
-	case 3:
-		Charac.crt = Charac.crt + 2;
-		Acc.headdamagex = Acc.headdamagex + .25;
-		Acc.chestdamagex = Acc.chestdamagex + .15;
-		Acc.rightarmdamagex = Acc.rightarmdamagex + .1;
-		Acc.leftarmdamagex = Acc.leftarmdamagex + .1;
-		Acc.rightlegdamagex = Acc.rightlegdamagex + .1;
-		Acc.leftlegdamagex = Acc.leftlegdamagex + .1;
-		Charac.profession = "Hunter";
-		break;
-	case 4:
-		Charac.spdprof = Charac.spdprof + .1;
-		Charac.profession = "Scout";
-		break;
-	case 5:
-		Charac.defprof = Charac.defprof + .1;
-		Charac.profession = "Soldier";
-		break;
+	// The benchmarked effects in C++, to call through a pointer (as a table of effects would).
+	inline void potionEffect(Stats& stats) {
+		stats[0] += 30;
+		stats[1] += 10;
 	}
-	ClearScreen();
-	cout << "Q3) By whom were you necromanced?\n1) A Necromancer\n2) A Friend\n3) No-one." << endl;
-	cin >> pastchoice[2];
-	if (pastchoice[2] < 1 || pastchoice[2] > 3) {
-		cout << "That choice does not exist... Defaulting to 1." << endl;
-		pastchoice[2] = 1;
+	inline void elixirEffect(Stats& stats) {
+		stats[0] = std::min(stats[0] + 60, stats[2]);
+		stats[1] = std::max(stats[1] - 5, 0);
+		stats[4] += (stats[10] + 3) / 2;
 	}
-	switch (pastchoice[2]) {
-	case 1:
-		Charac.str = Charac.str + 1;
-		Charac.itl = Charac.itl + 1;
-		break;
-	case 2:
-		Charac.def = Charac.def + 3;
-		break;
-	case 3:
-		Charac.crt = Charac.crt + 1;
-		Charac.spdprof = Charac.spdprof + .05;
+	/* Times item effects run as scripts against the same    *
+	* effects written in C++: inlined into the loop (where  *
+	* the stats stay in registers), and called through a    *
+	* pointer, which is the fair comparison for effects     *
+	* chosen at run time.                                   */
+	void scripting() {
+		cout << "-*- Scripting -*-\n(ns per use)\n    effect   script      c++     call" << endl;
+		const Consumable potion("Bench Potion", "", 0, 30, 10, 1, 1);
+		const Consumable elixir("Bench Elixir", "", 0, 30, 10, 1, 1, "hp = min(hp + health * 2, maxhp); mp = max(mp - 5, 0); str += (lvl + 3) / 2");
+		const Script potionScript = Compiler(potion, potion.getEffect()).compile();
+		const Script elixirScript = Compiler(elixir, elixir.getEffect()).compile();
+		constexpr std::size_t count = 10000000;
+		Stats stats{ 1, 1, 1000000, 1000000, 1, 1, 1, 1, 1, 0, 5, 0 };
+		volatile int sink = 0;
+		const double potionRun = timePerCall(count, [&](std::size_t) { execute(potionScript, stats); stats[0] &= 0xFFFF; });
+		const double potionNative = timePerCall(count, [&](std::size_t) { stats[0] += potion.getHealth(); stats[1] += potion.getMana(); stats[0] &= 0xFFFF; });
+		// (volatile, so the compiler can't see through the pointers)
+		void (*volatile potionCall)(Stats&) = potionEffect;
+		void (*volatile elixirCall)(Stats&) = elixirEffect;
+		const double potionCalled = timePerCall(count, [&](std::size_t) { potionCall(stats); stats[0] &= 0xFFFF; });
+		sink = sink + stats[0];
+		printf("%10s %8.2f %8.2f %8.2f\n", "potion", potionRun, potionNative, potionCalled);
+		const double elixirRun = timePerCall(count, [&](std::size_t) { execute(elixirScript, stats); stats[4] &= 0xFFFF; });
+		const double elixirNative = timePerCall(count, [&](std::size_t) {
+			stats[0] = std::min(stats[0] + elixir.getHealth() * 2, stats[2]);
+			stats[1] = std::max(stats[1] - 5, 0);
+			stats[4] += (stats[10] + 3) / 2;
+			stats[4] &= 0xFFFF;
+		});
+		const double elixirCalled = timePerCall(count, [&](std::size_t) { elixirCall(stats); stats[4] &= 0xFFFF; });
+		sink = sink + stats[4];
+		printf("%10s %8.2f %8.2f %8.2f\n", "elixir", elixirRun, elixirNative, elixirCalled);
 	}
-	ClearScreen();
-	cout << "Q4) What weapon were you skilled with?\n1) Bow\n2) Sword\n3) Staff\n4) Fists." << endl;
-	cin >> pastchoice[3];
-	if (pastchoice[3] < 1 || pastchoice[3] > 4) {
-		cout << "That choice does not exist... Defaulting to 1." << endl;
-		pastchoice[3] = 1;
+	// Times headless fights (rounds per second, on one core).
+	void combat() {
+		cout << "-*- Combat -*-" << endl;
+		Combat::Random random(1, Randomness::streamID(Randomness::Subsystem::BENCHMARK, 0));
+		Combat::Fighter player{};
+		player.hp = player.maxHP = 60; player.mp = player.maxMP = 20;
+		player.str = 6; player.def = 4; player.itl = 4; player.spd = 5; player.crt = 5; player.lvl = 3;
+		Combat::arm(player, &WeaponTable.generate("Iron Blade"));
+		std::size_t rounds = 0, fights = 0, wins = 0;
+		const auto start = std::chrono::steady_clock::now();
+		while (rounds < 20000000) {
+			Combat::State state{ player, Combat::generateEnemy(player, 1.5, random), random };
+			while (state.outcome == Combat::Outcome::ONGOING) {
+				const Combat::Action action{ state.player.mp >= Combat::castCost ? Combat::Action::Type::CAST : Combat::Action::Type::ATTACK };
+				state = Combat::step(state, action).state;
+			}
+			random = state.random;
+			rounds += state.round;
+			fights++;
+			wins += state.outcome == Combat::Outcome::WON;
+		}
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		printf("%zu fights, %zu rounds, %.1f%% won\n%.1f million rounds per second\n", fights, rounds, 100.0 * wins / fights, rounds / seconds / 1e6);
 	}
-	switch (pastchoice[3]) {
-	case 1:
-		Charac.bowprof = Charac.bowprof + .1;
-		break;
-	case 2:
-		Charac.swordprof = Charac.swordprof + .1;
-		break;
-	case 3:
-		Charac.staffprof = Charac.staffprof + .1;
-		break;
-	case 4:
-		Charac.unarmedprof = Charac.unarmedprof + .1;
-		break;
+	// Times enemy generation and volleys, one Fighter at a time against batch columns.
+	void enemies() {
+		cout << "-*- Enemies -*-\n(ns per enemy, " << Combat::VectorLanes::name << " kernels)\n            scalar    batch" << endl;
+		constexpr std::size_t count = 1 << 16;
+		Combat::Random random(1, Randomness::streamID(Randomness::Subsystem::BENCHMARK, 2));
+		Combat::Fighter player{};
+		player.hp = player.maxHP = 60; player.mp = player.maxMP = 20;
+		player.str = 12; player.def = 8; player.itl = 8; player.spd = 10; player.crt = 10; player.lvl = 6;
+		Combat::arm(player, &WeaponTable.generate("Iron Blade"));
+		std::vector<Combat::Fighter> fighters(count);
+		Combat::EnemyBatch batch;
+		const double generate = timePerCall(count, [&](std::size_t i) { fighters[i] = Combat::generateEnemy(player, 1.5, random); });
+		// Once first so the columns are allocated and warm
+		Combat::generateEnemies(player, 1.5, random, batch, count);
+		const double generateBatch = timePerCall(16, [&](std::size_t) { Combat::generateEnemies(player, 1.5, random, batch, count); }) / count;
+		printf("%10s %8.2f %8.2f\n", "generate", generate, generateBatch);
+		// Volleys until everyone is down
+		Combat::Events events;
+		std::size_t volleys = 0, fallen = 0;
+		const auto start = std::chrono::steady_clock::now();
+		for (std::size_t standing = count; standing > 0; volleys++) {
+			for (Combat::Fighter& enemy : fighters) {
+				if (enemy.hp <= 0) continue;
+				events.count = 0;
+				Combat::attack(player, enemy, Combat::Side::PLAYER, random, events);
+				standing -= enemy.hp <= 0;
+			}
+		}
+		const double attack = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (volleys * count);
+		const std::size_t batchVolleys = volleys;
+		volleys = 0;
+		const double volley = timePerCall(batchVolleys, [&](std::size_t) { fallen += Combat::volley(player, batch, random); volleys++; }) / count;
+		printf("%10s %8.2f %8.2f\n(%zu volleys, %zu of %zu fell in the batch)\n", "volley", attack, volley, volleys, fallen, count);
 	}
-	ClearScreen();
-	cout << "Q5) " << endl;
-	ClearScreen();
-	cout << "Q10) Finally, what is your father's name? (No Spaces)" << endl;
-	cin >> Charac.dad;
-	for (size_t i = 0; i < Charac.dad.size(); i++) {
-		Charac.seed += int(Charac.dad[i]);
-	}
-	srand(Charac.seed);
-	Charac.maxHP = Charac.str * Charac.def * Charac.lvl + Charac.difficultyD;
-	Charac.maxMP = Charac.itl * Charac.def * Charac.lvl + Charac.difficultyD;
-	Charac.hp = Charac.maxHP;
-	Charac.mp = Charac.maxMP;
-	if (Charac.maxHP < 10) {
-		Charac.maxHP = 10;
-		Charac.hp = 10;
-	}
-	if (Charac.maxMP < 5) {
-		Charac.maxMP = 5;
-		Charac.mp = 5;
-	}
-	ClearScreen();
-	cout << "Do these stats look ok?\n\nName: " << Charac.name << "\nRace: " << Charac.race << "\nClass: " << Charac.clas << "\nProfession: " << Charac.profession << "\n\nMax Health: " << Charac.maxHP << "\nMax Mana: " << Charac.maxMP << "\n\nStrength: " << Charac.str << "\nDefense: " << Charac.def << "\nIntelligence: " << Charac.itl << "\nSpeed: " << Charac.spd << "\nCritical Chance: " << Charac.crt << "\n\nDifficulty: " << Charac.difficultyN << endl;
-	cout << "\n1) Yes \n2) No" << endl;
-	cin >> input;
-	switch (input) {
-	case 1:
-		Charac.maxHP = Charac.hp;
-		Charac.maxMP = Charac.mp;
-		Charac.inventory.addItem(WeaponTable.generate("Stick"));
-		Charac.equipped = const_cast<Weapon*>(dynamic_cast<const Weapon*>(Charac.inventory.inspectItem(0)));
-		home();
-		break;
-	case 2:
-		Charac.str = 1;
-		Charac.def = 1;
-		Charac.itl = 1;
-		Charac.spd = 1;
-		Charac.crt = 1;
-		Charac.strprof = 1.00;
-		Charac.defprof = 1.00;
-		Charac.spdprof = 1.00;
-		Charac.itlprof = 1.00;
-		Charac.bowprof = 1.00;
-		Charac.swordprof = 1.00;
-		Charac.staffprof = 1.00;
-		Charac.unarmedprof = 1.00;
-		Acc.headdamagex = 2;
-		Acc.chestdamagex = 1;
-		Acc.rightarmdamagex = 1;
-		Acc.leftarmdamagex = 1;
-		Acc.rightlegdamagex = 1;
-		Acc.leftlegdamagex = 1;
-		Charac.race = "None";
-		Charac.clas = "None";
-		chargen();
-		break;
+	// Times level ups for growing experience: one level at a time against levelsFor() and a batch roll.
+	void leveling() {
+		cout << "-*- Leveling -*-\n(ns per level up)\n       exp   levels     loop   closed" << endl;
+		Randomness::Stream random(1, Randomness::streamID(Randomness::Subsystem::BENCHMARK, 3));
+		for (const int exp : { 100, 10000, 1000000, 100000000 }) {
+			constexpr std::size_t count = 1000;
+			int levels = 0;
+			volatile int sink = 0;
+			const double loop = timePerCall(count, [&](std::size_t) {
+				int lvl = 1, str = 1;
+				double expmultiplier = 1;
+				while (exp > Leveling::threshold(lvl, 1.5, expmultiplier)) {
+					lvl++;
+					expmultiplier += .25;
+					str += random.below(2) + 1;
+				}
+				levels = lvl - 1;
+				sink = sink + str;
+			});
+			const double closed = timePerCall(count, [&](std::size_t) {
+				const int gained = Leveling::levelsFor(exp, 1, 1.5, 1);
+				sink = sink + Leveling::roll(gained, random);
+			});
+			printf("%10d %8d %8.1f %8.1f\n", exp, levels, loop, closed);
+		}
 	}
-}
-
-void chargen() {
-	bool chargenboolfin = false;
-	while (chargenboolfin == false) {
-		ClearScreen();
-		cout << "-*- Character Generation -*-" << endl;
-		cout << "1) Name" << endl;
-		cout << "2) Class" << endl;
-		cout << "3) Race" << endl;
-		cout << "4) Continue to Past Selection" << endl;
-		cout << "\n-*- Current Skeleton -*-" << endl;
-		cout << "Name: " << Charac.name << "\nRace: " << Charac.race << "\nClass: " << Charac.clas << endl;
-		cout << "\n-*- Stats -*- \nStrength: " << Charac.str << "\nDefense: " << Charac.def << "\nIntelligence: " << Charac.itl << "\nSpeed: " << Charac.spd << "\nCritical Chance: " << Charac.crt << endl;
-		cin >> input;
-		switch (input) {
-		case 1:
-			cout << "Input your name. No Spaces." << endl;
-			cin >> Charac.name;
-			continue;
-		case 2:
-			ClearScreen();
-			cout << "-*- Classes -*-" << endl;
-			cout << "1) Skeleton Warrior - \nA warrior with more attack spells\n\n2) Skeleton Mage - \nA mage with destructive and healing powers\n\n3) Skeleton Warlock - \nA dangerous class with more spells focusing on damage\n\n4) Bone Baron -\nA skeleton with no spells, only melee" << endl;
-			cin >> input;
-			if (input < 1 || input > 4) {
-				cout << "You cannot do that." << endl;
-				wait_enter();
-				continue;
+	// The items of the saves benchmark (one per slot).
+	inline std::vector<Consumable> savedItems;
+	inline const Item* findSaved(const unsigned short& id) {
+		return id < savedItems.size() ? &savedItems[id] : nullptr;
+	}
+	// Times encoding and decoding saves with growing inventories, and a save and load through a file.
+	void saves() {
+		cout << "-*- Saves -*-\n(microseconds per save or load)\n     slots    bytes   encode   decode     file" << endl;
+		const std::string path = "bench.sav";
+		for (const unsigned int slots : { 20u, 200u, 2000u, 20000u, 65535u }) {
+			savedItems.clear();
+			savedItems.reserve(slots);
+			for (unsigned int i = 0; i < slots; i++)
+				savedItems.push_back(Consumable("Bench Item", "", static_cast<unsigned short>(i), 1, 1, 1, 1));
+			Character character;
+			for (const Consumable& item : savedItems)
+				character.inventory.addItem(item, static_cast<unsigned short>(1 + item.getID() % 99));
+			character.equip(character.inventory.getHandle(slots / 2));
+			Accuracy accuracy;
+			const std::size_t count = std::max(1u, 20000u / slots);
+			std::string bytes;
+			const double encode = timePerCall(count, [&](std::size_t) { bytes = Saves::encode(character, accuracy); }) / 1000;
+			Character loaded;
+			Accuracy aim;
+			const double decode = timePerCall(count, [&](std::size_t) {
+				Saves::decode(reinterpret_cast<const unsigned char*>(bytes.data()), bytes.size(), loaded, aim, findSaved);
+			}) / 1000;
+			const double file = timePerCall(count, [&](std::size_t) {
+				Saves::save(character, accuracy, path);
+				const ItemSystem::Database::MappedFile mapped(path);
+				Saves::decode(mapped.getData(), mapped.getSize(), loaded, aim, findSaved);
+			}) / 1000;
+			printf("%10u %8zu %8.1f %8.1f %8.1f\n", slots, bytes.size(), encode, decode, file);
+		}
+		std::remove(path.c_str());
+	}
+	// Times autosaves (a journal commit of a small change) against writing the whole save, for growing inventories.
+	void journal() {
+		cout << "-*- Journal -*-\n(microseconds per autosave)\n     slots    whole   commit    bytes   syncs" << endl;
+		const std::string path = "bench.sav";
+		for (const unsigned int slots : { 20u, 2000u, 65535u }) {
+			savedItems.clear();
+			savedItems.reserve(slots);
+			for (unsigned int i = 0; i < slots; i++)
+				savedItems.push_back(Consumable("Bench Item", "", static_cast<unsigned short>(i), 1, 1, 1, 1));
+			Character character;
+			for (const Consumable& item : savedItems)
+				character.inventory.addItem(item, 1);
+			Accuracy accuracy;
+			const double whole = timePerCall(20, [&](std::size_t i) {
+				character.dust = static_cast<int>(i);
+				Saves::save(character, accuracy, path);
+			}) / 1000;
+			Saves::Journal journal;
+			journal.open(path, character, accuracy, findSaved);
+			journal.flush();
+			// Buy one of something
+			constexpr std::size_t count = 2000;
+			std::size_t bytes = 0;
+			const double commit = timePerCall(count, [&](std::size_t i) {
+				character.dust = static_cast<int>(i);
+				character.inventory.addItem(savedItems[i % slots]);
+				bytes += journal.commit(character, accuracy);
+			}) / 1000;
+			journal.close();
+			printf("%10u %8.1f %8.1f %8zu %7llu\n", slots, whole, commit, bytes / count, static_cast<unsigned long long>(journal.getCounters().syncs));
+			for (std::uint64_t generation = 0; generation < 1000; generation++)
+				std::remove(Saves::journalPath(path, generation).c_str());
+		}
+		std::remove(path.c_str());
+	}
+	// Times the line that saves (Save at Home) against a line that only redraws Home, for growing inventories.
+	void snapshot() {
+		cout << "-*- Snapshot -*-\n(microseconds from a line to its screen)\n     slots     idle     save    added" << endl;
+		const std::string path = "bench.sav";
+		for (const unsigned int slots : { 20u, 2000u, 65535u }) {
+			savedItems.clear();
+			savedItems.reserve(slots);
+			for (unsigned int i = 0; i < slots; i++)
+				savedItems.push_back(Consumable("Bench Item", "", static_cast<unsigned short>(i), 1, 1, 1, 1));
+			Saves::Journal journal;
+			std::ostream nowhere(nullptr);
+			Scenes::Session session(nowhere, false);
+			for (const Consumable& item : savedItems)
+				session.character.inventory.addItem(item, 1);
+			session.journal = &journal;
+			session.savePath = path;
+			session.start(Scenes::SceneID::HOME);
+			// The first save opens the journal
+			session.handle("5");
+			session.handle("");
+			journal.flush();
+			constexpr std::size_t count = 200;
+			const double idle = timePerCall(count, [&](std::size_t) { session.handle("9"); }) / 1000;
+			// Buy one of something, then save (waiting for each save outside the timing)
+			double save = 0;
+			for (std::size_t i = 0; i < count; i++) {
+				session.character.dust = static_cast<int>(i);
+				session.character.inventory.addItem(savedItems[i % slots]);
+				save += timePerCall(1, [&](std::size_t) { session.handle("5"); }) / 1000;
+				session.handle("");
+				journal.flush();
 			}
-			switch (input) {
-			case 1:
-				Charac.clas = "Skeleton Warrior";
-				continue;
-			case 2:
-				Charac.clas = "Skeleton Mage";
-				continue;
-			case 3:
-				Charac.clas = "Skeleton Warlock";
-				continue;
-			case 4:
-				Charac.clas = "Bone Baron";
-				continue;
+			save /= count;
+			journal.close();
+			printf("%10u %8.1f %8.1f %8.1f\n", slots, idle, save, save - idle);
+			for (std::uint64_t generation = 0; generation < 1000; generation++)
+				std::remove(Saves::journalPath(path, generation).c_str());
+		}
+		std::remove(path.c_str());
+	}
+	// Times a store of many players' saves: saves in batches of 100, then lookups of saves that are there and aren't.
+	void store() {
+		cout << "-*- Store -*-\n(microseconds per save or lookup)\n   players    write      hit     miss  segments  skipped" << endl;
+		const std::string path = "bench.kv";
+		Character character;
+		for (const Consumable& item : ConsumableTable)
+			character.inventory.addItem(item, 3);
+		const Accuracy accuracy;
+		const std::string bytes = Saves::encode(character, accuracy);
+		for (const unsigned int players : { 1000u, 10000u, 50000u }) {
+			Store::Engine store;
+			store.open(path);
+			const double write = timePerCall(players / 100, [&](std::size_t i) {
+				Store::Batch batch;
+				for (std::size_t player = i * 100; player < i * 100 + 100; player++)
+					batch.put(Store::key("Player " + std::to_string(player), 0), bytes);
+				store.write(batch);
+			}) / 100 / 1000;
+			store.flush();
+			std::string value;
+			std::size_t found = 0;
+			const double hit = timePerCall(players, [&](std::size_t i) { found += store.get(Store::key("Player " + std::to_string(i), 0), value); }) / 1000;
+			const double miss = timePerCall(players, [&](std::size_t i) { found += store.get(Store::key("Player " + std::to_string(i), 1), value); }) / 1000;
+			const Store::Engine::Counters counters = store.getCounters();
+			store.close();
+			printf("%10u %8.1f %8.2f %8.2f %9zu %7.1f%%%s\n", players, write, hit, miss, counters.segments,
+				100.0 * counters.skips / std::max<std::uint64_t>(1, counters.skips + counters.probes), found == players ? "" : " (lookups are wrong)");
+			std::remove(path.c_str());
+			for (std::uint64_t number = 0; number < 1000; number++) {
+				std::remove(Store::logPath(path, number).c_str());
+				std::remove(Store::segmentPath(path, number).c_str());
 			}
-			break;
-		case 4:
-			if (Charac.race == "None" || Charac.clas == "None") {
-				cout << "You cannot do that." << endl;
-				wait_enter();
-				continue;
+		}
+	}
+	// Times random whole numbers: rand() % n against Philox streams.
+	void random() {
+		cout << "-*- Random -*-\n(ns per number, 0 to 99)" << endl;
+		constexpr std::size_t count = 1 << 20;
+		std::vector<std::uint32_t> numbers(count);
+		Randomness::Stream stream(1, Randomness::streamID(Randomness::Subsystem::BENCHMARK, 1));
+		std::srand(1);
+		const double crand = timePerCall(count, [&](std::size_t i) { numbers[i] = std::rand() % 100; });
+		const double single = timePerCall(count, [&](std::size_t i) { numbers[i] = stream.below(100); });
+		const double batch = timePerCall(1, [&](std::size_t) { stream.fillBelow(numbers.data(), count, 100); }) / count;
+		// Check the batch is uniform (chi-squared over the 100 values, about 99 expected)
+		std::array<std::size_t, 100> seen{};
+		for (const std::uint32_t& number : numbers) seen[number]++;
+		double chi = 0;
+		for (const std::size_t& hits : seen) chi += (hits - count / 100.0) * (hits - count / 100.0) / (count / 100.0);
+		printf("rand() %% n %8.2f\nbelow()    %8.2f\nfillBelow()%8.2f   (chi-squared %.1f)\n", crand, single, batch, chi);
+	}
+	// Runs the benchmarks named on the command line.
+	int run(const std::vector<std::string_view>& names) {
+		const std::pair<std::string_view, void(*)()> benchmarks[] = {
+			{ "inventory", inventory },
+			{ "sorting", sorting },
+			{ "scripting", scripting },
+			{ "combat", combat },
+			{ "enemies", enemies },
+			{ "leveling", leveling },
+			{ "saves", saves },
+			{ "journal", journal },
+			{ "snapshot", snapshot },
+			{ "store", store },
+			{ "random", random }
+		};
+		for (const auto& name : names) {
+			bool found = false;
+			for (const auto& benchmark : benchmarks) {
+				if (name == benchmark.first || name == "all") {
+					benchmark.second();
+					found = true;
+				}
 			}
-			pastselec();
-			break;
-		case 3:
-			ClearScreen();
-			Charac.str = 1;
-			Charac.itl = 1;
-			Charac.def = 1;
-			Charac.crt = 1;
-			Charac.spd = 1;
-			ClearScreen();
-			cout << "-*- Race -*-" << endl;
-			cout << "1) Human Skeleton - \n+3 Str || +2 Def\n\n2) Kobold Skeleton -\n+3 Crt || +2 Spd\n\n3) Bone Dragonborn - \n+5 Str \n\n4) Skeleton Scholar - \n+4 Itl || +1 Spd \n\n5) Coag Skeleton - \n+5 Def\n\n6) Dust Skeleton - \n+1 All" << endl;
-			cin >> input;
-			switch (input) {
-			case 1:
-				Charac.race = "Human Skeleton";
-				Charac.str = Charac.str + 3;
-				Charac.def = Charac.def + 2;
-				continue;
-			case 2:
-				Charac.race = "Kobold Skeleton";
-				Charac.crt = Charac.crt + 3;
-				Charac.spd = Charac.spd + 2;
-				continue;
-			case 3:
-				Charac.race = "Bone Dragonborn";
-				Charac.str = Charac.str + 5;
-				continue;
-			case 4:
-				Charac.race = "Skeleton Scholar";
-				Charac.itl = Charac.itl + 4;
-				Charac.spd = Charac.spd + 1;
-				continue;
-			case 5:
-				Charac.race = "Coag Skeleton";
-				Charac.def = Charac.def + 5;
-				continue;
-			case 6:
-				Charac.race = "Dust Skeleton";
-				Charac.str = Charac.str + 1;
-				Charac.def = Charac.def + 1;
-				Charac.crt = Charac.crt + 1;
-				Charac.spd = Charac.spd + 1;
-				Charac.itl = Charac.itl + 1;
-				continue;
+			if (!found) {
+				cout << "Unknown benchmark: " << name << endl;
+				return 1;
 			}
 		}
-		break;
+		return 0;
 	}
 }
 
-int main()
+// Reads the command line argument at index (if there is one) as a whole number from least to most. Returns false if it isn't one.
+template<class Number>
+bool numberArgument(const int& argc, char* argv[], const int& index, const Number& least, const Number& most, Number& value) {
+	if (index >= argc) return true;
+	const std::string_view text = argv[index];
+	Number parsed{};
+	const std::from_chars_result result = std::from_chars(text.data(), text.data() + text.size(), parsed);
+	if (result.ec != std::errc() || result.ptr != text.data() + text.size() || parsed < least || parsed > most) {
+		cout << "Expected a number from " << +least << " to " << +most << ", not \"" << text << "\"" << endl;
+		return false;
+	}
+	value = parsed;
+	return true;
+}
+// Prints how to start the game (for a command line it couldn't read).
+int usage() {
+	cout << "Usage: bones [--script <path> | --count-writes]\n"
+		"       bones --bot [games] [seed]\n"
+		"       bones --balance [runs] [seed] [threads]\n"
+		"       bones --bench <name>... | all\n"
+		"       bones --compile-items [path]\n"
+		"       bones --serve [port] [store]\n"
+		"       bones --load [sessions] [port] [script]" << endl;
+	return 1;
+}
+
+int main(int argc, char* argv[])
 {
-	cout << "-*- Bones -*-\n1) Start\n2) Load\n\nWARNING: Loads don't work." << endl; //Start Screen
-	cin >> input;
-	switch (input) { //Switch statement for the starting, can either be chargen or load
-	case 1:
-		chargen();
-		break;
-	case 2:
-		break;
-	case 3267:
-		cout << "Quickstart activated. Giving DEV Weapon." << endl;
-		Charac.inventory.addItem(WeaponTable.generate("Modal Soul"));
-		Charac.equipped = const_cast<Weapon*>(dynamic_cast<const Weapon*>(Charac.inventory.inspectItem(0)));
-		Charac.dust = 99999;
-		cin >> Charac.dad;
-		for (size_t i = 0; i < Charac.dad.size(); i++) {
-			Charac.seed += int(Charac.dad[i]);
-		}
-		srand(Charac.seed);
-		wait_enter();
-		Charac.inventory.addItem(ConsumableTable.generate("Normal Health Potion"));
-		Charac.inventory.addItem(ConsumableTable.generate("Normal Health Potion"));
-		Charac.inventory.addItem(ConsumableTable.generate("Greater Health Potion"));
-		Charac.inventory.addItem(ConsumableTable.generate("Super Health Potion"));
-		home();
-		break;
+	constexpr std::uint64_t most = std::numeric_limits<std::uint64_t>::max();
+	// Developer modes
+	if (argc > 2 && std::string_view(argv[1]) == "--bench")
+		return Benchmarks::run(std::vector<std::string_view>(argv + 2, argv + argc));
+	if (argc > 1 && std::string_view(argv[1]) == "--balance") {
+		std::uint64_t runs = 1000000, seed = 1;
+		unsigned int threads = 0;
+		if (!numberArgument(argc, argv, 2, std::uint64_t(1), std::uint64_t(1) << 40, runs) || !numberArgument(argc, argv, 3, std::uint64_t(0), most, seed)
+			|| !numberArgument(argc, argv, 4, 0u, 1024u, threads))
+			return usage();
+		return Balance::run(runs, seed, threads);
+	}
+	if (argc > 1 && std::string_view(argv[1]) == "--compile-items") {
+		const std::string path = argc > 2 ? argv[2] : ItemSystem::Database::defaultPath;
+		try {
+			ItemSystem::Database::compile(path);
+		}
+		catch (const std::exception& e) {
+			cout << e.what() << endl;
+			return 1;
+		}
+		cout << "Wrote " << path << endl;
+		return 0;
+	}
+	if (argc > 1 && std::string_view(argv[1]) == "--bot") {
+		std::uint64_t games = 100, seed = 1;
+		if (!numberArgument(argc, argv, 2, std::uint64_t(1), std::uint64_t(1) << 40, games) || !numberArgument(argc, argv, 3, std::uint64_t(0), most, seed))
+			return usage();
+		return Bot::run(games, seed);
+	}
+	// Serve games over TCP on localhost (and load the server)
+	if (argc > 1 && std::string_view(argv[1]) == "--serve") {
+		std::uint16_t port = Server::defaultPort;
+		if (!numberArgument(argc, argv, 2, std::uint16_t(1), std::uint16_t(65535), port))
+			return usage();
+		try {
+			ItemSystem::Database::load(ItemSystem::Database::defaultPath);
+		}
+		catch (const std::exception& e) {
+			cout << e.what() << "\nUsing the built-in items." << endl;
+		}
+		return Server::run(port, argc > 3 ? argv[3] : Server::defaultStore);
+	}
+	if (argc > 1 && std::string_view(argv[1]) == "--load") {
+		std::size_t sessions = 1000;
+		std::uint16_t port = Server::defaultPort;
+		if (!numberArgument(argc, argv, 2, std::size_t(1), std::size_t(1000000), sessions) || !numberArgument(argc, argv, 3, std::uint16_t(1), std::uint16_t(65535), port))
+			return usage();
+		std::string script = Server::defaultScript();
+		if (argc > 4) {
+			std::ifstream in(argv[4], std::ios::binary);
+			if (!in) {
+				cout << "Can't open " << argv[4] << endl;
+				return 1;
+			}
+			script.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		}
+		return Server::replay(sessions, port, script);
+	}
+	// Draw screens in-process, a frame at a time (--count-writes prints what each costs)
+	Terminal::reporting = argc > 1 && std::string_view(argv[1]) == "--count-writes";
+	Terminal::install();
+	// Use the item database if there is one
+	try {
+		ItemSystem::Database::load(ItemSystem::Database::defaultPath);
+	}
+	catch (const std::exception& e) {
+		cout << e.what() << "\nUsing the built-in items." << endl;
+	}
+	// Play scene by scene, a line at a time (from a file with --script <path>)
+	Scenes::Input input = Scenes::Input::terminal();
+	if (argc > 2 && std::string_view(argv[1]) == "--script") {
+		try {
+			input = Scenes::Input::file(argv[2]);
+		}
+		catch (const std::exception& e) {
+			cout << e.what() << endl;
+			return 1;
+		}
 	}
+	// Saved games autosave as they play
+	Saves::Journal journal;
+	Scenes::Session session;
+	session.journal = &journal;
+	session.start(Scenes::SceneID::START);
+	session.play(input);
 	return 0;
 }